@@ -0,0 +1,1358 @@
+// --------------------------------------------
+// HeadlessBenchmark.cpp
+// --------------------------------------------
+// Runs the raytracer, pathfinding, particle
+// and terrain workloads with fixed settings
+// and no window, so they can be timed on a
+// build server. Each workload does the same
+// work as its test in the app: the same
+// scene, map, bots and particle amounts, and
+// the same split into jobs when running on
+// more than one thread. Only the compute is
+// timed, never the loading or the upload to
+// the GPU (there isn't one).
+// A thread count of 1 runs each workload's
+// single-threaded path. N runs it on a pool
+// of N - 1 threads plus the main thread.
+// Every result is the summary of several
+// timed runs, see Benchmark.h.
+//
+// This is a separate program with its own
+// main(), so it isn't part of the Visual
+// Studio project. Build it from the project
+// folder with:
+// g++ -O2 -std=c++17 -Ih -ISFML-2.6.0/include bench/HeadlessBenchmark.cpp src/ThreadPool.cpp src/Benchmark.cpp src/ScalingSweep.cpp src/TaskGraph.cpp src/Profiler.cpp src/RayScene.cpp src/RayBounds.cpp src/HDRBuffer.cpp src/DynamicResolution.cpp src/BVH.cpp src/SphereSoA.cpp src/TerrainMap.cpp src/PerfCounters.cpp src/Noise.cpp src/AStar.cpp src/DefaultParticle.cpp -pthread -lsfml-system -o headless_bench
+// and run it from the project folder too, so
+// the map and bot files can be found.
+//
+// Options:
+// --threads 1,2,4      Thread counts to test
+//                      (default 1 and every
+//                      hardware thread)
+// --workloads a,b      Any of raytracer,
+//                      pathfinding, particles
+//                      and terrain (default all)
+// --warmup N           Untimed runs before the
+//                      timed ones (default 1)
+// --repetitions N      Timed runs per result
+//                      (default 5)
+// --json file          Write the results as JSON
+// --csv file           Write the results as CSV
+// --compare old new    Compare two CSV files
+//                      instead of running
+//                      anything. Exits with 2 if
+//                      anything got slower
+// --threshold P        The smallest change in
+//                      the median that counts
+//                      when comparing, as a
+//                      percentage (default 2)
+// --sweep              Test 1, 2, 4 ... every
+//                      hardware thread and show
+//                      speedup, efficiency and
+//                      the serial fraction
+// --scaling file       Write the sweep's
+//                      scaling as CSV
+// --spheres N          Scatter N more spheres
+//                      into the raytracer's
+//                      scene (default 0)
+// --scalar             Test spheres one at a
+//                      time instead of 8 at a
+//                      time with AVX
+// --single-rays        Trace the raytracer's
+//                      rays one at a time instead
+//                      of in 8x8 packets
+// --no-bins            Trace the raytracer's
+//                      camera rays through the
+//                      BVH instead of binning
+//                      the spheres by the pixels
+//                      they cover
+// --no-shadow-cache    Don't test the sphere
+//                      that blocked the last
+//                      shadow ray to a light
+//                      first
+// --aa-grid N          Anti-alias the raytracer's
+//                      edges with N x N samples
+//                      (default 1, none)
+// --validate           Check that the AVX and
+//                      scalar sphere tests match
+//                      Sphere::intersect bit for
+//                      bit, and that packets (with
+//                      and without bins) match
+//                      single rays, with and
+//                      without the shadow
+//                      cache, and that HDR
+//                      renders resolve to the
+//                      same pixels, and that the
+//                      BVH still matches testing
+//                      every sphere after each
+//                      of many random edits,
+//                      that rendering only the
+//                      tiles an edit could change
+//                      matches rendering them all,
+//                      and that the completion
+//                      queue hands over every
+//                      item exactly once with
+//                      several threads pushing,
+//                      instead of running
+//                      anything. Exits with 1 if
+//                      they don't
+// --real-time          Render the raytracer's
+//                      scene in real time with
+//                      dynamic resolution at
+//                      each thread count, and
+//                      show the resolution and
+//                      bounces it settles on and
+//                      its frame times, instead
+//                      of running the workloads
+// --frame-budget MS    The real-time frame
+//                      budget (default 16)
+// --------------------------------------------
+
+#include "ThreadPool.h"
+#include "ParallelFor.h"
+#include "RayScene.h"
+#include "DynamicResolution.h"
+#include "SphereSoA.h"
+#include "TerrainMap.h"
+#include "AStar.h"
+#include "DefaultParticle.h"
+#include "Generator.h"
+#include "Benchmark.h"
+#include "ScalingSweep.h"
+#include "CompletionQueue.h"
+#include "Timer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Set by --spheres
+static int scatterAmount = 0;
+
+// Cleared by --single-rays
+static bool usePackets = true;
+
+// Cleared by --no-bins
+static bool useBins = true;
+
+// Cleared by --no-shadow-cache
+static bool useShadowCache = true;
+
+// Set by --aa-grid
+static int aaGrid = 1;
+
+// Set by --frame-budget
+static float frameBudgetMs = 16.0f;
+
+/// <summary>
+/// Render the raytracer's demo scene at 1280x720, plus any scattered spheres.
+/// Multi-threaded renders use the app's default 64x64 tiles.
+/// Building the BVH isn't timed, but binning the spheres is, as the app
+/// does it for every render.
+/// </summary>
+/// <param name="pool">The pool to run on.</param>
+/// <param name="threads">The number of threads to use, 1 for the single-threaded path.</param>
+/// <returns>The time taken in milliseconds.</returns>
+static double runRaytracer(ThreadPool &pool, int threads)
+{
+	const int renderW = 1280;
+	const int renderH = 720;
+
+	RayScene scene;
+	std::vector<uint8_t> pixelArray(renderW * renderH * 4);
+
+	scene.scatterSpheres(scatterAmount, 1);
+	scene.build();
+	scene.usePackets = usePackets;
+	scene.useBins = useBins;
+	scene.useShadowCache = useShadowCache;
+	scene.aaGrid = aaGrid;
+
+	Timer timer("Raytracer");
+
+	if (useBins)
+	{
+		scene.binSpheres(renderW, renderH);
+	}
+
+	if (threads > 1)
+	{
+		parallelFor2D(pool, { 0, 0, renderW, renderH }, { 64, 64 }, [&](const Range2D &tile)
+		{
+			scene.renderSection(pixelArray, renderW, renderH, { tile.beginX, tile.beginY }, { tile.endX, tile.endY });
+		}, threads);
+	}
+	else
+	{
+		scene.renderSection(pixelArray, renderW, renderH, { 0, 0 }, { renderW, renderH });
+	}
+
+	return timer.stop();
+}
+
+/// <summary>
+/// Render the raytracer's demo scene, plus any scattered spheres, in real time
+/// at 1280x720, the same way as the app's real-time mode, at each thread count.
+/// The first frames let the resolution and bounces settle, then the rest are
+/// timed. Only the render, resolve and upscale are timed, not the upload to the
+/// texture, so frames within the budget leave room for the rest of the frame.
+/// </summary>
+/// <param name="threadCounts">The thread counts to test.</param>
+/// <returns>0, as there's nothing to fail.</returns>
+static int runRealTime(const std::vector<int> &threadCounts)
+{
+	const int outputW = 1280;
+	const int outputH = 720;
+	const int settleFrames = 60;
+	const int timedFrames = 240;
+
+	RayScene scene;
+	std::vector<uint8_t> pixelArray;
+
+	scene.scatterSpheres(scatterAmount, 1);
+	scene.build();
+	scene.usePackets = usePackets;
+	scene.useBins = useBins;
+	scene.useShadowCache = useShadowCache;
+	scene.aaGrid = aaGrid;
+
+	std::printf("Real-time at %dx%d with a %.1f ms budget\n", outputW, outputH, frameBudgetMs);
+	std::printf("%8s %8s %8s %10s %10s %10s %8s %6s\n", "threads", "scale", "bounces", "median", "p95", "max", "over", "fps");
+
+	for (int threads : threadCounts)
+	{
+		ThreadPool pool(threads - 1);
+		DynamicResolution dynamicResolution;
+		dynamicResolution.budgetMs = frameBudgetMs;
+
+		for (int i = 0; i < settleFrames; ++i)
+		{
+			dynamicResolution.renderFrame(scene, pool, threads, { 64, 64 }, pixelArray, outputW, outputH, 1.0f, false);
+		}
+
+		std::vector<double> frames;
+		int overBudget = 0;
+
+		for (int i = 0; i < timedFrames; ++i)
+		{
+			frames.push_back(dynamicResolution.renderFrame(scene, pool, threads, { 64, 64 }, pixelArray, outputW, outputH, 1.0f, false));
+			overBudget += frames.back() > frameBudgetMs ? 1 : 0;
+		}
+
+		double total = 0.0;
+
+		for (double frame : frames)
+		{
+			total += frame;
+		}
+
+		BenchmarkSummary summary = Benchmark::summarise(frames);
+
+		std::printf("%8d %7.0f%% %8d %10.3f %10.3f %10.3f %7.1f%% %6.0f\n", threads, dynamicResolution.getScale() * 100.0f, dynamicResolution.getBounces(),
+			summary.median, summary.p95, *std::max_element(frames.begin(), frames.end()), 100.0 * overBudget / timedFrames, 1000.0 * timedFrames / total);
+	}
+
+	return 0;
+}
+
+/// <summary>
+/// Search for a path from every demo bot to the default destination.
+/// The map and bots are loaded from the same files as the Pathfinding test.
+/// </summary>
+/// <param name="pool">The pool to run on.</param>
+/// <param name="threads">The number of threads to use, 1 for the single-threaded path.</param>
+/// <returns>The time taken in milliseconds, or a negative value if the files couldn't be read.</returns>
+static double runPathfinding(ThreadPool &pool, int threads)
+{
+	const int mapWidth = 256;
+	const int mapHeight = 256;
+	const sf::Vector2i destinationNode{ 4, 4 };
+
+	// The obstacle layer, stored as comma separated tile IDs
+	std::vector<int> mapData(mapWidth * mapHeight);
+	std::ifstream data("assets/pathfinding_map_layer_1.txt");
+	std::string line;
+	int counter = 0;
+
+	while (std::getline(data, line, ',') && counter < mapWidth * mapHeight)
+	{
+		mapData[counter] = std::atoi(line.c_str());
+		counter++;
+	}
+
+	// Each bot gets its own search, the same as a Bot does
+	std::vector<sf::Vector2i> positions;
+	std::vector<std::unique_ptr<AStar>> searches;
+	std::ifstream botFile("bot_positions.txt");
+
+	while (std::getline(botFile, line))
+	{
+		std::istringstream iss(line);
+
+		int x, y;
+		char comma;
+
+		if (iss >> x >> comma >> y)
+		{
+			positions.push_back({ x, y });
+			searches.push_back(std::make_unique<AStar>(mapData, mapWidth, mapHeight));
+		}
+	}
+
+	if (counter == 0 || searches.empty())
+	{
+		return -1.0;
+	}
+
+	Timer timer("Pathfinding");
+
+	if (threads > 1)
+	{
+		parallelFor(pool, 0, static_cast<int>(searches.size()), 1, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				searches[i]->run(positions[i], destinationNode);
+			}
+		}, threads);
+	}
+	else
+	{
+		for (std::size_t i = 0; i < searches.size(); ++i)
+		{
+			searches[i]->run(positions[i], destinationNode);
+		}
+	}
+
+	return timer.stop();
+}
+
+/// <summary>
+/// Update 500,000 particles for 60 frames at 60fps.
+/// There are always 16 generators so the work is the same at every
+/// thread count, and each one has its own random number generator.
+/// </summary>
+/// <param name="pool">The pool to run on.</param>
+/// <param name="threads">The number of threads to use, 1 for the single-threaded path.</param>
+/// <returns>The time taken in milliseconds.</returns>
+static double runParticles(ThreadPool &pool, int threads)
+{
+	const int generatorAmount = 16;
+	const int frameAmount = 60;
+	int scrW = 1280;
+	int numOfParticles = 500000;
+	float speed = 180.0f;
+	float timeToLive = 20.0f;
+	sf::Vector2f startPosition(640.0f, 360.0f);
+	sf::Time dt = sf::seconds(1.0f / 60.0f);
+	std::vector<uint8_t> pixels(1280 * 720 * 4);
+
+	std::vector<std::mt19937> gens;
+	std::vector<std::unique_ptr<Generator>> generators;
+	std::vector<std::unique_ptr<DefaultParticle>> particles;
+
+	for (int i = 0; i < generatorAmount; ++i)
+	{
+		gens.emplace_back(i);
+	}
+
+	for (int i = 0; i < generatorAmount; ++i)
+	{
+		generators.push_back(std::make_unique<Generator>(startPosition, dt, numOfParticles, speed, timeToLive, &pixels));
+
+		for (int n = 0; n < numOfParticles / generatorAmount; ++n)
+		{
+			particles.push_back(std::make_unique<DefaultParticle>(gens[i]));
+			generators.back()->particlePool.push_back(particles.back().get());
+		}
+	}
+
+	Timer timer("Particles");
+
+	for (int frame = 0; frame < frameAmount; ++frame)
+	{
+		std::fill(pixels.begin(), pixels.end(), 0);
+
+		if (threads > 1)
+		{
+			parallelFor(pool, 0, generatorAmount, 1, [&](int begin, int end)
+			{
+				for (int i = begin; i < end; ++i)
+				{
+					generators[i]->update(scrW, generatorAmount);
+				}
+			}, threads);
+		}
+		else
+		{
+			for (auto &generator : generators)
+			{
+				generator->update(scrW, generatorAmount);
+			}
+		}
+	}
+
+	return timer.stop();
+}
+
+/// <summary>
+/// Generate and colour in the Terrain Generator test's default 960x960 map.
+/// </summary>
+/// <param name="pool">The pool to run on.</param>
+/// <param name="threads">The number of threads to use, 1 for the single-threaded path.</param>
+/// <returns>The time taken in milliseconds.</returns>
+static double runTerrain(ThreadPool &pool, int threads)
+{
+	TerrainMap terrainMap(pool);
+
+	Timer timer("Terrain");
+
+	terrainMap.generate(960, 960, 500, 0, threads > 1, threads);
+
+	return timer.stop();
+}
+
+/// <summary>
+/// Split a comma separated list.
+/// </summary>
+/// <param name="text">The list.</param>
+/// <returns>Each item in the list.</returns>
+static std::vector<std::string> splitList(const std::string &text)
+{
+	std::vector<std::string> items;
+	std::istringstream iss(text);
+	std::string item;
+
+	while (std::getline(iss, item, ','))
+	{
+		if (!item.empty())
+		{
+			items.push_back(item);
+		}
+	}
+
+	return items;
+}
+
+/// <summary>
+/// Write the results as JSON.
+/// </summary>
+/// <param name="path">The file to write.</param>
+/// <param name="results">The results.</param>
+/// <param name="settings">The number of warmup and timed runs per result.</param>
+/// <returns>True if the file was written.</returns>
+static bool writeJson(const std::string &path, const std::vector<BenchmarkResult> &results, const BenchmarkSettings &settings)
+{
+	std::ofstream file(path);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	file << std::fixed << std::setprecision(4);
+	file << "{\n  \"hardwareThreads\": " << std::thread::hardware_concurrency() << ",\n";
+	file << "  \"warmup\": " << settings.warmup << ",\n";
+	file << "  \"repetitions\": " << settings.repetitions << ",\n";
+	file << "  \"results\": [";
+
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		const BenchmarkSummary &summary = results[i].summary;
+
+		file << (i == 0 ? "\n" : ",\n");
+		file << "    { \"workload\": \"" << results[i].workload << "\", \"threads\": " << results[i].threads
+			<< ", \"samples\": " << summary.samples << ", \"outliers\": " << summary.outliers
+			<< ", \"min\": " << summary.min << ", \"median\": " << summary.median << ", \"p95\": " << summary.p95
+			<< ", \"mean\": " << summary.mean << ", \"stddev\": " << summary.stddev
+			<< ", \"ciLow\": " << summary.ciLow << ", \"ciHigh\": " << summary.ciHigh << " }";
+	}
+
+	file << "\n  ]\n}\n";
+
+	return file.good();
+}
+
+/// <summary>
+/// Compare two result files and print every workload and thread count found in both.
+/// </summary>
+/// <param name="baselinePath">The older results.</param>
+/// <param name="currentPath">The newer results.</param>
+/// <param name="thresholdPercent">The smallest change in the median that counts, as a percentage.</param>
+/// <returns>0 if nothing got slower, 1 if a file couldn't be read and 2 if something got slower.</returns>
+static int compareFiles(const std::string &baselinePath, const std::string &currentPath, double thresholdPercent)
+{
+	std::vector<BenchmarkResult> baseline;
+	std::vector<BenchmarkResult> current;
+
+	if (!Benchmark::loadResults(baselinePath, baseline))
+	{
+		std::fprintf(stderr, "Couldn't read %s\n", baselinePath.c_str());
+		return 1;
+	}
+
+	if (!Benchmark::loadResults(currentPath, current))
+	{
+		std::fprintf(stderr, "Couldn't read %s\n", currentPath.c_str());
+		return 1;
+	}
+
+	int regressions = 0;
+
+	std::printf("%-12s %8s %12s %12s %9s  %s\n", "workload", "threads", "old median", "new median", "change", "verdict");
+
+	for (const BenchmarkResult &newer : current)
+	{
+		for (const BenchmarkResult &older : baseline)
+		{
+			if (older.workload != newer.workload || older.threads != newer.threads)
+			{
+				continue;
+			}
+
+			BenchmarkComparison comparison = Benchmark::compare(older.summary, newer.summary, thresholdPercent);
+			const char *verdict = "same";
+
+			if (comparison.regression)
+			{
+				verdict = "SLOWER";
+				regressions++;
+			}
+			else if (comparison.improvement)
+			{
+				verdict = "faster";
+			}
+			else if (comparison.significant)
+			{
+				verdict = "same (below threshold)";
+			}
+
+			std::printf("%-12s %8d %12.3f %12.3f %+8.2f%%  %s\n", newer.workload.c_str(), newer.threads,
+				older.summary.median, newer.summary.median, comparison.changePercent, verdict);
+		}
+	}
+
+	return regressions > 0 ? 2 : 0;
+}
+
+/// <summary>
+/// Trace one ray through the scene's BVH, with AVX and without, and compare
+/// its closest hit and shadow test with testing every sphere one by one.
+/// </summary>
+/// <param name="scene">The scene, which must be built.</param>
+/// <param name="rayOrigin">The origin point of the ray.</param>
+/// <param name="rayDir">The direction of the ray.</param>
+/// <returns>How many of the ways the ray was traced didn't match.</returns>
+static int countRayMismatches(const RayScene &scene, const Vec3f &rayOrigin, const Vec3f &rayDir)
+{
+	// Every sphere one by one, as the raytracer used to
+	float bruteNear = INFINITY;
+	bool bruteShadow = false;
+
+	for (std::size_t j = 0; j < scene.spheres.size(); ++j)
+	{
+		float t0 = INFINITY;
+		float t1 = INFINITY;
+
+		if (scene.spheres[j].intersect(rayOrigin, rayDir, t0, t1))
+		{
+			bruteShadow |= j != 0;
+			bruteNear = std::min(bruteNear, t0 < 0 ? t1 : t0);
+		}
+	}
+
+	int mismatches = 0;
+
+	for (int simd = 0; simd <= (SphereSoA::isSIMDAvailable() ? 1 : 0); ++simd)
+	{
+		SphereSoA::setSIMDEnabled(simd == 1);
+
+		float tNear = INFINITY;
+		int hitIndex = -1;
+		int shadowIndex = -1;
+
+		scene.getBVH().closestHit(rayOrigin, rayDir, tNear, hitIndex);
+
+		// Compare the bits, so even a difference in the last place counts
+		if (std::memcmp(&tNear, &bruteNear, sizeof(float)) != 0 || scene.getBVH().anyHit(rayOrigin, rayDir, 0, shadowIndex) != bruteShadow)
+		{
+			mismatches++;
+		}
+	}
+
+	return mismatches;
+}
+
+/// <summary>
+/// Check that tracing through the BVH gives exactly the same results with the
+/// AVX and scalar sphere tests, and the same as testing every sphere with
+/// Sphere::intersect. Each random ray's closest hit and shadow test are
+/// compared, then whole renders traced with and without packets. Last, an
+/// HDR render is resolved and compared with one straight to pixels, and
+/// accumulated samples are resolved with AVX and without.
+/// </summary>
+/// <returns>0 if everything matched, 1 if anything didn't.</returns>
+static int validateSpheres()
+{
+	const int rayAmount = 20000;
+	const int renderW = 640;
+	const int renderH = 360;
+
+	RayScene scene;
+	scene.scatterSpheres(std::max(scatterAmount, 10000), 1);
+	scene.build();
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	bool simdAvailable = SphereSoA::isSIMDAvailable();
+	int mismatches = 0;
+
+	for (int i = 0; i < rayAmount; ++i)
+	{
+		Vec3f rayOrigin(unit(random) * 20.0f, 1.0f + unit(random), 10.0f + unit(random) * 10.0f);
+		Vec3f rayDir(unit(random), unit(random) * 0.2f, -1.0f);
+		rayDir.normalize();
+
+		mismatches += countRayMismatches(scene, rayOrigin, rayDir);
+	}
+
+	std::printf("Rays: %d tested against %d spheres, %d mismatches\n", rayAmount, static_cast<int>(scene.spheres.size()), mismatches);
+
+	// Packets must find exactly the same hits as single rays, whether they go through the BVH or the bins
+	std::vector<uint8_t> packetPixels(renderW * renderH * 4);
+	std::vector<uint8_t> binnedPixels(renderW * renderH * 4);
+	std::vector<uint8_t> singlePixels(renderW * renderH * 4);
+
+	scene.usePackets = true;
+	scene.useBins = false;
+	scene.renderSection(packetPixels, renderW, renderH, { 0, 0 }, { renderW, renderH });
+	scene.useBins = true;
+	scene.binSpheres(renderW, renderH);
+	scene.renderSection(binnedPixels, renderW, renderH, { 0, 0 }, { renderW, renderH });
+	scene.usePackets = false;
+	scene.renderSection(singlePixels, renderW, renderH, { 0, 0 }, { renderW, renderH });
+
+	bool samePackets = packetPixels == singlePixels;
+	bool sameBins = binnedPixels == singlePixels;
+	mismatches += (samePackets ? 0 : 1) + (sameBins ? 0 : 1);
+
+	std::printf("Render: packets and single rays %s\n", samePackets ? "match" : "DON'T MATCH");
+	std::printf("Render: binned packets and single rays %s\n", sameBins ? "match" : "DON'T MATCH");
+
+	// The shadow cache only saves searching the BVH, so it mustn't change which shadow rays are blocked
+	std::vector<uint8_t> uncachedPixels(renderW * renderH * 4);
+	bool sameCache = true;
+
+	scene.useShadowCache = false;
+
+	for (int packets = 0; packets <= 1; ++packets)
+	{
+		scene.usePackets = packets == 1;
+		scene.renderSection(uncachedPixels, renderW, renderH, { 0, 0 }, { renderW, renderH });
+		sameCache = sameCache && uncachedPixels == singlePixels;
+	}
+
+	mismatches += sameCache ? 0 : 1;
+	scene.useShadowCache = true;
+
+	std::printf("Render: with and without the shadow cache %s\n", sameCache ? "match" : "DON'T MATCH");
+
+	scene.usePackets = true;
+
+	std::vector<uint8_t> scalarPixels(renderW * renderH * 4);
+	std::vector<uint8_t> simdPixels(renderW * renderH * 4);
+
+	SphereSoA::setSIMDEnabled(false);
+	scene.renderSection(scalarPixels, renderW, renderH, { 0, 0 }, { renderW, renderH });
+
+	if (simdAvailable)
+	{
+		SphereSoA::setSIMDEnabled(true);
+		scene.renderSection(simdPixels, renderW, renderH, { 0, 0 }, { renderW, renderH });
+
+		bool sameRender = scalarPixels == simdPixels;
+		mismatches += sameRender ? 0 : 1;
+
+		std::printf("Render: AVX and scalar %s\n", sameRender ? "match" : "DON'T MATCH");
+	}
+	else
+	{
+		std::printf("Render: AVX isn't available, only the scalar tests were checked\n");
+	}
+
+	// With no exposure change and clamping, one HDR sample must show exactly as rendering straight to pixels does
+	HDRBuffer hdrBuffer;
+	std::vector<uint8_t> resolvedPixels(renderW * renderH * 4);
+
+	SphereSoA::setSIMDEnabled(false);
+	hdrBuffer.resize(renderW, renderH);
+	scene.renderSection(hdrBuffer, { 0, 0 }, { renderW, renderH });
+	hdrBuffer.resolve(resolvedPixels.data(), 0, 0, renderW, renderH, 1.0f, false);
+
+	bool sameHDR = resolvedPixels == scalarPixels;
+	mismatches += sameHDR ? 0 : 1;
+
+	std::printf("Render: HDR resolved and straight to pixels %s\n", sameHDR ? "match" : "DON'T MATCH");
+
+	if (simdAvailable)
+	{
+		for (int sample = 0; sample < 3; ++sample)
+		{
+			scene.renderSection(hdrBuffer, { 0, 0 }, { renderW, renderH }, 1, 0, nullptr, true);
+		}
+
+		// Exposure pushes plenty of colours past the soft clip's knee and past 1
+		bool sameResolve = true;
+
+		for (int softClip = 0; softClip <= 1; ++softClip)
+		{
+			hdrBuffer.resolve(resolvedPixels.data(), 0, 0, renderW, renderH, 1.5f, softClip == 1);
+			SphereSoA::setSIMDEnabled(true);
+			hdrBuffer.resolve(simdPixels.data(), 0, 0, renderW, renderH, 1.5f, softClip == 1);
+			SphereSoA::setSIMDEnabled(false);
+
+			sameResolve = sameResolve && resolvedPixels == simdPixels;
+		}
+
+		mismatches += sameResolve ? 0 : 1;
+
+		std::printf("Resolve: AVX and scalar %s\n", sameResolve ? "match" : "DON'T MATCH");
+	}
+
+	return mismatches > 0 ? 1 : 0;
+}
+
+/// <summary>
+/// Check that the BVH still finds exactly what testing every sphere does after
+/// each of a long random run of edits. Spheres are moved a little or a long way,
+/// resized, added and removed through the scene, which refits, inserts and
+/// removes them in the BVH, rotating nodes as it goes, and random rays are
+/// traced after every single edit, so a bad edit shows up straight away.
+/// </summary>
+/// <returns>0 if everything matched, 1 if anything didn't.</returns>
+static int validateBVHEdits()
+{
+	const int editAmount = 2000;
+	const int raysPerEdit = 16;
+
+	RayScene scene;
+	scene.scatterSpheres(500, 2);
+	scene.build();
+
+	std::mt19937 random(3);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+	int counts[3] = { 0, 0, 0 };
+	int mismatches = 0;
+	int firstMismatch = -1;
+
+	for (int edit = 0; edit < editAmount; ++edit)
+	{
+		int sphereAmount = static_cast<int>(scene.spheres.size());
+		float kind = chance(random);
+
+		if (kind < 0.4f)
+		{
+			Sphere &sphere = scene.spheres[std::uniform_int_distribution<int>(0, sphereAmount - 1)(random)];
+
+			// Mostly nudged, as when dragged, but sometimes thrown across the scene
+			if (chance(random) < 0.8f)
+			{
+				sphere.center += Vec3f(unit(random), unit(random) * 0.2f, unit(random));
+			}
+			else
+			{
+				sphere.center = Vec3f(unit(random) * 60.0f, unit(random) * 5.0f, -100.0f + unit(random) * 95.0f);
+			}
+
+			sphere.radius = std::max(0.05f, sphere.radius * (1.0f + unit(random) * 0.3f));
+			sphere.radius2 = sphere.radius * sphere.radius;
+
+			scene.updateSphere(static_cast<int>(&sphere - scene.spheres.data()));
+			counts[0]++;
+		}
+		else if (kind < 0.7f || sphereAmount <= 2)
+		{
+			float radius = 0.05f + (unit(random) + 1.0f) * 0.5f;
+			Vec3f center(unit(random) * 60.0f, radius, -100.0f + unit(random) * 95.0f);
+
+			scene.addSphere(Sphere(center, radius, Vec3f(0.5f)));
+			counts[1]++;
+		}
+		else
+		{
+			scene.removeSphere(std::uniform_int_distribution<int>(0, sphereAmount - 1)(random));
+			counts[2]++;
+		}
+
+		int editMismatches = 0;
+
+		for (int i = 0; i < raysPerEdit; ++i)
+		{
+			Vec3f rayOrigin(unit(random) * 20.0f, 1.0f + unit(random), 10.0f + unit(random) * 10.0f);
+			Vec3f rayDir(unit(random), unit(random) * 0.2f, -1.0f);
+			rayDir.normalize();
+
+			editMismatches += countRayMismatches(scene, rayOrigin, rayDir);
+		}
+
+		if (editMismatches > 0 && firstMismatch < 0)
+		{
+			firstMismatch = edit;
+		}
+
+		mismatches += editMismatches;
+	}
+
+	std::printf("BVH edits: %d moves, %d adds and %d removes, ending with %d spheres in %d nodes %d deep, %d mismatches",
+		counts[0], counts[1], counts[2], static_cast<int>(scene.spheres.size()), scene.getBVH().getNodeAmount(), scene.getBVH().getDepth(), mismatches);
+
+	if (firstMismatch >= 0)
+	{
+		std::printf(", the first after edit %d", firstMismatch);
+	}
+
+	std::printf("\n");
+
+	return mismatches > 0 ? 1 : 0;
+}
+
+/// <summary>
+/// Check that rendering only the tiles an edit could change gives exactly the
+/// same image as rendering every tile again. Each tile keeps the RayBounds of
+/// its last render, and after each edit, the tiles isSectionDirty() picks are
+/// rendered again, as the raytracer does. Spheres are moved and resized a few
+/// at a time, with and without anti-aliasing, as its ring of pixels reaches
+/// into the next tile, and with and without mirrors and glass. Some renders
+/// are cancelled part way, and the tiles they left are checked next time.
+/// </summary>
+/// <returns>0 if every edit matched, 1 if any didn't.</returns>
+static int validateDirtyTiles()
+{
+	const int renderW = 320;
+	const int renderH = 180;
+	const int tileSize = 32;
+	const int editRounds = 15;
+
+	std::mt19937 random(4);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	int badRounds = 0;
+	int renderedTiles = 0;
+	int totalTiles = 0;
+	int comparedRounds = 0;
+
+	// Mirrors and glass send rays almost everywhere, so without them far fewer tiles are
+	// rendered again, and a tile the footprints or bounds wrongly left out shows up
+	for (int variant = 0; variant < 4; ++variant)
+	{
+		RayScene scene;
+		scene.scatterSpheres(1000, 5);
+		scene.aaGrid = 1 + variant % 2;
+
+		if (variant >= 2)
+		{
+			for (Sphere &sphere : scene.spheres)
+			{
+				sphere.reflection = 0.0f;
+				sphere.transparency = 0.0f;
+			}
+		}
+
+		scene.build();
+
+		std::vector<Vec3f> lights;
+
+		for (int light : scene.getLights())
+		{
+			lights.push_back(scene.spheres[light].center);
+		}
+
+		// Every tile rendered once, remembering where its rays went
+		int columns = (renderW + tileSize - 1) / tileSize;
+		int rows = (renderH + tileSize - 1) / tileSize;
+		std::vector<RayBounds> tileBounds(columns * rows);
+		std::vector<char> tileFinished(columns * rows, 1);
+		HDRBuffer partialBuffer;
+		HDRBuffer fullBuffer;
+
+		partialBuffer.resize(renderW, renderH);
+		fullBuffer.resize(renderW, renderH);
+		scene.binSpheres(renderW, renderH);
+
+		for (int cell = 0; cell < columns * rows; ++cell)
+		{
+			sf::Vector2i pixTL(cell % columns * tileSize, cell / columns * tileSize);
+			sf::Vector2i pixBR(std::min(pixTL.x + tileSize, renderW), std::min(pixTL.y + tileSize, renderH));
+
+			scene.renderSection(partialBuffer, pixTL, pixBR, 1, 0, &tileBounds[cell]);
+		}
+
+		std::vector<uint8_t> partialPixels(renderW * renderH * 4);
+		std::vector<uint8_t> fullPixels(renderW * renderH * 4);
+
+		for (int round = 0; round < editRounds; ++round)
+		{
+			// Each edited sphere before and after, as the raytracer keeps them
+			std::vector<Sphere> editedSpheres;
+			int editAmount = 1 + static_cast<int>(random() % 3);
+
+			for (int edit = 0; edit < editAmount; ++edit)
+			{
+				int index = static_cast<int>(random() % scene.spheres.size());
+				Sphere &sphere = scene.spheres[index];
+
+				// Editing a light renders every tile, so there's nothing to check
+				if (sphere.emissionColour.x > 0)
+				{
+					continue;
+				}
+
+				editedSpheres.push_back(sphere);
+
+				// Nudged a few pixels, as when dragged, however far away it is. Sometimes it's lifted
+				// into the empty sky instead, where no tile's rays went, so only its footprint can tell
+				float distance = std::abs(sphere.center.z - scene.rayOrigin.z);
+
+				if (random() % 4 == 0)
+				{
+					sphere.center.y += distance * (0.05f + (unit(random) + 1.0f) * 0.05f);
+				}
+				else
+				{
+					sphere.center += Vec3f(unit(random), unit(random), unit(random)) * (distance * 0.02f);
+				}
+
+				sphere.radius = std::max(0.05f, sphere.radius * (1.0f + unit(random) * 0.3f));
+				sphere.radius2 = sphere.radius * sphere.radius;
+				scene.updateSphere(index);
+
+				editedSpheres.push_back(sphere);
+			}
+
+			std::vector<Footprint> footprints(editedSpheres.size());
+
+			for (std::size_t i = 0; i < editedSpheres.size(); ++i)
+			{
+				scene.getFootprint(editedSpheres[i], renderW, renderH, footprints[i].pixTL, footprints[i].pixBR);
+			}
+
+			scene.binSpheres(renderW, renderH);
+
+			// Some renders are cancelled part way, leaving every other dirty tile unfinished,
+			// so the next round has to render those again whatever it edits
+			bool cancelled = round % 3 == 1;
+			int dirtyTiles = 0;
+
+			for (int cell = 0; cell < columns * rows; ++cell)
+			{
+				sf::Vector2i pixTL(cell % columns * tileSize, cell / columns * tileSize);
+				sf::Vector2i pixBR(std::min(pixTL.x + tileSize, renderW), std::min(pixTL.y + tileSize, renderH));
+
+				totalTiles++;
+
+				if (!isSectionDirty(pixTL, pixBR, tileFinished[cell], tileBounds[cell], editedSpheres, footprints, lights))
+				{
+					continue;
+				}
+
+				tileFinished[cell] = !cancelled || dirtyTiles++ % 2 == 0;
+
+				if (tileFinished[cell])
+				{
+					tileBounds[cell].clear();
+					scene.renderSection(partialBuffer, pixTL, pixBR, 1, 0, &tileBounds[cell]);
+					renderedTiles++;
+				}
+			}
+
+			// The unfinished tiles still show the scene from before
+			if (cancelled)
+			{
+				continue;
+			}
+
+			scene.renderSection(fullBuffer, { 0, 0 }, { renderW, renderH });
+			comparedRounds++;
+
+			partialBuffer.resolve(partialPixels.data(), 0, 0, renderW, renderH, 1.0f, false);
+			fullBuffer.resolve(fullPixels.data(), 0, 0, renderW, renderH, 1.0f, false);
+
+			badRounds += partialPixels == fullPixels ? 0 : 1;
+		}
+	}
+
+	std::printf("Dirty tiles: %d rounds of edits, %d cancelled part way, %d of %d tiles rendered again, %d of %d rounds didn't match a full render\n",
+		editRounds * 4, editRounds * 4 - comparedRounds, renderedTiles, totalTiles, badRounds, comparedRounds);
+
+	return badRounds > 0 ? 1 : 0;
+}
+
+/// <summary>
+/// Check the CompletionQueue with several threads pushing at once while this
+/// thread drains it, as workers hand the raytracer's tiles to the main thread.
+/// Each item's payload is written before it's pushed, so a pop that comes
+/// before the payload is visible shows up too. Every item must come out exactly
+/// once, in every round, and the queue is reset between rounds like a new render.
+/// </summary>
+/// <returns>0 if every round matched, 1 if any didn't.</returns>
+static int validateCompletionQueue()
+{
+	const int producerAmount = 4;
+	const int itemsPerProducer = 5000;
+	const int roundAmount = 50;
+	const int itemAmount = producerAmount * itemsPerProducer;
+
+	CompletionQueue queue;
+	std::vector<int> payloads(itemAmount);
+	std::vector<int> popCounts(itemAmount);
+	int badRounds = 0;
+
+	for (int round = 0; round < roundAmount; ++round)
+	{
+		queue.reset(itemAmount);
+		std::fill(payloads.begin(), payloads.end(), -1);
+		std::fill(popCounts.begin(), popCounts.end(), 0);
+
+		std::vector<std::thread> producers;
+		std::atomic<int> finishedProducers{ 0 };
+		int badPayloads = 0;
+
+		for (int producer = 0; producer < producerAmount; ++producer)
+		{
+			producers.emplace_back([&, producer]()
+			{
+				// Interleaved, so the producers' slots are mixed together
+				for (int i = 0; i < itemsPerProducer; ++i)
+				{
+					int item = i * producerAmount + producer;
+
+					payloads[item] = item + round;
+					queue.push(item);
+				}
+
+				finishedProducers.fetch_add(1);
+			});
+		}
+
+		int item = 0;
+
+		while (queue.getPopped() < itemAmount)
+		{
+			// Read first, so once every item has been pushed, a lost one isn't waited for forever
+			bool pushedAll = finishedProducers.load() == producerAmount;
+
+			if (!queue.tryPop(item))
+			{
+				if (pushedAll)
+				{
+					break;
+				}
+
+				std::this_thread::yield();
+				continue;
+			}
+
+			if (item < 0 || item >= itemAmount)
+			{
+				badPayloads++;
+				continue;
+			}
+
+			popCounts[item]++;
+			badPayloads += payloads[item] != item + round ? 1 : 0;
+		}
+
+		for (std::thread &producer : producers)
+		{
+			producer.join();
+		}
+
+		bool once = std::all_of(popCounts.begin(), popCounts.end(), [](int count) { return count == 1; });
+
+		// Everything was pushed, so there must be nothing more to take
+		if (badPayloads > 0 || !once || queue.tryPop(item))
+		{
+			badRounds++;
+		}
+	}
+
+	std::printf("Completion queue: %d rounds of %d threads pushing %d items each, %d rounds wrong\n",
+		roundAmount, producerAmount, itemsPerProducer, badRounds);
+
+	return badRounds > 0 ? 1 : 0;
+}
+
+/// <summary>
+/// Entry point.
+/// </summary>
+/// <param name="argc">Argument count.</param>
+/// <param name="argv">The options listed at the top of this file.</param>
+/// <returns>0 for successful exit, 1 if an option or workload was wrong or a file couldn't be read or written, 2 if a comparison found a regression.</returns>
+int main(int argc, char *argv[])
+{
+	struct Workload
+	{
+		const char *name;
+		double (*run)(ThreadPool &pool, int threads);
+	};
+
+	const Workload workloads[] =
+	{
+		{ "raytracer", runRaytracer },
+		{ "pathfinding", runPathfinding },
+		{ "particles", runParticles },
+		{ "terrain", runTerrain }
+	};
+
+	int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<int> threadCounts{ 1 };
+	std::vector<std::string> selected;
+	BenchmarkSettings settings;
+	std::string jsonPath;
+	std::string csvPath;
+	std::string baselinePath;
+	std::string currentPath;
+	double thresholdPercent = 2.0;
+	bool sweep = false;
+	std::string scalingPath;
+	bool validate = false;
+	bool realTime = false;
+
+	if (hardwareThreads > 1)
+	{
+		threadCounts.push_back(hardwareThreads);
+	}
+
+	for (const Workload &workload : workloads)
+	{
+		selected.push_back(workload.name);
+	}
+
+	for (int i = 1; i < argc; ++i)
+	{
+		bool hasValue = i + 1 < argc;
+
+		if (std::strcmp(argv[i], "--threads") == 0 && hasValue)
+		{
+			threadCounts.clear();
+
+			for (const std::string &item : splitList(argv[++i]))
+			{
+				threadCounts.push_back(std::max(1, std::atoi(item.c_str())));
+			}
+		}
+		else if (std::strcmp(argv[i], "--workloads") == 0 && hasValue)
+		{
+			selected = splitList(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--warmup") == 0 && hasValue)
+		{
+			settings.warmup = std::max(0, std::atoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "--repetitions") == 0 && hasValue)
+		{
+			settings.repetitions = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "--json") == 0 && hasValue)
+		{
+			jsonPath = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--csv") == 0 && hasValue)
+		{
+			csvPath = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--compare") == 0 && i + 2 < argc)
+		{
+			baselinePath = argv[++i];
+			currentPath = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--threshold") == 0 && hasValue)
+		{
+			thresholdPercent = std::max(0.0, std::atof(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "--sweep") == 0)
+		{
+			sweep = true;
+		}
+		else if (std::strcmp(argv[i], "--scaling") == 0 && hasValue)
+		{
+			scalingPath = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--spheres") == 0 && hasValue)
+		{
+			scatterAmount = std::max(0, std::atoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "--aa-grid") == 0 && hasValue)
+		{
+			aaGrid = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "--real-time") == 0)
+		{
+			realTime = true;
+		}
+		else if (std::strcmp(argv[i], "--frame-budget") == 0 && hasValue)
+		{
+			frameBudgetMs = std::max(1.0f, static_cast<float>(std::atof(argv[++i])));
+		}
+		else if (std::strcmp(argv[i], "--scalar") == 0)
+		{
+			SphereSoA::setSIMDEnabled(false);
+		}
+		else if (std::strcmp(argv[i], "--single-rays") == 0)
+		{
+			usePackets = false;
+		}
+		else if (std::strcmp(argv[i], "--no-bins") == 0)
+		{
+			useBins = false;
+		}
+		else if (std::strcmp(argv[i], "--no-shadow-cache") == 0)
+		{
+			useShadowCache = false;
+		}
+		else if (std::strcmp(argv[i], "--validate") == 0)
+		{
+			validate = true;
+		}
+		else
+		{
+			std::fprintf(stderr, "Unknown option: %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (!baselinePath.empty())
+	{
+		return compareFiles(baselinePath, currentPath, thresholdPercent);
+	}
+
+	if (validate)
+	{
+		int failed = validateSpheres();
+		failed |= validateBVHEdits();
+		failed |= validateDirtyTiles();
+		failed |= validateCompletionQueue();
+
+		return failed;
+	}
+
+	if (sweep)
+	{
+		threadCounts = ScalingSweep::getThreadCounts(hardwareThreads);
+	}
+
+	if (realTime)
+	{
+		return runRealTime(threadCounts);
+	}
+
+	std::vector<BenchmarkResult> results;
+
+	std::printf("%-12s %8s %10s %10s %10s %10s %21s %4s\n", "workload", "threads", "min", "median", "p95", "stddev", "95% CI of mean", "out");
+
+	for (const std::string &name : selected)
+	{
+		const Workload *workload = nullptr;
+
+		for (const Workload &candidate : workloads)
+		{
+			if (name == candidate.name)
+			{
+				workload = &candidate;
+			}
+		}
+
+		if (workload == nullptr)
+		{
+			std::fprintf(stderr, "Unknown workload: %s\n", name.c_str());
+			return 1;
+		}
+
+		for (int threads : threadCounts)
+		{
+			// The main thread works too, so the pool has one thread less
+			ThreadPool pool(threads - 1);
+
+			std::vector<double> samples = Benchmark::run([&] { return workload->run(pool, threads); }, settings);
+
+			if (*std::min_element(samples.begin(), samples.end()) < 0.0)
+			{
+				std::fprintf(stderr, "%s: couldn't load its files, run this from the project folder\n", workload->name);
+				return 1;
+			}
+
+			BenchmarkSummary summary = Benchmark::summarise(samples);
+			results.push_back({ workload->name, threads, summary });
+
+			std::printf("%-12s %8d %10.3f %10.3f %10.3f %10.3f %10.3f-%-10.3f %4d\n", workload->name, threads,
+				summary.min, summary.median, summary.p95, summary.stddev, summary.ciLow, summary.ciHigh, summary.outliers);
+		}
+	}
+
+	// Every workload that ran at more than one thread count gets its scaling shown
+	std::vector<ScalingResult> scaling;
+
+	for (const BenchmarkResult &result : results)
+	{
+		if (scaling.empty() || scaling.back().workload != result.workload)
+		{
+			ScalingResult workloadScaling;
+			workloadScaling.workload = result.workload;
+
+			scaling.push_back(workloadScaling);
+		}
+
+		ScalingPoint point;
+		point.threads = result.threads;
+		point.summary = result.summary;
+
+		scaling.back().points.push_back(point);
+	}
+
+	if (threadCounts.size() > 1)
+	{
+		std::printf("\n%-12s %8s %9s %11s %9s\n", "workload", "threads", "speedup", "efficiency", "amdahl");
+
+		for (ScalingResult &result : scaling)
+		{
+			ScalingSweep::analyse(result);
+
+			for (const ScalingPoint &point : result.points)
+			{
+				std::printf("%-12s %8d %8.2fx %10.1f%% %8.2fx\n", result.workload.c_str(), point.threads, point.speedup,
+					point.efficiency * 100.0, ScalingSweep::getAmdahlSpeedup(result.serialFraction, point.threads));
+			}
+
+			std::printf("%-12s serial fraction %.1f%%\n", result.workload.c_str(), result.serialFraction * 100.0);
+		}
+	}
+
+	if (!scalingPath.empty() && !ScalingSweep::saveCsv(scalingPath, scaling))
+	{
+		std::fprintf(stderr, "Couldn't write %s\n", scalingPath.c_str());
+		return 1;
+	}
+
+	if (!jsonPath.empty() && !writeJson(jsonPath, results, settings))
+	{
+		std::fprintf(stderr, "Couldn't write %s\n", jsonPath.c_str());
+		return 1;
+	}
+
+	if (!csvPath.empty() && !Benchmark::saveResults(csvPath, results))
+	{
+		std::fprintf(stderr, "Couldn't write %s\n", csvPath.c_str());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,168 @@
+// --------------------------------------------
+// JobSubmitBenchmark.cpp
+// --------------------------------------------
+// Measures what it costs to submit a job to
+// the ThreadPool, using the future-returning
+// addJob and the JobCounter addJob. Every
+// heap allocation is counted, so this also
+// shows whether submission is allocation-free
+// once the pool has warmed up.
+// The batches look like a frame of the
+// particle test: one small job per generator,
+// submitted and waited on again and again.
+//
+// This is a separate program with its own
+// main(), so it isn't part of the Visual
+// Studio project. Build it from the project
+// folder with:
+// g++ -O2 -std=c++17 -Ih bench/JobSubmitBenchmark.cpp src/ThreadPool.cpp -pthread -o job_submit_bench
+// --------------------------------------------
+
+#include "ThreadPool.h"
+#include "Timer.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+// Counts every call to the global operator new
+static std::atomic<std::size_t> allocations{ 0 };
+
+void *operator new(std::size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (void *ptr = std::malloc(size ? size : 1))
+	{
+		return ptr;
+	}
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+struct Result
+{
+	double nsPerJob;
+	double allocationsPerJob;
+};
+
+/// <summary>
+/// Submit frames of jobs using futures, the way the tests originally did.
+/// </summary>
+/// <param name="pool">The pool to use.</param>
+/// <param name="frames">The number of frames to run.</param>
+/// <param name="jobsPerFrame">The number of jobs submitted per frame.</param>
+/// <returns>Time and allocations per submitted job.</returns>
+static Result runFutures(ThreadPool &pool, int frames, int jobsPerFrame)
+{
+	std::vector<std::future<void>> futures;
+	futures.reserve(jobsPerFrame);
+
+	std::atomic<int> sink{ 0 };
+
+	std::size_t allocationsBefore = allocations.load();
+	Timer timer("Futures");
+
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		futures.clear();
+
+		for (int i = 0; i < jobsPerFrame; ++i)
+		{
+			futures.push_back(pool.addJob([&sink, i] { sink.fetch_add(i, std::memory_order_relaxed); }));
+		}
+
+		for (auto &future : futures)
+		{
+			future.wait();
+		}
+	}
+
+	double ms = timer.stop();
+	std::size_t allocated = allocations.load() - allocationsBefore;
+	double jobAmount = static_cast<double>(frames) * jobsPerFrame;
+
+	return { ms * 1e6 / jobAmount, allocated / jobAmount };
+}
+
+/// <summary>
+/// Submit frames of jobs using a JobCounter.
+/// </summary>
+/// <param name="pool">The pool to use.</param>
+/// <param name="frames">The number of frames to run.</param>
+/// <param name="jobsPerFrame">The number of jobs submitted per frame.</param>
+/// <returns>Time and allocations per submitted job.</returns>
+static Result runCounter(ThreadPool &pool, int frames, int jobsPerFrame)
+{
+	std::atomic<int> sink{ 0 };
+
+	std::size_t allocationsBefore = allocations.load();
+	Timer timer("Counter");
+
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		JobCounter counter;
+
+		for (int i = 0; i < jobsPerFrame; ++i)
+		{
+			pool.addJob(counter, [&sink, i] { sink.fetch_add(i, std::memory_order_relaxed); });
+		}
+
+		pool.wait(counter);
+	}
+
+	double ms = timer.stop();
+	std::size_t allocated = allocations.load() - allocationsBefore;
+	double jobAmount = static_cast<double>(frames) * jobsPerFrame;
+
+	return { ms * 1e6 / jobAmount, allocated / jobAmount };
+}
+
+/// <summary>
+/// Entry point.
+/// </summary>
+/// <param name="argc">Argument count.</param>
+/// <param name="argv">Optional thread count.</param>
+/// <returns>0 for successful exit.</returns>
+int main(int argc, char *argv[])
+{
+	std::size_t threadAmount = std::max(1u, std::thread::hardware_concurrency());
+
+	if (argc > 1)
+	{
+		threadAmount = std::max(1, std::atoi(argv[1]));
+	}
+
+	ThreadPool pool(threadAmount);
+
+	const int frames = 20000;
+	const int batchSizes[] = { 8, 64, 512 };
+
+	std::printf("%zu threads, %d frames per run\n\n", threadAmount, frames);
+	std::printf("%10s %16s %16s %16s %16s\n", "jobs/frame", "future ns/job", "future allocs", "counter ns/job", "counter allocs");
+
+	for (int jobsPerFrame : batchSizes)
+	{
+		// Warm up so the queues have already grown to their working size
+		runCounter(pool, 100, jobsPerFrame);
+		runFutures(pool, 100, jobsPerFrame);
+
+		Result futures = runFutures(pool, frames, jobsPerFrame);
+		Result counter = runCounter(pool, frames, jobsPerFrame);
+
+		std::printf("%10d %16.1f %16.2f %16.1f %16.2f\n", jobsPerFrame,
+			futures.nsPerJob, futures.allocationsPerJob,
+			counter.nsPerJob, counter.allocationsPerJob);
+	}
+
+	return 0;
+}
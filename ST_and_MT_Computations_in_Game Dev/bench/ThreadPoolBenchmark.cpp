@@ -0,0 +1,303 @@
+// --------------------------------------------
+// ThreadPoolBenchmark.cpp
+// --------------------------------------------
+// Compares the original single-queue thread
+// pool against the work-stealing ThreadPool.
+// Both pools run the same batches of jobs at
+// 1, 2, 4 ... N threads. Tiny jobs show how
+// much time goes on fighting over the queue
+// lock, tile-sized jobs show what that means
+// for a real workload. Next to each time is
+// the lock wait: the total time every thread
+// spent blocked on a taken queue mutex, per
+// job, measured the same way for both pools.
+//
+// This is a separate program with its own
+// main(), so it isn't part of the Visual
+// Studio project. Build it from the project
+// folder with:
+// g++ -O2 -std=c++17 -Ih bench/ThreadPoolBenchmark.cpp src/ThreadPool.cpp -pthread -o threadpool_bench
+// Pass a number to override the highest
+// thread count tested.
+// --------------------------------------------
+
+#include "ThreadPool.h"
+#include "Timer.h"
+
+#include <queue>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+
+/// <summary>
+/// The thread pool as it was before work stealing: one job queue,
+/// one mutex and one condition variable shared by every worker.
+/// Kept here only so the two can be compared. The only addition is
+/// the lock wait counter, timed the same way as ThreadPool's.
+/// </summary>
+class LegacyThreadPool
+{
+public:
+	using Job = std::function<void()>;
+
+	explicit LegacyThreadPool(std::size_t threadAmount)
+	{
+		for (auto i = 0u; i < threadAmount; ++i)
+		{
+			threads.emplace_back([=]
+			{
+				while (true)
+				{
+					Job job;
+
+					{
+						std::unique_lock<std::mutex> lock = lockCounted();
+						eventVar.wait(lock, [=] { return stopping || !jobs.empty(); });
+
+						if (stopping && jobs.empty())
+						{
+							break;
+						}
+
+						job = std::move(jobs.front());
+						jobs.pop();
+					}
+
+					job();
+				}
+			});
+		}
+	}
+
+	~LegacyThreadPool()
+	{
+		{
+			std::unique_lock<std::mutex> lock{ eventMutex };
+			stopping = true;
+		}
+
+		eventVar.notify_all();
+
+		for (auto &thread : threads)
+		{
+			thread.join();
+		}
+	}
+
+	template<class T>
+	auto addJob(T job)->std::future<decltype(job())>
+	{
+		auto wrapper = std::make_shared<std::packaged_task<decltype(job())()>>(std::move(job));
+
+		{
+			std::unique_lock<std::mutex> lock = lockCounted();
+			jobs.emplace([=] { (*wrapper)(); });
+		}
+
+		eventVar.notify_one();
+		return wrapper->get_future();
+	}
+
+	/// <summary>
+	/// Get the total time every thread has spent waiting for the queue's mutex.
+	/// </summary>
+	/// <returns>The time in nanoseconds.</returns>
+	std::uint64_t getLockWaitNs() const
+	{
+		return lockWaitNs.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::vector<std::thread> threads;
+	std::condition_variable eventVar;
+	std::mutex eventMutex;
+	bool stopping = false;
+	std::queue<Job> jobs;
+	std::atomic<std::uint64_t> lockWaitNs{ 0 };
+
+	/// <summary>
+	/// Lock the queue's mutex, adding any time spent waiting for it to the lock wait.
+	/// The clock is only read when the mutex is already taken, like ThreadPool::lockCounted().
+	/// </summary>
+	/// <returns>The lock.</returns>
+	std::unique_lock<std::mutex> lockCounted()
+	{
+		std::unique_lock<std::mutex> lock{ eventMutex, std::try_to_lock };
+
+		if (!lock.owns_lock())
+		{
+			auto lockStart = std::chrono::steady_clock::now();
+			lock.lock();
+			lockWaitNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - lockStart).count(), std::memory_order_relaxed);
+		}
+
+		return lock;
+	}
+};
+
+/// <summary>
+/// Get the total time every thread has spent waiting for the old pool's queue lock.
+/// </summary>
+/// <param name="pool">The pool.</param>
+/// <returns>The time in nanoseconds.</returns>
+static std::uint64_t getLockWaitNs(const LegacyThreadPool &pool)
+{
+	return pool.getLockWaitNs();
+}
+
+/// <summary>
+/// Get the total time every thread has spent waiting for any of the pool's locks.
+/// </summary>
+/// <param name="pool">The pool.</param>
+/// <returns>The time in nanoseconds.</returns>
+static std::uint64_t getLockWaitNs(const ThreadPool &pool)
+{
+	std::vector<ThreadStats> stats = pool.getStats();
+
+	return std::accumulate(stats.begin(), stats.end(), std::uint64_t{ 0 }, [](std::uint64_t total, const ThreadStats &thread) { return total + thread.lockWaitNs; });
+}
+
+/// <summary>
+/// A small amount of floating point work that the compiler can't remove.
+/// </summary>
+/// <param name="iterations">How much work to do.</param>
+/// <returns>A value that depends on every iteration.</returns>
+static float spin(int iterations)
+{
+	volatile float value = 1.0f;
+
+	for (int i = 0; i < iterations; ++i)
+	{
+		value = value * 1.000001f + 0.5f;
+	}
+
+	return value;
+}
+
+/// <summary>
+/// Submit a batch of jobs to a pool and wait for all of them.
+/// </summary>
+/// <param name="pool">The pool to test.</param>
+/// <param name="jobAmount">The number of jobs to submit.</param>
+/// <param name="iterations">The amount of work done by each job.</param>
+/// <param name="lockWaitNs">Set to the time every thread spent waiting for the pool's locks during the batch.</param>
+/// <returns>The time taken in milliseconds.</returns>
+template<class Pool>
+static double runBatch(Pool &pool, int jobAmount, int iterations, std::uint64_t &lockWaitNs)
+{
+	std::uint64_t lockWaitStart = getLockWaitNs(pool);
+
+	std::vector<std::future<void>> futures;
+	futures.reserve(jobAmount);
+
+	Timer timer("Batch");
+
+	for (int i = 0; i < jobAmount; ++i)
+	{
+		futures.push_back(pool.addJob([=] { spin(iterations); }));
+	}
+
+	for (auto &future : futures)
+	{
+		future.wait();
+	}
+
+	double ms = timer.stop();
+
+	// A job's future is ready just before its worker goes back for the next job,
+	// so the workers may still be taking their last locks
+	lockWaitNs = getLockWaitNs(pool) - lockWaitStart;
+
+	return ms;
+}
+
+/// <summary>
+/// Run one scenario on both pools at every thread count and print a table.
+/// </summary>
+/// <param name="name">The scenario name.</param>
+/// <param name="jobAmount">The number of jobs in each batch.</param>
+/// <param name="iterations">The amount of work done by each job.</param>
+/// <param name="repetitions">The number of batches to run (the fastest one, and its lock wait, is reported).</param>
+/// <param name="maxThreads">The highest thread count to test.</param>
+static void runScenario(const char *name, int jobAmount, int iterations, int repetitions, std::size_t maxThreads)
+{
+	std::printf("\n%s: %d jobs x %d iterations\n", name, jobAmount, iterations);
+	std::printf("%8s %12s %14s %17s %12s %15s %17s %9s\n", "threads", "legacy ms", "legacy ns/job", "legacy lock/job", "stealing ms", "stealing ns/job", "stealing lock/job", "speedup");
+
+	for (std::size_t threadAmount = 1; ; threadAmount *= 2)
+	{
+		threadAmount = std::min(threadAmount, maxThreads);
+
+		double legacyMs = 1e30;
+		double stealingMs = 1e30;
+		std::uint64_t legacyLockNs = 0;
+		std::uint64_t stealingLockNs = 0;
+
+		// New scope so each pool is shut down before the next one starts
+		{
+			LegacyThreadPool legacy(threadAmount);
+
+			for (int i = 0; i < repetitions; ++i)
+			{
+				std::uint64_t lockWaitNs = 0;
+				double ms = runBatch(legacy, jobAmount, iterations, lockWaitNs);
+
+				if (ms < legacyMs)
+				{
+					legacyMs = ms;
+					legacyLockNs = lockWaitNs;
+				}
+			}
+		}
+
+		{
+			ThreadPool stealing(threadAmount);
+
+			for (int i = 0; i < repetitions; ++i)
+			{
+				std::uint64_t lockWaitNs = 0;
+				double ms = runBatch(stealing, jobAmount, iterations, lockWaitNs);
+
+				if (ms < stealingMs)
+				{
+					stealingMs = ms;
+					stealingLockNs = lockWaitNs;
+				}
+			}
+		}
+
+		std::printf("%8zu %12.3f %14.1f %17.1f %12.3f %15.1f %17.1f %8.2fx\n", threadAmount,
+			legacyMs, legacyMs * 1e6 / jobAmount, static_cast<double>(legacyLockNs) / jobAmount,
+			stealingMs, stealingMs * 1e6 / jobAmount, static_cast<double>(stealingLockNs) / jobAmount,
+			legacyMs / stealingMs);
+
+		if (threadAmount == maxThreads)
+		{
+			break;
+		}
+	}
+}
+
+/// <summary>
+/// Entry point.
+/// </summary>
+/// <param name="argc">Argument count.</param>
+/// <param name="argv">Optional highest thread count.</param>
+/// <returns>0 for successful exit.</returns>
+int main(int argc, char *argv[])
+{
+	std::size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	if (argc > 1)
+	{
+		maxThreads = std::max(1, std::atoi(argv[1]));
+	}
+
+	// Almost no work per job, so nearly all of the time is queue overhead
+	runScenario("Tiny jobs (queue contention)", 200000, 16, 3, maxThreads);
+
+	// Roughly the size of a 16x16 raytracer tile or a single bot's A* search
+	runScenario("Tile jobs", 2000, 20000, 3, maxThreads);
+
+	return 0;
+}
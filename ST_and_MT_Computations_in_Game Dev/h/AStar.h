@@ -11,7 +11,9 @@
 #define ASTAR_H
 
 #include <SFML/Graphics.hpp>
+#include <cmath>
 #include <list>
+#include <vector>
 
 struct Node
 {
@@ -7,6 +7,13 @@
 // events, and updates and draws whichever
 // test is currently active. All of the
 // ImGui menus are handled here also.
+// The Application owns the one ThreadPool
+// that every test shares, so loading more
+// than one test doesn't create more threads
+// than there are cores. The tests' per-frame
+// updates run as a TaskGraph so they overlap
+// with each other and with ImGui's frame
+// setup on the main thread.
 // --------------------------------------------
 
 #ifndef APPLICATION_H
@@ -18,6 +25,9 @@
 #include "Pathfinding.h"
 #include "ParticleEffect.h"
 #include "TerrainGenerator.h"
+#include "ThreadPool.h"
+#include "TaskGraph.h"
+#include "Profiler.h"
 
 #include <SFML/Graphics.hpp>
 
@@ -41,16 +51,21 @@ private:
 	static const unsigned int SCREEN_HEIGHT = 720u;
 	sf::RenderWindow window;
 	bool exitApp;
+	std::unique_ptr<ThreadPool> threadPool;
 	Raytracer *raytracer = nullptr;
 	Pathfinding *pathfinding = nullptr;
 	ParticleEffect *particleEffect = nullptr;
 	TerrainGenerator *terrainGenerator = nullptr;
 	sf::Time timePerFrame = sf::seconds(1.f / 60.0f);
+	sf::Time frameTime;
+	TaskGraph frameGraph;
+	std::string profilerStatus;
 
 	void processEvents();
 	void update(const sf::Time &dt);
 	void handleUI();
 	void loadTest(TestID testID);
+	void buildFrameGraph();
 	void draw();
 };
 
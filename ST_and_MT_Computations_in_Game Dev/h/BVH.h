@@ -0,0 +1,98 @@
+// --------------------------------------------
+// BVH.h
+// BVH.cpp
+// --------------------------------------------
+// A bounding volume hierarchy over the
+// raytracer's spheres. Every node holds a box
+// around the spheres below it, so a ray only
+// has to test the spheres in boxes it passes
+// through. Nodes are split using the surface
+// area heuristic (SAH): the split chosen is
+// the one that makes it cheapest, on average,
+// for a random ray to find what it hits.
+// Leaves test their spheres through a
+// SphereSoA copy, kept in leaf order so a
+// leaf's spheres are next to each other in
+// memory. The BVH must be told whenever the
+// spheres change:
+// build() starts again from scratch, while
+// refit(), insert() and remove() only touch
+// the nodes above one sphere, so small edits
+// stay quick however big the scene is. The
+// tree's quality slowly drops with each edit
+// until the next build().
+// Rays can also be traced as a RayPacket, so
+// each node is tested against many rays at
+// once. A packet finds exactly the same hits
+// as tracing its rays one at a time.
+// --------------------------------------------
+
+#ifndef BVH_H
+#define BVH_H
+
+#include "Vec3.h"
+#include "SphereSoA.h"
+#include "RayPacket.h"
+
+#include <cstdint>
+#include <vector>
+
+struct Sphere;
+
+struct AABB
+{
+    Vec3f min{ INFINITY };
+    Vec3f max{ -INFINITY };
+
+    void grow(const Vec3f &point);
+    void grow(const AABB &box);
+    float area() const;
+};
+
+struct BVHNode
+{
+    AABB bounds;
+    int leftOrFirst = 0; // The left child's index, or the first sphere if this is a leaf
+    int count = 0;       // The number of spheres if this is a leaf, 0 otherwise
+};
+
+class BVH
+{
+public:
+    void build(const std::vector<Sphere> &spheres);
+    void refit(const std::vector<Sphere> &spheres, int sphereIndex);
+    void insert(const std::vector<Sphere> &spheres, int sphereIndex);
+    void remove(int sphereIndex);
+    bool closestHit(const Vec3f &rayOrigin, const Vec3f &rayDir, float &tNear, int &hitIndex) const;
+    bool anyHit(const Vec3f &rayOrigin, const Vec3f &rayDir, int ignoreIndex, int &hitIndex) const;
+    void closestHitPacket(const RayPacket &packet, float *tNear, int *hitIndex) const;
+    std::uint64_t anyHitPacket(const RayPacket &packet, int ignoreIndex, int *hitIndex) const;
+    int getNodeAmount() const;
+    int getDepth() const;
+
+private:
+    std::vector<BVHNode> nodes;
+    std::vector<int> parents;      // Each node's parent, -1 for the root
+    std::vector<int> heights;      // The number of levels from each node down to its deepest leaf
+    std::vector<int> freeNodes;    // Pairs of nodes left over by remove(), by their first index
+    std::vector<int> indices;      // Sphere indices in leaf order. Each leaf's spheres are next to each other
+    SphereSoA leafSpheres;         // A copy of the spheres in the same order as indices, for tracing
+    std::vector<AABB> sphereBounds;
+    std::vector<Vec3f> centroids;
+    std::vector<int> sphereLeaves; // The leaf each sphere is in
+
+    void updateBounds(int nodeIndex);
+    void setSphereBounds(const std::vector<Sphere> &spheres, int sphereIndex);
+    void refitUpwards(int nodeIndex);
+    void updateNode(int nodeIndex);
+    void rotate(int nodeIndex);
+    void swapNodes(int a, int b);
+    void setParent(int nodeIndex);
+    void appendSphere(const std::vector<Sphere> &spheres, int sphereIndex);
+    void appendSlot(int slot);
+    int allocateNodePair();
+    void subdivide(int nodeIndex, int level);
+    float findBestSplit(const BVHNode &node, int &bestAxis, float &bestPosition) const;
+};
+
+#endif // !BVH_H
@@ -0,0 +1,74 @@
+// --------------------------------------------
+// Benchmark.h
+// Benchmark.cpp
+// --------------------------------------------
+// Runs a workload many times and sums up how
+// long it took. A few warmup runs come first
+// and aren't counted, so caches, the thread
+// pool and the memory allocator are all warm
+// before anything is measured. Samples far
+// outside the rest (Tukey's fences, 1.5x the
+// interquartile range) are treated as noise,
+// like the OS stealing a core, and left out
+// of the summary.
+// Two sets of results can be compared. A
+// change only counts when Welch's t-test says
+// it's significant at 95% and the median
+// moved by more than a threshold, so noise
+// isn't reported as a regression.
+// Results are saved and loaded as CSV, one
+// row per workload and thread count.
+// --------------------------------------------
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BenchmarkSettings
+{
+	int warmup = 1;
+	int repetitions = 5;
+};
+
+struct BenchmarkSummary
+{
+	int samples = 0;
+	int outliers = 0;
+	double min = 0.0;
+	double median = 0.0;
+	double p95 = 0.0;
+	double mean = 0.0;
+	double stddev = 0.0;
+	double ciLow = 0.0;
+	double ciHigh = 0.0;
+};
+
+struct BenchmarkResult
+{
+	std::string workload;
+	int threads = 1;
+	BenchmarkSummary summary;
+};
+
+struct BenchmarkComparison
+{
+	double changePercent = 0.0;
+	bool significant = false;
+	bool regression = false;
+	bool improvement = false;
+};
+
+class Benchmark
+{
+public:
+	static std::vector<double> run(const std::function<double()> &workload, const BenchmarkSettings &settings);
+	static BenchmarkSummary summarise(std::vector<double> samples);
+	static BenchmarkComparison compare(const BenchmarkSummary &baseline, const BenchmarkSummary &current, double thresholdPercent);
+	static bool saveResults(const std::string &path, const std::vector<BenchmarkResult> &results);
+	static bool loadResults(const std::string &path, std::vector<BenchmarkResult> &results);
+};
+
+#endif // !BENCHMARK_H
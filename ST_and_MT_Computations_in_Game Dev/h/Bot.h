@@ -10,6 +10,7 @@
 #define BOT_H
 
 #include <SFML/Graphics.hpp>
+#include <memory>
 
 #include "AStar.h"
 
@@ -0,0 +1,105 @@
+// --------------------------------------------
+// CompletionQueue.h
+// --------------------------------------------
+// A lock-free queue that worker threads use
+// to hand finished pieces of work (such as
+// render tiles, by number) to one reader,
+// usually the main thread. It holds at most
+// the number of items it was reset with, so
+// it never needs to grow: pushing claims the
+// next slot with one atomic add, then fills
+// it. The reader takes items in the order
+// their slots were claimed, and stops at the
+// first slot that is claimed but not yet
+// filled. Nobody ever waits on a lock.
+// --------------------------------------------
+
+#ifndef COMPLETIONQUEUE_H
+#define COMPLETIONQUEUE_H
+
+#include <atomic>
+#include <memory>
+
+class CompletionQueue
+{
+public:
+	/// <summary>
+	/// Empty the queue and make room for a number of items.
+	/// Nothing may be pushing while this runs.
+	/// </summary>
+	/// <param name="amount">The most items that will be pushed before the next reset.</param>
+	void reset(int amount)
+	{
+		if (amount > capacity)
+		{
+			slots = std::make_unique<std::atomic<int>[]>(amount);
+			capacity = amount;
+		}
+
+		for (int i = 0; i < amount; ++i)
+		{
+			slots[i].store(EMPTY, std::memory_order_relaxed);
+		}
+
+		size = amount;
+		readIndex = 0;
+		writeIndex.store(0, std::memory_order_release);
+	}
+
+	/// <summary>
+	/// Add an item. Any thread can call this.
+	/// Everything the thread wrote before pushing is visible to the reader once it pops the item.
+	/// </summary>
+	/// <param name="value">The item, which must not be negative.</param>
+	void push(int value)
+	{
+		int slot = writeIndex.fetch_add(1, std::memory_order_relaxed);
+
+		slots[slot].store(value, std::memory_order_release);
+	}
+
+	/// <summary>
+	/// Take the next item, if it's ready. Only one thread may call this.
+	/// </summary>
+	/// <param name="value">Set to the item.</param>
+	/// <returns>False if there's nothing ready yet.</returns>
+	bool tryPop(int &value)
+	{
+		if (readIndex >= size)
+		{
+			return false;
+		}
+
+		int item = slots[readIndex].load(std::memory_order_acquire);
+
+		if (item == EMPTY)
+		{
+			return false;
+		}
+
+		value = item;
+		readIndex++;
+
+		return true;
+	}
+
+	/// <summary>
+	/// Get the number of items taken since the last reset.
+	/// </summary>
+	/// <returns>The number of items popped.</returns>
+	int getPopped() const
+	{
+		return readIndex;
+	}
+
+private:
+	static const int EMPTY = -1;
+
+	std::unique_ptr<std::atomic<int>[]> slots;
+	int capacity = 0;
+	int size = 0;
+	int readIndex = 0;
+	std::atomic<int> writeIndex{ 0 };
+};
+
+#endif // !COMPLETIONQUEUE_H
@@ -0,0 +1,67 @@
+// --------------------------------------------
+// DynamicResolution.h
+// DynamicResolution.cpp
+// --------------------------------------------
+// Renders the raytracer's scene in real time,
+// once a frame, keeping each frame within a
+// time budget. After every frame a feedback
+// controller compares how long it took with
+// the budget and scales the resolution the
+// next one is rendered at, from 25% to 100%
+// of the output's width and height. If even
+// 25% is too slow, it lowers the bounces as
+// well, and puts them back first once there
+// is time to spare.
+// Each frame is rendered into an HDRBuffer at
+// the lower resolution, resolved, then scaled
+// up to the output's size with bilinear
+// filtering.
+// --------------------------------------------
+
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+#include "ThreadPool.h"
+#include "ParallelFor.h"
+#include "RayScene.h"
+#include "HDRBuffer.h"
+
+#include <cstdint>
+#include <vector>
+
+class DynamicResolution
+{
+public:
+    double renderFrame(RayScene &scene, ThreadPool &threadPool, int threads, Grain2D tileSize, std::vector<uint8_t> &pixelArray, int outputW, int outputH, float exposure, bool softClip);
+    void reset();
+    float getScale() const;
+    int getBounces() const;
+    int getRenderW() const;
+    int getRenderH() const;
+    double getAverageMs() const;
+
+    float budgetMs = 12.0f; // Leaves the rest of a 60 fps frame for the UI and drawing
+
+private:
+    // Where an output column falls between two columns of the render
+    struct Column
+    {
+        int left;
+        int right;
+        int weight; // Of the right one, out of 256
+    };
+
+    HDRBuffer hdrBuffer;
+    std::vector<uint8_t> renderPixels;
+    std::vector<Column> columns;
+    float scale = 1.0f;
+    int bounces = 0;         // 0 until the first frame, which uses the scene's max bounces
+    double averageMs = 0.0;  // 0 until the next frame, after the bounces change
+    int renderW = 0;
+    int renderH = 0;
+
+    void update(double frameMs, int maxBounces);
+    void upscale(std::vector<uint8_t> &pixelArray, int outputW, int outputH, int beginY, int endY) const;
+};
+
+#endif // !DYNAMICRESOLUTION_H
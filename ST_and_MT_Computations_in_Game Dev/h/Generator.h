@@ -0,0 +1,48 @@
+// --------------------------------------------
+// Generator.h
+// --------------------------------------------
+// A particle generator. It owns a pool of
+// particles and brings dead ones back to
+// life at the start position. The Particle
+// Effect test gives each thread its own
+// generator.
+// --------------------------------------------
+
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include "Particle.h"
+
+#include <cstdint>
+#include <vector>
+
+struct Generator
+{
+	Generator(sf::Vector2f &startPosition, sf::Time &dt, int &numOfParticles, float &speed, float &timeToLive, std::vector<uint8_t> *pixelsPtr) 
+		: startPosition(startPosition), dt(dt), numOfParticles(numOfParticles), speed(speed), timeToLive(timeToLive), pixelsPtr(pixelsPtr) { }
+
+	sf::Vector2f &startPosition;
+	sf::Time &dt;
+	int &numOfParticles;
+	float &speed;
+	float &timeToLive;
+	std::vector<uint8_t> *pixelsPtr;
+	std::vector<Particle*> particlePool;	
+
+	void update(int scrW, int threadAmount)
+	{
+		for (int i = 0; i < (numOfParticles / threadAmount); ++i)
+		{
+			if (!particlePool[i]->alive)
+			{
+				particlePool[i]->generate(startPosition, speed, timeToLive);
+			}
+			else
+			{
+				particlePool[i]->update(dt, *pixelsPtr, scrW);
+			}
+		}
+	}
+};
+
+#endif // !GENERATOR_H
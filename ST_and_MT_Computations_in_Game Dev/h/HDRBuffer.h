@@ -0,0 +1,60 @@
+// --------------------------------------------
+// HDRBuffer.h
+// HDRBuffer.cpp
+// --------------------------------------------
+// The raytracer's image before it's turned
+// into pixels that can be shown: for each
+// pixel, the sum of the colours of every
+// sample traced for it so far, and how many
+// samples there were. Colours aren't clamped
+// to 1 until the end, so a bright highlight
+// averaged with a dark edge comes out right.
+// While the scene doesn't change, more
+// samples, each through a different point of
+// its pixel, can be added one at a time to
+// make the image smoother.
+// resolve() averages each pixel's samples,
+// applies the exposure and tone mapping and
+// writes RGBA8 pixels. With AVX it handles
+// 2 pixels at a time, doing exactly the same
+// float maths as the scalar path, so their
+// results match bit for bit.
+// Nothing locks the pixels, so a pixel must
+// not be resolved while a sample is being
+// added to it: the raytracer only resolves a
+// tile once it has finished, and only adds
+// to it again once it has been resolved.
+// --------------------------------------------
+
+#ifndef HDRBUFFER_H
+#define HDRBUFFER_H
+
+#include "Vec3.h"
+
+#include <cstdint>
+#include <vector>
+
+class HDRBuffer
+{
+public:
+    void resize(int width, int height);
+    int getWidth() const;
+    int getHeight() const;
+    int getSamples(int x, int y) const;
+    Vec3f getAverage(int x, int y) const;
+    void setSample(int x, int y, const Vec3f &colour);
+    void addSample(int x, int y, const Vec3f &colour);
+    void resolve(uint8_t *pixels, int beginX, int beginY, int endX, int endY, float exposure, bool softClip) const;
+
+    static void getSampleOffset(int sample, double &offsetX, double &offsetY);
+
+private:
+    std::vector<float> values; // For each pixel, the red, green and blue sums, then the number of samples
+    int width = 0;
+    int height = 0;
+
+    void resolveScalar(uint8_t *pixels, int first, int amount, float exposure, bool softClip) const;
+    void resolveSIMD(uint8_t *pixels, int first, int amount, float exposure, bool softClip) const;
+};
+
+#endif // !HDRBUFFER_H
@@ -0,0 +1,377 @@
+// --------------------------------------------
+// Job.h
+// --------------------------------------------
+// The types the ThreadPool uses to store and
+// track work.
+// Job holds any callable. Small callables
+// (most lambdas) are stored inside the Job
+// itself, so creating one doesn't touch the
+// heap. JobCounter counts unfinished jobs so
+// a batch can be waited on without futures.
+// JobQueue is a ring buffer of jobs that only
+// ever grows, so once it has reached its
+// working size it never allocates again.
+// --------------------------------------------
+
+#ifndef JOB_H
+#define JOB_H
+
+#include <type_traits>
+#include <cstddef>
+#include <utility>
+#include <atomic>
+#include <vector>
+#include <new>
+
+class JobCounter
+{
+public:
+	JobCounter() = default;
+	JobCounter(const JobCounter &) = delete;
+	JobCounter &operator=(const JobCounter &) = delete;
+
+	/// <summary>
+	/// Register jobs that are about to be added.
+	/// </summary>
+	/// <param name="amount">The number of jobs.</param>
+	void add(int amount = 1)
+	{
+		count.fetch_add(amount);
+	}
+
+	/// <summary>
+	/// Mark one job as finished.
+	/// This must be the last time a job touches the counter.
+	/// </summary>
+	void done()
+	{
+		count.fetch_sub(1);
+	}
+
+	/// <summary>
+	/// Check whether every registered job has finished.
+	/// </summary>
+	/// <returns>True if there are no unfinished jobs.</returns>
+	bool isDone() const
+	{
+		return count.load() == 0;
+	}
+
+private:
+	std::atomic<int> count{ 0 };
+};
+
+class Job
+{
+public:
+	// Callables up to this size are stored without a heap allocation
+	static const std::size_t STORAGE_SIZE = 48;
+
+	Job() = default;
+
+	/// <summary>
+	/// Job constructor.
+	/// </summary>
+	/// <param name="function">The callable to run.</param>
+	/// <param name="counter">An optional counter that is told when the job has run.</param>
+	template<class F, class = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Job>>>
+	Job(F &&function, JobCounter *counter = nullptr) : counter(counter)
+	{
+		using Callable = std::decay_t<F>;
+
+		if constexpr (Ops<Callable>::LOCAL)
+		{
+			new (storage) Callable(std::forward<F>(function));
+		}
+		else
+		{
+			*reinterpret_cast<Callable**>(storage) = new Callable(std::forward<F>(function));
+		}
+
+		ops = &Ops<Callable>::TABLE;
+	}
+
+	Job(const Job &) = delete;
+	Job &operator=(const Job &) = delete;
+
+	/// <summary>
+	/// Job move constructor.
+	/// </summary>
+	/// <param name="other">The job to move from.</param>
+	Job(Job &&other) noexcept
+	{
+		moveFrom(other);
+	}
+
+	/// <summary>
+	/// Job move assignment.
+	/// </summary>
+	/// <param name="other">The job to move from.</param>
+	/// <returns>This job.</returns>
+	Job &operator=(Job &&other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			moveFrom(other);
+		}
+
+		return *this;
+	}
+
+	/// <summary>
+	/// Job destructor.
+	/// </summary>
+	~Job()
+	{
+		reset();
+	}
+
+	/// <summary>
+	/// Run the job, then tell its counter (if it has one) that it's finished.
+	/// The callable is destroyed before the counter is told, so nothing it
+	/// owns outlives the wait on the counter. The job is empty afterwards.
+	/// </summary>
+	void operator()()
+	{
+		JobCounter *finished = counter;
+
+		ops->invoke(storage);
+		reset();
+
+		if (finished != nullptr)
+		{
+			finished->done();
+		}
+	}
+
+	/// <summary>
+	/// Check whether the job holds a callable.
+	/// </summary>
+	/// <returns>True if the job can be run.</returns>
+	explicit operator bool() const
+	{
+		return ops != nullptr;
+	}
+
+	/// <summary>
+	/// Get the counter this job reports to.
+	/// </summary>
+	/// <returns>The counter, or nullptr if the job doesn't have one.</returns>
+	JobCounter *getCounter() const
+	{
+		return counter;
+	}
+
+private:
+	struct Table
+	{
+		void (*invoke)(void *storage);
+		void (*move)(void *to, void *from);
+		void (*destroy)(void *storage);
+	};
+
+	// One table of functions per callable type
+	template<class F>
+	struct Ops
+	{
+		static const bool LOCAL = sizeof(F) <= STORAGE_SIZE && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<F>;
+
+		static F *get(void *storage)
+		{
+			if constexpr (LOCAL)
+			{
+				return std::launder(reinterpret_cast<F*>(storage));
+			}
+			else
+			{
+				return *reinterpret_cast<F**>(storage);
+			}
+		}
+
+		static void invoke(void *storage)
+		{
+			(*get(storage))();
+		}
+
+		static void move(void *to, void *from)
+		{
+			if constexpr (LOCAL)
+			{
+				new (to) F(std::move(*get(from)));
+				get(from)->~F();
+			}
+			else
+			{
+				*reinterpret_cast<F**>(to) = get(from);
+			}
+		}
+
+		static void destroy(void *storage)
+		{
+			if constexpr (LOCAL)
+			{
+				get(storage)->~F();
+			}
+			else
+			{
+				delete get(storage);
+			}
+		}
+
+		static constexpr Table TABLE{ &invoke, &move, &destroy };
+	};
+
+	alignas(std::max_align_t) unsigned char storage[STORAGE_SIZE];
+	const Table *ops = nullptr;
+	JobCounter *counter = nullptr;
+
+	/// <summary>
+	/// Take the callable out of another job, leaving it empty.
+	/// </summary>
+	/// <param name="other">The job to move from.</param>
+	void moveFrom(Job &other)
+	{
+		if (other.ops != nullptr)
+		{
+			other.ops->move(storage, other.storage);
+		}
+
+		ops = other.ops;
+		counter = other.counter;
+		other.ops = nullptr;
+		other.counter = nullptr;
+	}
+
+	/// <summary>
+	/// Destroy the callable, leaving the job empty.
+	/// </summary>
+	void reset()
+	{
+		if (ops != nullptr)
+		{
+			ops->destroy(storage);
+			ops = nullptr;
+		}
+
+		counter = nullptr;
+	}
+};
+
+class JobQueue
+{
+public:
+	/// <summary>
+	/// Check whether the queue is empty.
+	/// </summary>
+	/// <returns>True if there are no jobs in the queue.</returns>
+	bool empty() const
+	{
+		return count == 0;
+	}
+
+	/// <summary>
+	/// Get the number of jobs in the queue.
+	/// </summary>
+	/// <returns>The number of jobs.</returns>
+	std::size_t size() const
+	{
+		return count;
+	}
+
+	/// <summary>
+	/// Add a job to the back of the queue.
+	/// The buffer doubles in size when it's full and never shrinks.
+	/// </summary>
+	/// <param name="job">The job to add.</param>
+	void pushBack(Job &&job)
+	{
+		if (count == ring.size())
+		{
+			grow();
+		}
+
+		ring[(head + count) & (ring.size() - 1)] = std::move(job);
+		++count;
+	}
+
+	/// <summary>
+	/// Take the job at the back of the queue (the newest).
+	/// </summary>
+	/// <returns>The job.</returns>
+	Job popBack()
+	{
+		--count;
+		return std::move(ring[(head + count) & (ring.size() - 1)]);
+	}
+
+	/// <summary>
+	/// Take the job at the front of the queue (the oldest).
+	/// </summary>
+	/// <returns>The job.</returns>
+	Job popFront()
+	{
+		Job job = std::move(ring[head]);
+
+		head = (head + 1) & (ring.size() - 1);
+		--count;
+
+		return job;
+	}
+
+	/// <summary>
+	/// Take the newest job that reports to the given counter, wherever it is in
+	/// the queue. The jobs behind it move up one place, so the rest stay in order.
+	/// </summary>
+	/// <param name="counter">The counter the job must report to.</param>
+	/// <param name="job">The job is moved in here, if one is found.</param>
+	/// <returns>True if a job was found.</returns>
+	bool takeMatching(const JobCounter *counter, Job &job)
+	{
+		std::size_t mask = ring.size() - 1;
+
+		for (std::size_t i = count; i-- > 0;)
+		{
+			if (ring[(head + i) & mask].getCounter() != counter)
+			{
+				continue;
+			}
+
+			job = std::move(ring[(head + i) & mask]);
+
+			for (std::size_t j = i + 1; j < count; ++j)
+			{
+				ring[(head + j - 1) & mask] = std::move(ring[(head + j) & mask]);
+			}
+
+			--count;
+
+			return true;
+		}
+
+		return false;
+	}
+
+private:
+	std::vector<Job> ring;
+	std::size_t head = 0;
+	std::size_t count = 0;
+
+	/// <summary>
+	/// Double the capacity (always a power of two) and unwrap the jobs to the start.
+	/// </summary>
+	void grow()
+	{
+		std::vector<Job> bigger(ring.empty() ? 64 : ring.size() * 2);
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			bigger[i] = std::move(ring[(head + i) & (ring.size() - 1)]);
+		}
+
+		ring = std::move(bigger);
+		head = 0;
+	}
+};
+
+#endif // !JOB_H
@@ -0,0 +1,192 @@
+// --------------------------------------------
+// ParallelFor.h
+// --------------------------------------------
+// Loops that are split into chunks and run
+// on a ThreadPool. The range is cut into
+// chunks of the given grain size (the last
+// chunk in each direction is clipped so
+// nothing past the end is touched and
+// nothing is left out). One job per thread
+// keeps taking the next unclaimed chunk
+// until there are none left, so uneven
+// chunks still balance out across threads.
+// The calling thread takes chunks too.
+// A grain size of 0 picks one automatically.
+// The number of threads working on a loop
+// can be capped, so a test can use only part
+// of a pool that is shared with other tests.
+// --------------------------------------------
+
+#ifndef PARALLELFOR_H
+#define PARALLELFOR_H
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+struct Range2D
+{
+	int beginX;
+	int beginY;
+	int endX;
+	int endY;
+
+	int width() const { return endX - beginX; }
+	int height() const { return endY - beginY; }
+};
+
+struct Grain2D
+{
+	int width;
+	int height;
+};
+
+// Roughly how many chunks each thread should get when the grain size is
+// picked automatically. More chunks balance better, fewer cost less
+static const int CHUNKS_PER_THREAD = 4;
+
+/// <summary>
+/// Get the number of threads a loop will run on: the pool's threads plus
+/// the calling thread, capped at the given limit.
+/// </summary>
+/// <param name="pool">The pool to run on.</param>
+/// <param name="maxConcurrency">The most threads to use (0 for no limit).</param>
+/// <returns>The number of threads, at least 1.</returns>
+inline int getConcurrency(const ThreadPool &pool, int maxConcurrency)
+{
+	int concurrency = static_cast<int>(pool.getThreadAmount()) + 1;
+
+	if (maxConcurrency > 0)
+	{
+		concurrency = std::min(concurrency, maxConcurrency);
+	}
+
+	return concurrency;
+}
+
+/// <summary>
+/// Split a count into chunks and run them across the pool.
+/// The function is called with the chunk number.
+/// This blocks until every chunk has finished.
+/// </summary>
+/// <param name="pool">The pool to run on.</param>
+/// <param name="chunkAmount">The number of chunks.</param>
+/// <param name="function">Called once for each chunk number.</param>
+/// <param name="maxConcurrency">The most threads to use, including the calling thread (0 for no limit).</param>
+template<class F>
+void runChunks(ThreadPool &pool, int chunkAmount, const F &function, int maxConcurrency = 0)
+{
+	if (chunkAmount <= 0)
+	{
+		return;
+	}
+
+	std::atomic<int> nextChunk{ 0 };
+	JobCounter jobCounter;
+
+	auto runner = [&]
+	{
+		for (int chunk = nextChunk.fetch_add(1); chunk < chunkAmount; chunk = nextChunk.fetch_add(1))
+		{
+			function(chunk);
+		}
+	};
+
+	// The calling thread is one of the runners, so one fewer job is needed
+	int jobAmount = std::min(chunkAmount, getConcurrency(pool, maxConcurrency)) - 1;
+
+	for (int i = 0; i < jobAmount; ++i)
+	{
+		pool.addJob(jobCounter, runner);
+	}
+
+	runner();
+
+	pool.wait(jobCounter);
+}
+
+/// <summary>
+/// Run a function over [begin, end) in parallel.
+/// The function is called with the first and one-past-last index of each chunk.
+/// </summary>
+/// <param name="pool">The pool to run on.</param>
+/// <param name="begin">The first index.</param>
+/// <param name="end">One past the last index.</param>
+/// <param name="grain">The number of indices per chunk (0 to pick automatically).</param>
+/// <param name="function">Called as function(chunkBegin, chunkEnd).</param>
+/// <param name="maxConcurrency">The most threads to use, including the calling thread (0 for no limit).</param>
+template<class F>
+void parallelFor(ThreadPool &pool, int begin, int end, int grain, const F &function, int maxConcurrency = 0)
+{
+	int count = end - begin;
+
+	if (count <= 0)
+	{
+		return;
+	}
+
+	if (grain <= 0)
+	{
+		int targetChunks = getConcurrency(pool, maxConcurrency) * CHUNKS_PER_THREAD;
+		grain = std::max(1, (count + targetChunks - 1) / targetChunks);
+	}
+
+	int chunkAmount = (count + grain - 1) / grain;
+
+	runChunks(pool, chunkAmount, [&](int chunk)
+	{
+		int chunkBegin = begin + chunk * grain;
+		int chunkEnd = std::min(chunkBegin + grain, end);
+
+		function(chunkBegin, chunkEnd);
+	}, maxConcurrency);
+}
+
+/// <summary>
+/// Run a function over a 2D range in parallel, one tile at a time.
+/// If the grain width is 0 each tile covers whole rows, which suits
+/// row-major arrays. If the grain height is 0 it's picked so each thread
+/// gets a few tiles.
+/// </summary>
+/// <param name="pool">The pool to run on.</param>
+/// <param name="range">The area to cover.</param>
+/// <param name="grain">The tile size.</param>
+/// <param name="function">Called as function(tile) with a Range2D.</param>
+/// <param name="maxConcurrency">The most threads to use, including the calling thread (0 for no limit).</param>
+template<class F>
+void parallelFor2D(ThreadPool &pool, const Range2D &range, Grain2D grain, const F &function, int maxConcurrency = 0)
+{
+	if (range.width() <= 0 || range.height() <= 0)
+	{
+		return;
+	}
+
+	if (grain.width <= 0)
+	{
+		grain.width = range.width();
+	}
+
+	int tilesW = (range.width() + grain.width - 1) / grain.width;
+
+	if (grain.height <= 0)
+	{
+		int targetRows = std::max(1, getConcurrency(pool, maxConcurrency) * CHUNKS_PER_THREAD / tilesW);
+		grain.height = std::max(1, (range.height() + targetRows - 1) / targetRows);
+	}
+
+	int tilesH = (range.height() + grain.height - 1) / grain.height;
+
+	runChunks(pool, tilesW * tilesH, [&](int chunk)
+	{
+		Range2D tile;
+		tile.beginX = range.beginX + (chunk % tilesW) * grain.width;
+		tile.beginY = range.beginY + (chunk / tilesW) * grain.height;
+		tile.endX = std::min(tile.beginX + grain.width, range.endX);
+		tile.endY = std::min(tile.beginY + grain.height, range.endY);
+
+		function(tile);
+	}, maxConcurrency);
+}
+
+#endif // !PARALLELFOR_H
@@ -12,43 +12,19 @@
 
 #include "imgui.h"
 #include "imgui-SFML.h"
-#include "ThreadPool.h"
+#include "ParallelFor.h"
+#include "PoolStatsPanel.h"
+#include "ScalingPanel.h"
+#include "PerfCounterPanel.h"
 #include "DefaultParticle.h"
+#include "Generator.h"
 #include "Timer.h"
-
-struct Generator
-{
-	Generator(sf::Vector2f &startPosition, sf::Time &dt, int &numOfParticles, float &speed, float &timeToLive, std::vector<uint8_t> *pixelsPtr) 
-		: startPosition(startPosition), dt(dt), numOfParticles(numOfParticles), speed(speed), timeToLive(timeToLive), pixelsPtr(pixelsPtr) { }
-
-	sf::Vector2f &startPosition;
-	sf::Time &dt;
-	int &numOfParticles;
-	float &speed;
-	float &timeToLive;
-	std::vector<uint8_t> *pixelsPtr;
-	std::vector<Particle*> particlePool;	
-
-	void update(int scrW, int threadAmount)
-	{
-		for (int i = 0; i < (numOfParticles / threadAmount); ++i)
-		{
-			if (!particlePool[i]->alive)
-			{
-				particlePool[i]->generate(startPosition, speed, timeToLive);
-			}
-			else
-			{
-				particlePool[i]->update(dt, *pixelsPtr, scrW);
-			}
-		}
-	}
-};
+#include "Profiler.h"
 
 class ParticleEffect
 {
 public:
-	ParticleEffect(sf::Time &dt);
+	ParticleEffect(sf::Time &dt, ThreadPool &threadPool);
 	~ParticleEffect();
 	void update(const sf::Time &dt);
 	void handleUI();
@@ -56,7 +32,11 @@ public:
 private:
 	std::vector<uint8_t> pixels;
 	std::vector<uint8_t> *pixelsPtr;
-	std::unique_ptr<ThreadPool> threadPool;
+	ThreadPool *threadPool;
+	int threadLimit;
+	PoolStatsPanel poolStats;
+	ScalingPanel scalingPanel;
+	PerfCounterPanel perfCounters;
 	std::random_device rd;
 	std::mt19937 gen;
 	int threadAmount;
@@ -75,6 +55,9 @@ private:
 	double ms;
 	sf::Clock clock;
 	sf::Time clTimer;
+
+	void updateGenerators(bool multiThreaded, int threadLimit);
+	double runAtThreads(int threads);
 };
 
 #endif // !PARTICLEEFFECTS_H
\ No newline at end of file
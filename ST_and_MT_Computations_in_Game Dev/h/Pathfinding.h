@@ -16,16 +16,20 @@
 
 #include "imgui.h"
 #include "imgui-SFML.h"
-#include "ThreadPool.h"
+#include "ParallelFor.h"
+#include "PoolStatsPanel.h"
+#include "ScalingPanel.h"
+#include "PerfCounterPanel.h"
 #include "Vec3.h"
 #include "Timer.h"
+#include "Profiler.h"
 #include "TileMap.h"
 #include "Bot.h"
 
 class Pathfinding
 {
 public:
-	Pathfinding();
+	Pathfinding(ThreadPool &threadPool);
 	~Pathfinding();
 	void update(const sf::Time &dt);
 	void handleUI();
@@ -39,7 +43,11 @@ private:
 	std::unique_ptr<sf::Texture> tileSet;
 	sf::RenderTexture tileMap_RT;
 	std::unique_ptr<sf::RenderTexture> main_RT;
-	std::unique_ptr<ThreadPool> threadPool;
+	ThreadPool *threadPool;
+	int threadLimit;
+	PoolStatsPanel poolStats;
+	ScalingPanel scalingPanel;
+	PerfCounterPanel perfCounters;
 	float zoom = 1.0f;
 	int mapWidth = 256;
 	int mapHeight = 256;
@@ -68,6 +76,7 @@ private:
 	void loadDemoBots();
 	void writeBotPositionsToFile();
 	void startPathfinding(bool multiThreaded);
+	double runAtThreads(int threads);
 };
 
 #endif // !PATHFINDING_H
\ No newline at end of file
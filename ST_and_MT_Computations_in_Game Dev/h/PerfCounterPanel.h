@@ -0,0 +1,36 @@
+// --------------------------------------------
+// PerfCounterPanel.h
+// PerfCounterPanel.cpp
+// --------------------------------------------
+// Shows the hardware counters from a test's
+// PERF_SCOPEs during its last timed run, next
+// to its time. Call begin() and end() around
+// the code being timed, pass getTotals() to
+// the PERF_SCOPEs and call handleUI() to draw
+// the results. Counting slows every scope
+// down a little, so it's off until it's
+// turned on here.
+// --------------------------------------------
+
+#ifndef PERFCOUNTERPANEL_H
+#define PERFCOUNTERPANEL_H
+
+#include "imgui.h"
+#include "PerfCounters.h"
+
+class PerfCounterPanel
+{
+public:
+	PerfCounterPanel();
+	~PerfCounterPanel();
+	void begin();
+	void end();
+	void handleUI();
+	PerfCounterTotals &getTotals();
+
+private:
+	PerfCounterTotals totals;
+	PerfCounterValues runValues;
+};
+
+#endif // !PERFCOUNTERPANEL_H
@@ -0,0 +1,118 @@
+// --------------------------------------------
+// PerfCounters.h
+// PerfCounters.cpp
+// --------------------------------------------
+// Hardware performance counters for profiling
+// scopes. Put PERF_SCOPE(totals) next to a
+// PROFILE_SCOPE and, while counting is turned
+// on, the cycles, instructions, last level
+// cache misses, branch misses and context
+// switches of the calling thread inside that
+// scope are added to the totals.
+// Counters come from perf_event_open, so they
+// only work on Linux, and only if the kernel
+// lets this process use them (see
+// /proc/sys/kernel/perf_event_paranoid).
+// Each thread opens its own counters the
+// first time it enters a scope. When the
+// PMU is shared, counts are scaled up by the
+// share of time they were really counting.
+// Context switches come from getrusage and
+// work on any Linux kernel.
+// Everywhere else PERF_SCOPE does nothing.
+// --------------------------------------------
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include "Profiler.h"
+
+#include <atomic>
+#include <cstdint>
+
+struct PerfCounterValues
+{
+	std::uint64_t cycles = 0;
+	std::uint64_t instructions = 0;
+	std::uint64_t cacheMisses = 0;
+	std::uint64_t branchMisses = 0;
+	std::uint64_t contextSwitches = 0;
+	std::uint64_t scopes = 0;
+};
+
+class PerfCounterTotals
+{
+public:
+	void reset();
+	void add(const PerfCounterValues &values);
+	PerfCounterValues get() const;
+
+private:
+	std::atomic<std::uint64_t> cycles{ 0 };
+	std::atomic<std::uint64_t> instructions{ 0 };
+	std::atomic<std::uint64_t> cacheMisses{ 0 };
+	std::atomic<std::uint64_t> branchMisses{ 0 };
+	std::atomic<std::uint64_t> contextSwitches{ 0 };
+	std::atomic<std::uint64_t> scopes{ 0 };
+};
+
+struct PerfSample
+{
+	std::uint64_t values[4] = {};
+	std::uint64_t timeEnabled = 0;
+	std::uint64_t timeRunning = 0;
+	std::uint64_t contextSwitches = 0;
+};
+
+class PerfCounters
+{
+public:
+	static void setEnabled(bool enabled);
+	static bool isEnabled();
+	static bool isAvailable();
+	static PerfSample read();
+	static PerfCounterValues difference(const PerfSample &start, const PerfSample &end);
+};
+
+class PerfScope
+{
+public:
+	/// <summary>
+	/// Start counting a scope. Nothing is counted unless counting is turned on.
+	/// </summary>
+	/// <param name="totals">The totals to add the scope's counts to.</param>
+	explicit PerfScope(PerfCounterTotals &totals) : totals(totals), active(PerfCounters::isEnabled())
+	{
+		if (active)
+		{
+			start = PerfCounters::read();
+		}
+	}
+
+	PerfScope(const PerfScope &) = delete;
+	PerfScope &operator=(const PerfScope &) = delete;
+
+	/// <summary>
+	/// Add the scope's counts to the totals when it goes out of scope.
+	/// </summary>
+	~PerfScope()
+	{
+		if (active)
+		{
+			totals.add(PerfCounters::difference(start, PerfCounters::read()));
+		}
+	}
+
+private:
+	PerfCounterTotals &totals;
+	bool active;
+	PerfSample start;
+};
+
+#ifndef DISABLE_PROFILER
+#define PERF_SCOPE(totals) PerfScope PROFILE_CONCAT(perfScope_, __LINE__)(totals)
+#else
+#define PERF_SCOPE(totals)
+#endif
+
+#endif // !PERFCOUNTERS_H
@@ -0,0 +1,48 @@
+// --------------------------------------------
+// PoolStatsPanel.h
+// PoolStatsPanel.cpp
+// --------------------------------------------
+// Shows what the ThreadPool's threads were
+// doing during a test's last timed run: how
+// many jobs each one ran and stole, and how
+// much of the run it spent busy, asleep and
+// waiting for locks. Call begin() and end()
+// around the code being timed, and
+// handleUI() to draw the results. Each
+// panel watches the queue depths on its own,
+// so panels never reset each other's. The
+// other counters belong to the threads, not
+// the test, and the pool is shared by all
+// tests, so anything else using it during
+// the same run shows up too. Keep the run
+// to just the code being timed.
+// --------------------------------------------
+
+#ifndef POOLSTATSPANEL_H
+#define POOLSTATSPANEL_H
+
+#include "imgui.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <vector>
+
+class PoolStatsPanel
+{
+public:
+	PoolStatsPanel(ThreadPool &threadPool);
+	~PoolStatsPanel();
+	void begin();
+	void end();
+	void handleUI();
+
+private:
+	ThreadPool *threadPool;
+	std::vector<ThreadStats> startStats;
+	std::vector<ThreadStats> runStats;
+	int highWaterWatch = -1;
+	std::chrono::steady_clock::time_point startTimepoint;
+	double runNs = 0.0;
+};
+
+#endif // !POOLSTATSPANEL_H
@@ -0,0 +1,86 @@
+// --------------------------------------------
+// Profiler.h
+// Profiler.cpp
+// --------------------------------------------
+// A scoped profiler. Put PROFILE_SCOPE("Name")
+// at the top of a block and, while a capture
+// is running, the time spent in that block is
+// recorded as a zone. Zones inside zones show
+// up nested underneath them, on whichever
+// thread they ran on.
+// Every thread writes its zones into its own
+// fixed-size buffer, so recording a zone
+// never takes a lock or allocates memory. If
+// a buffer fills up, further zones on that
+// thread are dropped (and counted) until the
+// next capture starts.
+// A capture can be saved in the Chrome trace
+// JSON format and opened in about:tracing or
+// https://ui.perfetto.dev to see every thread
+// on one timeline.
+// Define DISABLE_PROFILER to compile all of
+// the PROFILE_SCOPE zones out.
+// --------------------------------------------
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "Timer.h"
+
+#include <cstdint>
+#include <string>
+
+class Profiler
+{
+public:
+	static void startCapture();
+	static void stopCapture();
+	static bool isCapturing();
+	static bool saveChromeTrace(const std::string &path);
+	static std::size_t getEventAmount();
+	static std::size_t getDroppedAmount();
+	static void setThreadName(const char *name);
+	static void record(const char *label, Timer::Clock::time_point start, Timer::Clock::time_point end);
+};
+
+class ProfileZone
+{
+public:
+	/// <summary>
+	/// Start timing a zone. Nothing is timed unless a capture is running.
+	/// </summary>
+	/// <param name="label">The zone name. This must be a string literal.</param>
+	explicit ProfileZone(const char *label) : timer(label), active(Profiler::isCapturing())
+	{
+
+	}
+
+	ProfileZone(const ProfileZone &) = delete;
+	ProfileZone &operator=(const ProfileZone &) = delete;
+
+	/// <summary>
+	/// Record the zone when it goes out of scope.
+	/// </summary>
+	~ProfileZone()
+	{
+		if (active)
+		{
+			Profiler::record(timer.getLabel(), timer.getStartTimepoint(), Timer::Clock::now());
+		}
+	}
+
+private:
+	Timer timer;
+	bool active;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifndef DISABLE_PROFILER
+#define PROFILE_SCOPE(label) ProfileZone PROFILE_CONCAT(profileZone_, __LINE__)(label)
+#else
+#define PROFILE_SCOPE(label)
+#endif
+
+#endif // !PROFILER_H
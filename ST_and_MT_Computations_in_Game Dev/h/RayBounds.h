@@ -0,0 +1,60 @@
+// --------------------------------------------
+// RayBounds.h
+// RayBounds.cpp
+// --------------------------------------------
+// A record of roughly where the rays traced
+// for one tile of the image went, apart from
+// the camera rays. Reflection and refraction
+// rays are kept as bundles, one per bounce:
+// a box around where they started, a box
+// around their directions and the longest
+// one's length. Shadow rays are kept as one
+// more bundle.
+// After a sphere is edited, mayHit() says
+// whether any of these rays could have gone
+// near it, before or after the edit. If not,
+// the tile would render exactly the same and
+// doesn't need rendering again. The check
+// never misses a ray that does hit the
+// sphere, but it often says yes for rays that
+// just pass close by. Mirrors and glass send
+// rays almost everywhere, so tiles showing
+// them are usually rendered again.
+// --------------------------------------------
+
+#ifndef RAYBOUNDS_H
+#define RAYBOUNDS_H
+
+#include "Vec3.h"
+#include "BVH.h"
+
+#include <vector>
+
+struct RayBundle
+{
+    AABB origins;
+    AABB directions;
+    float maxLength = 0.0f; // INFINITY if any ray missed everything
+
+    void add(const Vec3f &origin, const Vec3f &dir, float length);
+    void merge(const RayBundle &bundle);
+    bool mayHit(const Vec3f &center, float radius) const;
+};
+
+class RayBounds
+{
+public:
+    static const int DEPTHS = 4; // Bounces this deep or deeper share the last bundle
+
+    void clear();
+    void merge(const RayBounds &bounds);
+    void addBounce(int depth, const Vec3f &origin, const Vec3f &dir, float length);
+    void addShadow(const Vec3f &origin, const Vec3f &dir);
+    bool mayHit(const Vec3f &center, float radius, const std::vector<Vec3f> &lights) const;
+
+private:
+    RayBundle bounces[DEPTHS];
+    RayBundle shadows;
+};
+
+#endif // !RAYBOUNDS_H
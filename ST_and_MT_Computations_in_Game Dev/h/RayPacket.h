@@ -0,0 +1,125 @@
+// --------------------------------------------
+// RayPacket.h
+// --------------------------------------------
+// Up to 64 rays traced through the BVH
+// together, such as the camera rays of an
+// 8x8 block of pixels. Rays that start close
+// together and point the same way mostly
+// pass through the same boxes, so each box
+// is fetched once for the whole packet and
+// tested against 8 rays at a time.
+// Each ray is stored as a structure of
+// arrays, ready to be loaded 8 at a time.
+// When every ray starts at the same point
+// (camera rays do), the packet can also
+// have a frustum: four planes through the
+// origin that every ray lies between. A box
+// entirely outside the frustum can't be hit
+// by any ray in the packet, so it is skipped
+// without testing the rays one by one.
+// --------------------------------------------
+
+#ifndef RAYPACKET_H
+#define RAYPACKET_H
+
+#include "Vec3.h"
+
+#include <cstdint>
+
+struct RayPacket
+{
+    static const int MAX_RAYS = 64;
+
+    alignas(32) float originX[MAX_RAYS];
+    alignas(32) float originY[MAX_RAYS];
+    alignas(32) float originZ[MAX_RAYS];
+    alignas(32) float dirX[MAX_RAYS];
+    alignas(32) float dirY[MAX_RAYS];
+    alignas(32) float dirZ[MAX_RAYS];
+    alignas(32) float invDirX[MAX_RAYS];
+    alignas(32) float invDirY[MAX_RAYS];
+    alignas(32) float invDirZ[MAX_RAYS];
+
+    int amount = 0;
+    std::uint64_t active = 0; // Bit N is set if ray N should be traced
+
+    bool hasFrustum = false;
+    Vec3f frustumOrigin;
+    Vec3f frustumNormals[4]; // Each points into the frustum
+
+    /// <summary>
+    /// Store a ray in the packet and mark it active.
+    /// </summary>
+    /// <param name="index">The ray's slot, below MAX_RAYS.</param>
+    /// <param name="rayOrigin">The origin point of the ray.</param>
+    /// <param name="rayDir">The direction of the ray.</param>
+    void setRay(int index, const Vec3f &rayOrigin, const Vec3f &rayDir)
+    {
+        originX[index] = rayOrigin.x;
+        originY[index] = rayOrigin.y;
+        originZ[index] = rayOrigin.z;
+        dirX[index] = rayDir.x;
+        dirY[index] = rayDir.y;
+        dirZ[index] = rayDir.z;
+
+        // The same sums as BVH::closestHit, so boxes are culled the same way
+        invDirX[index] = 1.0f / rayDir.x;
+        invDirY[index] = 1.0f / rayDir.y;
+        invDirZ[index] = 1.0f / rayDir.z;
+
+        active |= std::uint64_t(1) << index;
+        amount = index + 1 > amount ? index + 1 : amount;
+    }
+
+    /// <summary>
+    /// Get a ray's origin.
+    /// </summary>
+    /// <param name="index">The ray's slot.</param>
+    /// <returns>The origin point of the ray.</returns>
+    Vec3f getOrigin(int index) const
+    {
+        return Vec3f(originX[index], originY[index], originZ[index]);
+    }
+
+    /// <summary>
+    /// Get a ray's direction.
+    /// </summary>
+    /// <param name="index">The ray's slot.</param>
+    /// <returns>The direction of the ray.</returns>
+    Vec3f getDir(int index) const
+    {
+        return Vec3f(dirX[index], dirY[index], dirZ[index]);
+    }
+
+    /// <summary>
+    /// Set up the frustum from the four corner rays, which must all start at
+    /// the same point and go round the packet in order. Every other ray in the
+    /// packet must lie between them.
+    /// </summary>
+    /// <param name="origin">The point all the rays start at.</param>
+    /// <param name="corners">The corner rays' directions.</param>
+    void setFrustum(const Vec3f &origin, const Vec3f corners[4])
+    {
+        Vec3f middle = corners[0] + corners[1] + corners[2] + corners[3];
+
+        for (int i = 0; i < 4; ++i)
+        {
+            const Vec3f &a = corners[i];
+            const Vec3f &b = corners[(i + 1) % 4];
+            Vec3f normal(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+
+            // Point the normal towards the middle of the packet, whichever way round the corners go
+            if (normal.dot(middle) < 0)
+            {
+                normal = -normal;
+            }
+
+            frustumNormals[i] = normal.normalize();
+        }
+
+        frustumOrigin = origin;
+        hasFrustum = true;
+    }
+};
+
+#endif // !RAYPACKET_H
@@ -0,0 +1,223 @@
+// --------------------------------------------
+// RayScene.h
+// RayScene.cpp
+// --------------------------------------------
+// The spheres, camera and render settings
+// the raytracer draws, and the code that
+// traces rays through them. None of this
+// touches the window or the GPU, so the
+// same scene can be rendered by the
+// Raytracer test or by the headless
+// benchmark.
+// Rays are traced through a BVH. Use
+// addSphere(), removeSphere() and
+// updateSphere() to edit the scene and the
+// BVH is updated to match. After changing
+// the spheres any other way, call build()
+// before rendering.
+// renderSection() traces camera rays in 8x8
+// packets, along with the shadow rays from
+// whatever they hit first. Reflections and
+// refractions point every which way, so
+// those are traced one ray at a time.
+// Bounces are traced without recursion, in
+// waves: every reflection and refraction
+// ray from one bounce is traced before any
+// from the next. Each ray carries how much
+// it adds to its pixel, and rays that would
+// add less than minContribution are never
+// traced, so a glass sphere doesn't spawn
+// 2^maxBounces rays.
+// Before rendering, binSpheres() can sort
+// the spheres into 8x8 blocks of pixels by
+// where they land on the image, like tiled
+// light culling. Camera rays then only test
+// the few spheres in their own block, rather
+// than going through the BVH. Blocks covered
+// by lots of spheres (usually far away, near
+// the horizon) still use the BVH, and so do
+// every other kind of ray.
+// Shadow rays stop at the first sphere in
+// their way. Each chunk also remembers which
+// sphere last blocked the shadow rays from
+// a surface to a light, and tests it first,
+// as neighbouring points are usually in the
+// same shadow.
+// At full resolution, pixels whose colour
+// stands out from a neighbour's (usually on
+// an edge) can be traced again with an
+// aaGrid x aaGrid grid of samples, each
+// jittered inside its cell, and averaged.
+// Flat areas keep their one sample.
+// renderSection() can also render into an
+// HDRBuffer, which keeps each pixel's colour
+// unclamped. With accumulate, it adds one
+// more sample to every pixel instead,
+// through a different point of the pixel
+// each time, so the image converges on a
+// fully anti-aliased one.
+// renderSection() can also record where
+// the rays other than camera rays went, so
+// the section is only rendered again when
+// an edit could change it, which
+// isSectionDirty() works out.
+// --------------------------------------------
+
+#ifndef RAYSCENE_H
+#define RAYSCENE_H
+
+#include "Vec3.h"
+#include "BVH.h"
+#include "RayBounds.h"
+#include "SphereSoA.h"
+#include "HDRBuffer.h"
+
+#include <SFML/System/Vector2.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+struct Sphere
+{
+    Vec3f center;
+    float radius;
+    float radius2;
+    Vec3f surfaceColour;
+    float transparency;
+    float reflection;
+    Vec3f emissionColour;
+
+    /// <summary>
+    /// Sphere constructor.
+    /// </summary>
+    /// <param name="center">The sphere's center point.</param>
+    /// <param name="radius">The sphere's radius.</param>
+    /// <param name="surfaceColour">The sphere's surface colour.</param>
+    /// <param name="reflection">The sphere's reflection value.</param>
+    /// <param name="transparency">The sphere's transparency value.</param>
+    /// <param name="emission">The sphere's emission colour.</param>
+    Sphere(const Vec3f &center, const float &radius, const Vec3f &surfaceColour, const float &reflection = 0.0f, const float &transparency = 0.0f, const Vec3f &emissionColour = 0.0f)
+        :
+        center(center), radius(radius), radius2(radius *radius), surfaceColour(surfaceColour), reflection(reflection), transparency(transparency), emissionColour(emissionColour) { }
+
+    /// <summary>
+    /// Compute a ray to sphere intersection using the geometric solution.
+    /// </summary>
+    /// <param name="rayOrigin">The origin point of the ray.</param>
+    /// <param name="rayDir">The direction of the ray.</param>
+    /// <param name="t0">Near value.</param>
+    /// <param name="t1">Far value.</param>
+    /// <returns>True if there's an intersection, false if there's no intersection.</returns>
+    bool intersect(const Vec3f &rayOrigin, const Vec3f &rayDir, float &t0, float &t1) const
+    {
+        Vec3f l = center - rayOrigin;
+        float tca = l.dot(rayDir);
+
+        if (tca < 0) { return false; }
+
+        float d2 = l.dot(l) - tca * tca;
+
+        if (d2 > radius2) { return false; }
+
+        float thc = std::sqrt(radius2 - d2);
+        t0 = tca - thc;
+        t1 = tca + thc;
+
+        return true;
+    }
+};
+
+// The pixels whose camera rays could hit a sphere, from RayScene::getFootprint()
+struct Footprint
+{
+    sf::Vector2i pixTL;
+    sf::Vector2i pixBR;
+};
+
+struct RayScene
+{
+    std::vector<Sphere> spheres;
+    Vec3f rayOrigin{ 0.0f, 0.0f, 10.0f };
+    int fov = 30;
+    int maxBounces = 25;
+    Vec3f backgroundColour{ 1.0f };
+    bool usePackets = true; // Trace camera and shadow rays in packets rather than one at a time
+    float minContribution = 1e-3f; // Reflection and refraction rays that add less than this to their pixel aren't traced
+    bool useBins = true; // Camera rays only test the spheres binned to their block of pixels, after binSpheres()
+    bool useShadowCache = true; // Shadow rays test the sphere that last blocked the way to the same light first
+    int aaGrid = 1; // Pixels that stand out are traced again with this many samples across and down, 1 for none
+    float aaThreshold = 0.05f; // How far, from 0 to 1, a pixel's colour has to be from a neighbour's to stand out
+
+    RayScene();
+    ~RayScene();
+    void build();
+    void addSphere(const Sphere &sphere);
+    void removeSphere(int index);
+    void updateSphere(int index);
+    void scatterSpheres(int amount, unsigned int seed);
+    const BVH &getBVH() const;
+    const std::vector<int> &getLights() const;
+    void binSpheres(int renderW, int renderH);
+    void getFootprint(const Sphere &sphere, int renderW, int renderH, sf::Vector2i &pixTL, sf::Vector2i &pixBR) const;
+    Vec3f trace(const Vec3f &rayOrigin, const Vec3f &rayDir, const int &depth) const;
+    void renderSection(std::vector<uint8_t> &pixelArray, int renderW, int renderH, sf::Vector2i pixTL, sf::Vector2i pixBR, int step = 1, int skipStep = 0, RayBounds *bounds = nullptr) const;
+    void renderSection(HDRBuffer &hdrBuffer, sf::Vector2i pixTL, sf::Vector2i pixBR, int step = 1, int skipStep = 0, RayBounds *bounds = nullptr, bool accumulate = false) const;
+
+private:
+    // A ray waiting to be traced
+    struct WaveRay
+    {
+        Vec3f origin;
+        Vec3f dir;
+        Vec3f weight; // How much of the colour it finds is added to its pixel
+        int pixel;    // Where its colour goes
+        int depth;    // Depth of recursion
+    };
+
+    // The spheres each 8x8 block of pixels' camera rays could hit, for one camera and image size
+    struct SphereBins
+    {
+        SphereSoA spheres;       // Each bin's spheres, one bin after another
+        std::vector<int> starts; // Where each bin's spheres start in spheres
+        std::vector<int> counts; // How many spheres each bin has, -1 if too many to be worth it
+        int columns = 0;
+        int renderW = 0;
+        int renderH = 0;
+        Vec3f rayOrigin;
+        int fov = 0;
+        bool ready = false;      // Cleared when the spheres change
+    };
+
+    // The sphere that last blocked a shadow ray from each surface to each light, for one chunk
+    struct ShadowCache
+    {
+        static const int SIZE = 256; // Surfaces and lights that share a slot replace each other
+
+        int surfaces[SIZE];
+        int lights[SIZE];          // The light's place in the list of lights
+        int occluders[SIZE];       // -1 if the slot is empty
+    };
+
+    const double PI = 3.141592653589793;
+    const float BIAS = 1e-4f; // How far rays leaving a surface start from it, so they don't hit it again
+    const int PACKET_SIZE = 8; // The width and height of the pixel blocks traced as one packet
+    const int CHUNK_SIZE = 64; // The width and height of the pixel blocks whose bounces are traced as one set of waves
+    const int MAX_BIN_SPHERES = 32; // Bins with more spheres than this use the BVH instead
+    BVH bvh;
+    SphereBins bins;
+    std::vector<int> lights; // The indices of every sphere that gives off light
+
+    float mix(const float &a, const float &b, const float &mix) const;
+    bool getHitPoint(const Vec3f &rayOrigin, const Vec3f &rayDir, float tNear, const Sphere &sphere, Vec3f &pHit, Vec3f &nHit) const;
+    int &getCachedOccluder(ShadowCache &shadowCache, int surface, int light) const;
+    bool isShadowed(const Vec3f &shadowOrigin, const Vec3f &lightDirection, int surface, int light, ShadowCache *shadowCache) const;
+    void shade(const WaveRay &ray, int sphereIndex, const Vec3f &pHit, const Vec3f &nHit, bool inside, const std::uint64_t *shadowMasks, int rayIndex, std::vector<Vec3f> &colours, std::vector<WaveRay> &nextWave, RayBounds *bounds, ShadowCache *shadowCache) const;
+    void traceWaves(std::vector<WaveRay> &wave, std::vector<Vec3f> &colours, RayBounds *bounds, ShadowCache *shadowCache) const;
+    void renderChunks(std::vector<uint8_t> *pixelArray, HDRBuffer *hdrBuffer, int renderW, int renderH, sf::Vector2i pixTL, sf::Vector2i pixBR, int step, int skipStep, RayBounds *bounds, bool accumulate) const;
+    void renderChunk(std::vector<uint8_t> *pixelArray, HDRBuffer *hdrBuffer, int renderW, int renderH, sf::Vector2i pixTL, sf::Vector2i pixBR, int step, int skipStep, RayBounds *bounds, bool accumulate) const;
+    void antiAliasChunk(const std::vector<uint8_t> *pixelArray, const HDRBuffer *hdrBuffer, int renderW, int renderH, sf::Vector2i pixTL, sf::Vector2i pixBR, std::vector<Vec3f> &colours, std::vector<char> &traced, RayBounds *bounds, ShadowCache *shadowCache) const;
+};
+
+bool isSectionDirty(sf::Vector2i pixTL, sf::Vector2i pixBR, bool finished, const RayBounds &bounds, const std::vector<Sphere> &editedSpheres, const std::vector<Footprint> &footprints, const std::vector<Vec3f> &lights);
+
+#endif // !RAYSCENE_H
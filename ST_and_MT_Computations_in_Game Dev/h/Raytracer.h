@@ -4,6 +4,44 @@
 // --------------------------------------------
 // This class can render spheres using ray
 // tracing.
+// Renders started from the UI don't block:
+// tiles are rendered from the centre out on
+// the pool (or a few per frame on the main
+// thread when single-threaded) and each one
+// is shown as soon as it's finished, so the
+// UI keeps running. They render a copy of
+// the scene, which can be edited meanwhile.
+// With preview refinement on, any change to
+// the camera or spheres restarts the render
+// straight away. The image is rendered at
+// 1/8 resolution first, then 1/4, 1/2 and
+// full, and each pass only traces the
+// pixels the passes before it didn't. A
+// tile's next pass is only handed to the
+// pool once the main thread has shown the
+// last one, so it's never read while it's
+// overwritten, and no thread waits for it.
+// Each tile remembers where its rays went.
+// Editing a sphere only renders the tiles
+// that could show it, before or after the
+// edit: directly, in a reflection or
+// refraction, or in a shadow it casts.
+// Anything that can change every pixel,
+// like moving the camera or a light,
+// renders every tile.
+// The image is kept in an HDRBuffer. With
+// progressive rendering on, once a render
+// has finished and nothing has changed,
+// each idle frame adds one more sample to
+// every pixel, until max samples, so the
+// image keeps getting smoother. Tiles are
+// tone mapped into the texture as they
+// finish, and changing the exposure or soft
+// clip only re-resolves the image.
+// Real-time mode renders the scene every
+// frame instead, blocking, at whatever
+// resolution and bounces keep the frame
+// within its budget (see DynamicResolution).
 // --------------------------------------------
 
 #ifndef RAYTRACER_H
@@ -12,92 +50,113 @@
 #include "imgui.h"
 #include "imgui-SFML.h"
 #include "ThreadPool.h"
+#include "PoolStatsPanel.h"
+#include "ScalingPanel.h"
+#include "PerfCounterPanel.h"
+#include "ParallelFor.h"
+#include "RayScene.h"
+#include "SphereSoA.h"
 #include "Vec3.h"
 #include "Timer.h"
+#include "Profiler.h"
+#include "CompletionQueue.h"
+#include "HDRBuffer.h"
+#include "DynamicResolution.h"
 
 #include <SFML/Graphics.hpp>
-
-struct Sphere
-{
-    Vec3f center;
-    float radius;
-    float radius2;
-    Vec3f surfaceColour;
-    float transparency;
-    float reflection;
-    Vec3f emissionColour;
-    Vec3f rayOrigin;
-
-    /// <summary>
-    /// Sphere constructor.
-    /// </summary>
-    /// <param name="center">The sphere's center point.</param>
-    /// <param name="radius">The sphere's radius.</param>
-    /// <param name="surfaceColour">The sphere's surface colour.</param>
-    /// <param name="reflection">The sphere's reflection value.</param>
-    /// <param name="transparency">The sphere's transparency value.</param>
-    /// <param name="emission">The sphere's emission colour.</param>
-    Sphere(const Vec3f &center, const float &radius, const Vec3f &surfaceColour, const float &reflection = 0.0f, const float &transparency = 0.0f, const Vec3f &emissionColour = 0.0f)
-        :
-        center(center), radius(radius), radius2(radius *radius), surfaceColour(surfaceColour), reflection(reflection), transparency(transparency), emissionColour(emissionColour) { }
-
-    /// <summary>
-    /// Compute a ray to sphere intersection using the geometric solution.
-    /// </summary>
-    /// <param name="rayOrigin">The origin point of the ray.</param>
-    /// <param name="rayDir">The direction of the ray.</param>
-    /// <param name="t0">Near value.</param>
-    /// <param name="t1">Far value.</param>
-    /// <returns>True if there's an intersection, false if there's no intersection.</returns>
-    bool intersect(const Vec3f &rayOrigin, const Vec3f &rayDir, float &t0, float &t1) const
-    {
-        Vec3f l = center - rayOrigin;
-        float tca = l.dot(rayDir);
-
-        if (tca < 0) { return false; }
-
-        float d2 = l.dot(l) - tca * tca;
-
-        if (d2 > radius2) { return false; }
-
-        float thc = std::sqrt(radius2 - d2);
-        t0 = tca - thc;
-        t1 = tca + thc;
-
-        return true;
-    }
-};
+#include <atomic>
 
 class Raytracer
 {
 public:
-	Raytracer(int w, int h);
+	Raytracer(int w, int h, ThreadPool &threadPool);
 	~Raytracer();
     void handleUI();
 
 private:	
-    const double PI = 3.141592653589793;
 	int renderW;
 	int renderH;
-    Vec3f rayOrigin{ 0.0f, 0.0f, 10.0f };
-    int fov = 30;
-    std::unique_ptr<ThreadPool> threadPool;
+    ThreadPool *threadPool;
+    int threadLimit;
+    PoolStatsPanel poolStats;
+    ScalingPanel scalingPanel;
+    PerfCounterPanel perfCounters;
     std::unique_ptr<sf::Texture> renderTexture;
-    std::vector<uint8_t> pixelArray;
-    std::vector<Sphere> spheres;
+    std::vector<uint8_t> pixelArray; // The whole image, tone mapped
+    HDRBuffer hdrBuffer;
+    RayScene scene;
     int renderTileW;
     int renderTileH;
-    int maxBounces;
-    Vec3f backgroundColour;
     bool multiThreaded = false;
-    int activeSphereIndex;
+    int activeSphereIndex = 0;
     bool sphereEditWindowOpen = false;
+    bool previewRefinement = true;
+    bool progressive = true;
+    bool progressivePaused = false; // Cancelled, until the next render
+    int maxSamples = 64;
+    float exposure = 1.0f;
+    bool softClip = false;
+    bool resolveNeeded = false;     // The exposure or soft clip changed during a render
+    bool realTime = false;
+    DynamicResolution dynamicResolution;
+    bool spheresChanged = false; // The spheres have changed since renderingScene was copied
+    std::vector<Sphere> editedSpheres; // Each edited sphere before and after, since the last render started
+    int lastEditedSphere = -1;         // The sphere whose after is last in editedSpheres, if that was the last edit
+    bool fullRenderNeeded = true;      // Something other than editedSpheres has changed every tile
+    int scatterAmount = 100000;
     double ms;
+    double bvhMs = 0.0;
+
+    // The render in progress, if any
+    bool rendering = false;
+    bool renderingMultiThreaded = false;
+    bool accumulating = false;                // Adding a sample to converged tiles rather than rendering
+    int accumulatingSample = 0;               // The fewest samples any of those tiles will have
+    int renderingW = 0;
+    int renderingH = 0;
+    std::unique_ptr<RayScene> renderingScene; // The scene as it was when the render started
+    std::vector<Range2D> tiles;               // Centre first
+    std::vector<int> passSteps;               // The spacing of the pixels each pass traces, coarsest first
+    int workAmount = 0;                       // Every pass of every tile, numbered pass by pass
+    std::vector<int> readyWork;               // Work that can be rendered, in the order it became ready
+    std::atomic<int> readyAmount{ 0 };        // How much of readyWork has been filled in, only by the main thread
+    std::atomic<int> nextReady{ 0 };          // The next of readyWork to render
+    int renderWorkers = 0;                    // The most of the pool's threads to render on
+    std::atomic<int> activeWorkers{ 0 };      // Render jobs added to the pool that haven't run out of work
+    std::atomic<int> renderedWork{ 0 };
+    std::atomic<bool> cancelled{ false };
+    CompletionQueue finishedTiles;            // Tiles rendered but not yet shown
+    JobCounter renderJobs;
+    Timer::Clock::time_point renderStart;
+    Timer::Clock::time_point renderEnd;       // Set by whichever thread renders the last tile
+    double mainThreadMs = 0.0;                // Time spent rendering on the main thread
+    std::vector<uint8_t> tileBuffer;
+
+    // What each tile last rendered, by its place in the grid, kept between renders
+    int gridTileW = 0;
+    int gridTileH = 0;
+    int gridColumns = 0;
+    std::vector<RayBounds> tileBounds; // Where each tile's rays went, other than camera rays
+    std::vector<int> tileSamples;      // The samples each tile's pixels have, 0 if its last render didn't finish
 
     void render(bool multiThreaded);
-    float mix(const float &a, const float &b, const float &mix);
-    Vec3f trace(const Vec3f &rayOrigin, const Vec3f &rayDir, const int &depth);
-    void renderSection(sf::Vector2i pixTL, sf::Vector2i pixBR);
+    void startRender(bool multiThreaded);
+    void startAccumulation();
+    void launchRender(bool multiThreaded);
+    void updateRender();
+    void cancelRender();
+    void renderTiles();
+    bool takeReadyWork(int &work);
+    bool claimWorker();
+    void startRenderWorkers();
+    void renderTile(int work);
+    void showFinishedTiles();
+    void finishRender();
+    void resolveImage();
+    void renderRealTime();
+    bool isTileDirty(int cell, const std::vector<Footprint> &footprints, const std::vector<Vec3f> &lights) const;
+    int getCell(const Range2D &tile) const;
+    double runAtThreads(int threads);
 };
 
 #endif // !RAYTRACER_H
\ No newline at end of file
@@ -0,0 +1,31 @@
+// --------------------------------------------
+// SIMD.h
+// --------------------------------------------
+// Switches for the raytracer's AVX code.
+// USE_AVX is defined when AVX code can be
+// compiled for this target: 64 bit x86, and
+// DISABLE_SIMD isn't defined. Functions that
+// use AVX are marked with AVX_FUNCTION, which
+// GCC and Clang need before they allow AVX
+// instructions in a function. This keeps the
+// rest of the program runnable on CPUs
+// without AVX. Whether the CPU can really
+// run them is checked at runtime, see
+// SphereSoA::isSIMDAvailable().
+// --------------------------------------------
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#if !defined(DISABLE_SIMD) && (defined(_M_X64) || defined(__x86_64__))
+#define USE_AVX
+#include <immintrin.h>
+#endif
+
+#if defined(USE_AVX) && defined(__GNUC__)
+#define AVX_FUNCTION __attribute__((target("avx")))
+#else
+#define AVX_FUNCTION
+#endif
+
+#endif // !SIMD_H
@@ -0,0 +1,41 @@
+// --------------------------------------------
+// ScalingPanel.h
+// ScalingPanel.cpp
+// --------------------------------------------
+// Runs a test's thread scaling sweep from its
+// Threads menu and plots the results: the
+// measured speedup against the ideal one and
+// the fitted Amdahl curve, and the parallel
+// efficiency at each thread count. The sweep
+// runs on the main thread, so the window
+// stops updating until it's finished.
+// --------------------------------------------
+
+#ifndef SCALINGPANEL_H
+#define SCALINGPANEL_H
+
+#include "imgui.h"
+#include "ThreadPool.h"
+#include "ScalingSweep.h"
+
+#include <functional>
+#include <string>
+
+class ScalingPanel
+{
+public:
+	ScalingPanel(ThreadPool &threadPool, const char *testName);
+	~ScalingPanel();
+	void handleUI(const std::function<double(int threads)> &runAtThreads);
+
+private:
+	ThreadPool *threadPool;
+	const char *testName;
+	BenchmarkSettings settings;
+	ScalingResult result;
+	std::string status;
+
+	void drawSpeedupPlot();
+};
+
+#endif // !SCALINGPANEL_H
@@ -0,0 +1,52 @@
+// --------------------------------------------
+// ScalingSweep.h
+// ScalingSweep.cpp
+// --------------------------------------------
+// Runs a workload at 1, 2, 4 ... N threads
+// and works out how well it scales. Speedup
+// is the single-threaded time divided by the
+// time at each thread count, and efficiency
+// is the speedup divided by the threads.
+// Amdahl's law is fitted to the speedups to
+// estimate the serial fraction: the share of
+// the work that doesn't run in parallel at
+// all, which caps the speedup at
+// 1 / serial fraction however many threads
+// are used.
+// --------------------------------------------
+
+#ifndef SCALINGSWEEP_H
+#define SCALINGSWEEP_H
+
+#include "Benchmark.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+struct ScalingPoint
+{
+	int threads = 1;
+	BenchmarkSummary summary;
+	double speedup = 1.0;
+	double efficiency = 1.0;
+};
+
+struct ScalingResult
+{
+	std::string workload;
+	std::vector<ScalingPoint> points;
+	double serialFraction = 0.0;
+};
+
+class ScalingSweep
+{
+public:
+	static std::vector<int> getThreadCounts(int maxThreads);
+	static ScalingResult run(const std::string &workload, const std::function<double(int threads)> &runAtThreads, const std::vector<int> &threadCounts, const BenchmarkSettings &settings);
+	static void analyse(ScalingResult &result);
+	static double getAmdahlSpeedup(double serialFraction, int threads);
+	static bool saveCsv(const std::string &path, const std::vector<ScalingResult> &results);
+};
+
+#endif // !SCALINGSWEEP_H
@@ -0,0 +1,63 @@
+// --------------------------------------------
+// SphereSoA.h
+// SphereSoA.cpp
+// --------------------------------------------
+// The raytracer's spheres stored as a
+// structure of arrays: one array each for
+// the centres' X, Y and Z, the squared radii
+// and the index of the Sphere each one came
+// from, which is where its material lives.
+// Keeping each value in its own array lets
+// one ray be tested against 8 spheres at a
+// time with AVX. On CPUs without AVX (or
+// when DISABLE_SIMD is defined, or SIMD is
+// turned off at runtime) the same tests run
+// one sphere at a time.
+// Both paths do exactly the same float maths
+// in the same order as Sphere::intersect, so
+// their results match it bit for bit. This
+// relies on the compiler not fusing
+// multiplies and adds, which is the default
+// for MSVC and for GCC without -mfma.
+// --------------------------------------------
+
+#ifndef SPHERESOA_H
+#define SPHERESOA_H
+
+#include "Vec3.h"
+
+#include <vector>
+
+struct Sphere;
+
+class SphereSoA
+{
+public:
+    void clear();
+    void resize(int amount);
+    void set(int slot, const Sphere &sphere, int sphereIndex);
+    void copy(int from, int to);
+    void setSphereIndex(int slot, int sphereIndex);
+    int getSize() const;
+    bool closestHit(int first, int count, const Vec3f &rayOrigin, const Vec3f &rayDir, float &tNear, int &hitIndex) const;
+    bool anyHit(int first, int count, const Vec3f &rayOrigin, const Vec3f &rayDir, int ignoreIndex, int &hitIndex) const;
+
+    static bool isSIMDAvailable();
+    static void setSIMDEnabled(bool enabled);
+    static bool isSIMDEnabled();
+
+private:
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> radius2;
+    std::vector<int> sphereIndices;
+    int size = 0;
+
+    bool closestHitScalar(int first, int count, const Vec3f &rayOrigin, const Vec3f &rayDir, float &tNear, int &hitIndex) const;
+    bool anyHitScalar(int first, int count, const Vec3f &rayOrigin, const Vec3f &rayDir, int ignoreIndex, int &hitIndex) const;
+    bool closestHitSIMD(int first, int count, const Vec3f &rayOrigin, const Vec3f &rayDir, float &tNear, int &hitIndex) const;
+    bool anyHitSIMD(int first, int count, const Vec3f &rayOrigin, const Vec3f &rayDir, int ignoreIndex, int &hitIndex) const;
+};
+
+#endif // !SPHERESOA_H
@@ -0,0 +1,95 @@
+// --------------------------------------------
+// TaskGraph.h
+// TaskGraph.cpp
+// --------------------------------------------
+// A set of tasks with dependencies between
+// them, run on a ThreadPool. A task is only
+// started once every task it depends on has
+// finished, and tasks that don't depend on
+// each other run at the same time. This lets
+// independent stages overlap instead of
+// having a full barrier after every stage.
+// When a task finishes it starts the tasks
+// that were waiting on it. The last one that
+// becomes ready is run straight away on the
+// same thread, the rest go to the pool.
+// A graph can be built once and run again
+// and again (for example once per frame).
+// The edges must not form a cycle.
+// --------------------------------------------
+
+#ifndef TASKGRAPH_H
+#define TASKGRAPH_H
+
+#include "ThreadPool.h"
+
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class TaskGraph
+{
+public:
+	using TaskID = std::size_t;
+
+	TaskGraph() = default;
+	TaskGraph(const TaskGraph &) = delete;
+	TaskGraph &operator=(const TaskGraph &) = delete;
+	~TaskGraph();
+
+	/// <summary>
+	/// Add a task with no dependencies yet.
+	/// </summary>
+	/// <param name="function">The work the task does.</param>
+	/// <returns>The ID of the new task.</returns>
+	template<class F>
+	TaskID addTask(F &&function)
+	{
+		auto task = std::make_unique<Task>();
+		task->function = std::forward<F>(function);
+		tasks.push_back(std::move(task));
+
+		return tasks.size() - 1;
+	}
+
+	/// <summary>
+	/// Add a task that runs once another task has finished.
+	/// </summary>
+	/// <param name="before">The task to follow on from.</param>
+	/// <param name="function">The work the new task does.</param>
+	/// <returns>The ID of the new task.</returns>
+	template<class F>
+	TaskID then(TaskID before, F &&function)
+	{
+		TaskID after = addTask(std::forward<F>(function));
+		addEdge(before, after);
+
+		return after;
+	}
+
+	void addEdge(TaskID before, TaskID after);
+	void clear();
+	std::size_t size() const;
+	void start(ThreadPool &threadPool);
+	void wait();
+	void run(ThreadPool &threadPool);
+
+private:
+	struct Task
+	{
+		std::function<void()> function;
+		std::vector<TaskID> successors;
+		int dependencies = 0;
+		std::atomic<int> remaining{ 0 };
+	};
+
+	std::vector<std::unique_ptr<Task>> tasks;
+	ThreadPool *threadPool = nullptr;
+	JobCounter jobCounter;
+
+	void submit(TaskID id);
+	void runTask(TaskID id);
+};
+
+#endif // !TASKGRAPH_H
@@ -0,0 +1,113 @@
+// --------------------------------------------
+// TerrainMap.h
+// TerrainMap.cpp
+// --------------------------------------------
+// Builds the terrain height map with Simplex
+// Noise and colours it in. This is the work
+// the Terrain Generator test times. It
+// doesn't touch the window or the GPU, so
+// the headless benchmark can run it too.
+// When multi-threaded, each stage splits
+// the map into row strips with
+// parallelFor2D. Every stage needs the one
+// before it, so they run one after another.
+// --------------------------------------------
+
+#ifndef TERRAINMAP_H
+#define TERRAINMAP_H
+
+#include "ThreadPool.h"
+#include "ParallelFor.h"
+#include "Noise.h"
+#include "Profiler.h"
+#include "PerfCounters.h"
+
+#include <SFML/System/Vector2.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct TerrainColour
+{
+	std::uint8_t r;
+	std::uint8_t g;
+	std::uint8_t b;
+};
+
+static const TerrainColour EARTH[10] =
+{
+	{ 0, 102, 255 },
+	{ 55, 125, 235 },
+	{ 0, 150, 0 },
+	{ 25, 150, 25 },
+	{ 50, 175, 50 },
+	{ 75, 175, 75 },
+	{ 100, 200, 100 },
+	{ 125, 200, 125 },
+	{ 150, 225, 150 },
+	{ 200, 255, 200 }
+};
+
+static const TerrainColour MARS[10] =
+{
+	{ 212, 50, 0 },
+	{ 212, 70, 15 },
+	{ 235, 90, 30 },
+	{ 235, 110, 50 },
+	{ 235, 130, 70 },
+	{ 235, 150, 90 },
+	{ 235, 170, 110 },
+	{ 235, 190, 130 },
+	{ 235, 210, 150 },
+	{ 235, 230, 170 }
+};
+
+static const TerrainColour MOON[10] =
+{
+	{ 50, 50, 50 },
+	{ 60, 60, 60 },
+	{ 70, 70, 70 },
+	{ 80, 80, 80 },
+	{ 90, 90, 90 },
+	{ 100, 100, 100 },
+	{ 110, 110, 110 },
+	{ 120, 120, 120 },
+	{ 130, 130, 130 },
+	{ 140, 140, 140 }
+};
+
+class TerrainMap
+{
+public:
+	TerrainMap(ThreadPool &threadPool);
+	~TerrainMap();
+	void generate(int width, int height, int seed, int terrainID, bool multiThreaded, int threadLimit);
+	const std::vector<float> &getHeightMap() const;
+	const std::vector<uint8_t> &getPixels() const;
+	void setPerfTotals(PerfCounterTotals &totals);
+
+private:
+	ThreadPool *threadPool;
+	std::unique_ptr<Noise> noise;
+	std::vector<float> heightMap;
+	std::vector<uint8_t> pixelArray;
+	int mapWidth = 0;
+	int mapHeight = 0;
+	int seed = 0;
+	int currentTerrainID = 0;
+	PerfCounterTotals ownPerfTotals;
+	PerfCounterTotals *perfTotals = &ownPerfTotals;
+	std::vector<float> stripMin;
+	std::vector<float> stripMax;
+	float heightMin = 0.0f;
+	float heightMax = 0.0f;
+
+	void runPipeline(int threadLimit);
+	void generateSection(sf::Vector2i pixTL, sf::Vector2i pixBR);
+	void findRange(sf::Vector2i pixTL, sf::Vector2i pixBR, float &min, float &max);
+	void normaliseSection(sf::Vector2i pixTL, sf::Vector2i pixBR, float min, float max);
+	void colouriseSection(sf::Vector2i pixTL, sf::Vector2i pixBR);
+};
+
+#endif // !TERRAINMAP_H
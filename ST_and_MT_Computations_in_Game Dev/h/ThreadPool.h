@@ -7,7 +7,27 @@
 // of threads available. Use the
 // constructor parameter to set the number
 // of threads manually.
-// This code is based on code I used for 
+// Each worker owns its own job queue. A
+// worker takes jobs from the back of its
+// own queue and, when that runs dry, steals
+// from the front of the other queues, so the
+// workers don't all fight over one lock.
+// Jobs that don't need a result can be added
+// with a JobCounter instead of a future,
+// which doesn't allocate any memory once the
+// queues have grown to their working size.
+// A thread that waits on a JobCounter runs
+// jobs from that same batch while it waits,
+// instead of sitting idle.
+// Every thread keeps a few cheap counters
+// (jobs run, steals, time busy, parked and
+// waiting for locks, and how deep its queue
+// has been) that can be read at any time
+// with getStats(). How deep the queues get
+// during one stretch of work is recorded
+// by a watch, so several watches can run at
+// once without resetting each other.
+// This code is based on code I used for
 // a previous college project.
 // --------------------------------------------
 
@@ -15,44 +35,115 @@
 #define THREADPOOL_H
 
 #include <condition_variable>
+#include <algorithm>
 #include <functional>
 #include <iostream>
+#include <cstdint>
 #include <future>
+#include <chrono>
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <thread>
-#include <queue>
+
+#include "Job.h"
+
+// A snapshot of one thread's counters. Times are in nanoseconds
+struct ThreadStats
+{
+	std::uint64_t jobsExecuted = 0;
+	std::uint64_t jobsStolen = 0;
+	std::uint64_t busyNs = 0;
+	std::uint64_t parkedNs = 0;
+	std::uint64_t waitNs = 0;
+	std::uint64_t lockWaitNs = 0;
+	std::uint64_t queueHighWater = 0;
+};
 
 class ThreadPool
 {
 public:
-	using Job = std::function<void()>;
-
 	explicit ThreadPool(std::size_t threadAmount = std::thread::hardware_concurrency());
 	~ThreadPool();
-	
+	std::size_t getThreadAmount() const;
+
 	template<class T>
 	auto addJob(T job)->std::future<decltype(job())>
 	{
 		auto wrapper = std::make_shared<std::packaged_task<decltype(job())()>>(std::move(job));
 
-		{
-			std::unique_lock<std::mutex> lock{ eventMutex };
-			jobs.emplace([=] { (*wrapper)(); });
-		}
+		push(Job([=] { (*wrapper)(); }));
 
-		eventVar.notify_one();
 		return wrapper->get_future();
 	}
 
+	/// <summary>
+	/// Add a job without creating a future. The counter is told when the job
+	/// has finished, so a whole batch can share one counter and be waited on
+	/// with wait(). The counter must outlive the job.
+	/// </summary>
+	/// <param name="counter">The counter that tracks this job.</param>
+	/// <param name="job">The job to run.</param>
+	template<class T>
+	void addJob(JobCounter &counter, T &&job)
+	{
+		counter.add();
+		push(Job(std::forward<T>(job), &counter));
+	}
+
+	void wait(const JobCounter &counter);
+	std::vector<ThreadStats> getStats() const;
+	int startHighWaterWatch();
+	std::vector<std::uint64_t> stopHighWaterWatch(int watch);
+
+	// The most watches that can run at once
+	static const int MAX_WATCHES = 8;
+
 private:
+	// Each on its own cache line so threads don't slow each other down
+	struct alignas(64) WorkerQueue
+	{
+		std::mutex mutex;
+		JobQueue jobs;
+		std::atomic<std::uint64_t> highWater{ 0 };
+		std::uint64_t watchHighWater[MAX_WATCHES] = {}; // Guarded by mutex
+	};
+
+	struct alignas(64) ThreadCounters
+	{
+		std::atomic<std::uint64_t> jobsExecuted{ 0 };
+		std::atomic<std::uint64_t> jobsStolen{ 0 };
+		std::atomic<std::uint64_t> busyNs{ 0 };
+		std::atomic<std::uint64_t> parkedNs{ 0 };
+		std::atomic<std::uint64_t> waitNs{ 0 };
+		std::atomic<std::uint64_t> lockWaitNs{ 0 };
+	};
+
 	std::vector<std::thread> threads;
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
 	std::condition_variable eventVar;
 	std::mutex eventMutex;
 	bool stopping = false;
-	std::queue<Job> jobs;
+	std::atomic<std::size_t> pendingJobs{ 0 };
+	std::atomic<std::size_t> sleepingThreads{ 0 };
+	std::atomic<std::size_t> nextQueue{ 0 };
+	std::condition_variable waitVar;
+	std::mutex waitMutex;
+	std::atomic<std::size_t> waitingThreads{ 0 };
+	std::unique_ptr<ThreadCounters[]> counters;
+	std::atomic<std::uint32_t> claimedWatches{ 0 }; // One bit per watch that's in use
+	std::atomic<std::uint32_t> activeWatches{ 0 };  // One bit per watch that's recording
 
 	void start(std::size_t threadAmount);
 	void stop() noexcept;
+	void push(Job &&job);
+	bool popJob(std::size_t index, Job &job);
+	bool stealJob(std::size_t index, Job &job);
+	bool takeGroupJob(const JobCounter &group, Job &job);
+	void runJob(Job &job);
+	void runWorker(std::size_t index);
+	ThreadCounters &getCounters();
+	std::unique_lock<std::mutex> lockCounted(std::mutex &mutex);
 };
 
 #endif // !THREADPOOL_H
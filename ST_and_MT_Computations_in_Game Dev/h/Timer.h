@@ -3,6 +3,12 @@
 // --------------------------------------------
 // This is a class that can be used to measure
 // time intervals between code executions.
+// The label names what is being timed. It is
+// used by the Profiler, which builds its
+// zones from Timers. The label must be a
+// string that lives for the whole program
+// (a string literal), so starting a Timer
+// never allocates memory.
 // --------------------------------------------
 
 #ifndef TIMER_H
@@ -15,19 +21,21 @@
 class Timer
 {
 public:
-	Timer(std::string label) : label(label)
+	using Clock = std::chrono::high_resolution_clock;
+
+	Timer(const char *label) : label(label)
 	{
-		startTimepoint = std::chrono::high_resolution_clock::now();
+		startTimepoint = Clock::now();
 	}
 
 	~Timer()
 	{
-		
+
 	}
 
 	double stop()
 	{
-		auto endTimepoint = std::chrono::high_resolution_clock::now();
+		auto endTimepoint = Clock::now();
 		auto start = std::chrono::time_point_cast<std::chrono::microseconds>(startTimepoint).time_since_epoch();
 		auto end = std::chrono::time_point_cast<std::chrono::microseconds>(endTimepoint).time_since_epoch();
 		auto duration = (end - start).count();
@@ -36,9 +44,19 @@ public:
 		return ms;
 	}
 
+	const char *getLabel() const
+	{
+		return label;
+	}
+
+	Clock::time_point getStartTimepoint() const
+	{
+		return startTimepoint;
+	}
+
 private:
-	std::string label;
-	std::chrono::time_point<std::chrono::high_resolution_clock> startTimepoint;
+	const char *label;
+	Clock::time_point startTimepoint;
 };
 
-#endif // !TIMER_H
\ No newline at end of file
+#endif // !TIMER_H
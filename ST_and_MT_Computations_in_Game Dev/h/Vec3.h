@@ -116,6 +116,26 @@ public:
         return *this;
     }
 
+    /// <summary>
+    /// Equality.
+    /// </summary>
+    /// <param name="vec">Vector.</param>
+    /// <returns>Result.</returns>
+    bool operator == (const Vec3<T> &vec) const
+    {
+        return x == vec.x && y == vec.y && z == vec.z;
+    }
+
+    /// <summary>
+    /// Inequality.
+    /// </summary>
+    /// <param name="vec">Vector.</param>
+    /// <returns>Result.</returns>
+    bool operator != (const Vec3<T> &vec) const
+    {
+        return !(*this == vec);
+    }
+
     /// <summary>
     /// Negate.
     /// </summary>
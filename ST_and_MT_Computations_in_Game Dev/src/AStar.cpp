@@ -72,7 +72,7 @@ void AStar::run(sf::Vector2i start, sf::Vector2i end)
 	// Distance lambda function
 	auto distance = [](Node *a, Node *b)
 	{
-		return std::sqrtf((a->x - b->x) * (a->x - b->x) + (a->y - b->y) * (a->y - b->y));
+		return std::sqrt(static_cast<float>((a->x - b->x) * (a->x - b->x) + (a->y - b->y) * (a->y - b->y)));
 	};
 
 	// Heuristic lambda function
@@ -7,6 +7,14 @@ Application::Application() : window{ sf::VideoMode{ SCREEN_WIDTH, SCREEN_HEIGHT,
 {
 	exitApp = false;
 
+	Profiler::setThreadName("Main Thread");
+
+	// Shared by every test. The thread that waits on a batch of jobs runs
+	// jobs too, so it makes up the last thread
+	threadPool = std::make_unique<ThreadPool>(std::max(1u, std::thread::hardware_concurrency()) - 1);
+
+	buildFrameGraph();
+
 	// Initialise ImGui SFML
 	ImGui::SFML::Init(window);
 
@@ -25,6 +33,10 @@ Application::~Application()
 	if (particleEffect) { delete particleEffect; }
 	if (terrainGenerator) { delete terrainGenerator; }
 
+	// The tests are gone, so nothing can still be using the pool
+	frameGraph.clear();
+	threadPool.reset();
+
 	ImGui::SFML::Shutdown();
 }
 
@@ -82,25 +94,56 @@ void Application::processEvents()
 /// </summary>
 /// <param name="dt">Delta time.</param>
 void Application::update(const sf::Time &dt)
-{	
+{
+	PROFILE_SCOPE("Update");
+
+	frameTime = dt;
+
+	// Update anything that needs to be updated on the pool
+	frameGraph.start(*threadPool);
+
 	ImGui::SFML::Update(window, dt);
 
 	// Cover entire window with dockspace
 	ImGui::DockSpaceOverViewport(ImGui::GetMainViewport());
 
-	// Update anything that needs to be updated
-	if (pathfinding != nullptr) { pathfinding->update(dt); }
-	if (particleEffect != nullptr) { particleEffect->update(dt); }
+	// The UI reads and changes the tests, so they must be finished first
+	{
+		PROFILE_SCOPE("Wait For Frame Graph");
+		frameGraph.wait();
+	}
 
 	// Update and draw UI
 	handleUI();
 }
 
+/// <summary>
+/// Build the graph of per-frame updates.
+/// The tests don't share any data, so their updates don't depend on each
+/// other and can all run at once. Any test that isn't loaded is skipped.
+/// </summary>
+void Application::buildFrameGraph()
+{
+	frameGraph.addTask([this]
+	{
+		PROFILE_SCOPE("Pathfinding Update");
+		if (pathfinding != nullptr) { pathfinding->update(frameTime); }
+	});
+
+	frameGraph.addTask([this]
+	{
+		PROFILE_SCOPE("Particle Effect Update");
+		if (particleEffect != nullptr) { particleEffect->update(frameTime); }
+	});
+}
+
 /// <summary>
 /// Update and draw all ImGui menus.
 /// </summary>
 void Application::handleUI()
 {
+	PROFILE_SCOPE("UI");
+
 	// Select and load a test
 	ImGui::Begin("Test Inspector##001");
 
@@ -128,6 +171,56 @@ void Application::handleUI()
 
 	ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
+	// Record a trace of what every thread is doing
+	if (ImGui::CollapsingHeader("Profiler##097"))
+	{
+		ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+		ImGui::Text("Record a capture, then save it and");
+		ImGui::Text("open it in about:tracing or");
+		ImGui::Text("ui.perfetto.dev to see each thread");
+		ImGui::Text("on a timeline.");
+
+		ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+		if (!Profiler::isCapturing())
+		{
+			if (ImGui::Button("Start Capture##098"))
+			{
+				Profiler::startCapture();
+				profilerStatus.clear();
+			}
+		}
+		else
+		{
+			if (ImGui::Button("Stop Capture##099"))
+			{
+				Profiler::stopCapture();
+			}
+		}
+
+		ImGui::SameLine();
+
+		if (ImGui::Button("Save Trace##100"))
+		{
+			const char *path = "profile_trace.json";
+			profilerStatus = Profiler::saveChromeTrace(path) ? std::string("Saved to ") + path : std::string("Couldn't write ") + path;
+		}
+
+		ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+		ImGui::Text("Zones: %zu (dropped: %zu)", Profiler::getEventAmount(), Profiler::getDroppedAmount());
+
+		if (!profilerStatus.empty())
+		{
+			ImGui::Text(profilerStatus.c_str());
+		}
+
+		ImGui::Dummy(ImVec2(0.0f, 8.0f));
+	}
+
+	ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
 	if (raytracer != nullptr) {	raytracer->handleUI(); }
 	if (pathfinding != nullptr) { pathfinding->handleUI(); }
 	if (particleEffect != nullptr) { particleEffect->handleUI(); }
@@ -149,7 +242,7 @@ void Application::loadTest(TestID testID)
 		{
 			if (raytracer == nullptr)
 			{
-				raytracer = new Raytracer(1280, 720);
+				raytracer = new Raytracer(1280, 720, *threadPool);
 			}
 
 			break;
@@ -159,7 +252,7 @@ void Application::loadTest(TestID testID)
 		{
 			if (pathfinding == nullptr)
 			{
-				pathfinding = new Pathfinding();
+				pathfinding = new Pathfinding(*threadPool);
 			}
 
 			break;
@@ -169,7 +262,7 @@ void Application::loadTest(TestID testID)
 		{
 			if (particleEffect == nullptr)
 			{
-				particleEffect = new ParticleEffect(timePerFrame);
+				particleEffect = new ParticleEffect(timePerFrame, *threadPool);
 			}
 
 			break;
@@ -179,7 +272,7 @@ void Application::loadTest(TestID testID)
 		{
 			if (terrainGenerator == nullptr)
 			{
-				terrainGenerator = new TerrainGenerator();
+				terrainGenerator = new TerrainGenerator(*threadPool);
 			}
 
 			break;
@@ -192,6 +285,8 @@ void Application::loadTest(TestID testID)
 /// </summary>
 void Application::draw()
 {
+	PROFILE_SCOPE("Draw");
+
 	window.clear(sf::Color::Black);
 
 	ImGui::SFML::Render(window);
@@ -0,0 +1,1220 @@
+#include "BVH.h"
+#include "RayScene.h"
+#include "SIMD.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+    // Nodes this deep are never split, which keeps the traversal stacks below safe
+    const int MAX_DEPTH = 64;
+
+    // Traversal holds at most one node per level waiting, plus the two children just pushed
+    const int STACK_SIZE = MAX_DEPTH + 2;
+
+    // Centroids are sorted into this many bins along an axis to find a split
+    const int BIN_AMOUNT = 16;
+
+    // Testing this many spheres one by one is quicker than testing boxes
+    // around them, so nodes this small are never split
+    const int LEAF_SIZE = 8;
+
+    /// <summary>
+    /// Get one axis of a vector.
+    /// </summary>
+    /// <param name="vec">The vector.</param>
+    /// <param name="axis">0 for X, 1 for Y and 2 for Z.</param>
+    /// <returns>The value on that axis.</returns>
+    float getAxis(const Vec3f &vec, int axis)
+    {
+        return axis == 0 ? vec.x : (axis == 1 ? vec.y : vec.z);
+    }
+
+    /// <summary>
+    /// Check whether two boxes are exactly the same.
+    /// </summary>
+    /// <param name="a">The first box.</param>
+    /// <param name="b">The second box.</param>
+    /// <returns>True if they match.</returns>
+    bool sameBounds(const AABB &a, const AABB &b)
+    {
+        return a.min.x == b.min.x && a.min.y == b.min.y && a.min.z == b.min.z &&
+            a.max.x == b.max.x && a.max.y == b.max.y && a.max.z == b.max.z;
+    }
+
+    /// <summary>
+    /// Find where a ray enters a box, using the slab test.
+    /// </summary>
+    /// <param name="box">The box.</param>
+    /// <param name="rayOrigin">The origin point of the ray.</param>
+    /// <param name="invDir">1 divided by each axis of the ray's direction.</param>
+    /// <returns>The distance along the ray to the box (0 if it starts inside), or INFINITY if it misses.</returns>
+    float intersectBox(const AABB &box, const Vec3f &rayOrigin, const Vec3f &invDir)
+    {
+        float tx1 = (box.min.x - rayOrigin.x) * invDir.x;
+        float tx2 = (box.max.x - rayOrigin.x) * invDir.x;
+        float tMin = std::min(tx1, tx2);
+        float tMax = std::max(tx1, tx2);
+
+        float ty1 = (box.min.y - rayOrigin.y) * invDir.y;
+        float ty2 = (box.max.y - rayOrigin.y) * invDir.y;
+        tMin = std::max(tMin, std::min(ty1, ty2));
+        tMax = std::min(tMax, std::max(ty1, ty2));
+
+        float tz1 = (box.min.z - rayOrigin.z) * invDir.z;
+        float tz2 = (box.max.z - rayOrigin.z) * invDir.z;
+        tMin = std::max(tMin, std::min(tz1, tz2));
+        tMax = std::min(tMax, std::max(tz1, tz2));
+
+        if (tMax < 0.0f || tMin > tMax)
+        {
+            return INFINITY;
+        }
+
+        return std::max(tMin, 0.0f);
+    }
+
+    /// <summary>
+    /// Check whether a box is entirely outside a packet's frustum, so none of its rays can hit it.
+    /// </summary>
+    /// <param name="box">The box.</param>
+    /// <param name="packet">The packet, which must have a frustum.</param>
+    /// <returns>True if the box can be skipped.</returns>
+    bool outsideFrustum(const AABB &box, const RayPacket &packet)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            const Vec3f &normal = packet.frustumNormals[i];
+
+            // The corner of the box furthest into the frustum
+            Vec3f corner(normal.x > 0 ? box.max.x : box.min.x, normal.y > 0 ? box.max.y : box.min.y, normal.z > 0 ? box.max.z : box.min.z);
+            Vec3f offset = corner - packet.frustumOrigin;
+            float distance = normal.dot(offset);
+
+            // Rays along the frustum's edges can round either way, so only skip boxes clearly outside it
+            float tolerance = 1e-4f * (std::abs(normal.x * offset.x) + std::abs(normal.y * offset.y) + std::abs(normal.z * offset.z));
+
+            if (distance < -tolerance)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /// <summary>
+    /// Find which rays in a packet enter a box closer than their closest hit so far,
+    /// one ray at a time.
+    /// </summary>
+    /// <param name="box">The box.</param>
+    /// <param name="packet">The packet.</param>
+    /// <param name="mask">The rays to test.</param>
+    /// <param name="tNear">Each ray's closest hit so far, or nullptr to count any hit.</param>
+    /// <returns>The rays in mask that enter the box in time.</returns>
+    std::uint64_t intersectPacketScalar(const AABB &box, const RayPacket &packet, std::uint64_t mask, const float *tNear)
+    {
+        std::uint64_t result = 0;
+
+        for (int i = 0; i < packet.amount; ++i)
+        {
+            std::uint64_t bit = std::uint64_t(1) << i;
+
+            if ((mask & bit) == 0)
+            {
+                continue;
+            }
+
+            Vec3f rayOrigin(packet.originX[i], packet.originY[i], packet.originZ[i]);
+            Vec3f invDir(packet.invDirX[i], packet.invDirY[i], packet.invDirZ[i]);
+
+            if (intersectBox(box, rayOrigin, invDir) < (tNear ? tNear[i] : INFINITY))
+            {
+                result |= bit;
+            }
+        }
+
+        return result;
+    }
+
+#ifdef USE_AVX
+    /// <summary>
+    /// Find which rays in a packet enter a box closer than their closest hit so far,
+    /// 8 rays at a time with AVX. The maths matches intersectBox exactly, NaNs included:
+    /// std::min(a, b) is _mm256_min_ps(b, a) and std::max(a, b) is _mm256_max_ps(b, a).
+    /// </summary>
+    /// <param name="box">The box.</param>
+    /// <param name="packet">The packet.</param>
+    /// <param name="mask">The rays to test.</param>
+    /// <param name="tNear">Each ray's closest hit so far, or nullptr to count any hit.</param>
+    /// <returns>The rays in mask that enter the box in time.</returns>
+    AVX_FUNCTION std::uint64_t intersectPacketSIMD(const AABB &box, const RayPacket &packet, std::uint64_t mask, const float *tNear)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 infinity = _mm256_set1_ps(INFINITY);
+        const __m256 minX = _mm256_set1_ps(box.min.x);
+        const __m256 minY = _mm256_set1_ps(box.min.y);
+        const __m256 minZ = _mm256_set1_ps(box.min.z);
+        const __m256 maxX = _mm256_set1_ps(box.max.x);
+        const __m256 maxY = _mm256_set1_ps(box.max.y);
+        const __m256 maxZ = _mm256_set1_ps(box.max.z);
+        std::uint64_t result = 0;
+
+        for (int i = 0; i < packet.amount; i += 8)
+        {
+            // Skip groups of 8 with no rays left to test
+            if (((mask >> i) & 0xFF) == 0)
+            {
+                continue;
+            }
+
+            __m256 originX = _mm256_load_ps(packet.originX + i);
+            __m256 originY = _mm256_load_ps(packet.originY + i);
+            __m256 originZ = _mm256_load_ps(packet.originZ + i);
+            __m256 invDirX = _mm256_load_ps(packet.invDirX + i);
+            __m256 invDirY = _mm256_load_ps(packet.invDirY + i);
+            __m256 invDirZ = _mm256_load_ps(packet.invDirZ + i);
+
+            __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(minX, originX), invDirX);
+            __m256 tx2 = _mm256_mul_ps(_mm256_sub_ps(maxX, originX), invDirX);
+            __m256 tMin = _mm256_min_ps(tx2, tx1);
+            __m256 tMax = _mm256_max_ps(tx2, tx1);
+
+            __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(minY, originY), invDirY);
+            __m256 ty2 = _mm256_mul_ps(_mm256_sub_ps(maxY, originY), invDirY);
+            tMin = _mm256_max_ps(_mm256_min_ps(ty2, ty1), tMin);
+            tMax = _mm256_min_ps(_mm256_max_ps(ty2, ty1), tMax);
+
+            __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(minZ, originZ), invDirZ);
+            __m256 tz2 = _mm256_mul_ps(_mm256_sub_ps(maxZ, originZ), invDirZ);
+            tMin = _mm256_max_ps(_mm256_min_ps(tz2, tz1), tMin);
+            tMax = _mm256_min_ps(_mm256_max_ps(tz2, tz1), tMax);
+
+            __m256 miss = _mm256_or_ps(_mm256_cmp_ps(tMax, zero, _CMP_LT_OQ), _mm256_cmp_ps(tMin, tMax, _CMP_GT_OQ));
+            __m256 entry = _mm256_max_ps(zero, tMin);
+            __m256 limit = tNear ? _mm256_loadu_ps(tNear + i) : infinity;
+            __m256 hit = _mm256_andnot_ps(miss, _mm256_cmp_ps(entry, limit, _CMP_LT_OQ));
+
+            result |= static_cast<std::uint64_t>(_mm256_movemask_ps(hit)) << i;
+        }
+
+        return result & mask;
+    }
+#endif
+
+    /// <summary>
+    /// Find which rays in a packet enter a box closer than their closest hit so far.
+    /// </summary>
+    /// <param name="box">The box.</param>
+    /// <param name="packet">The packet.</param>
+    /// <param name="mask">The rays to test.</param>
+    /// <param name="tNear">Each ray's closest hit so far, or nullptr to count any hit.</param>
+    /// <returns>The rays in mask that enter the box in time.</returns>
+    std::uint64_t intersectPacket(const AABB &box, const RayPacket &packet, std::uint64_t mask, const float *tNear)
+    {
+        if (packet.hasFrustum && outsideFrustum(box, packet))
+        {
+            return 0;
+        }
+
+#ifdef USE_AVX
+        if (SphereSoA::isSIMDEnabled())
+        {
+            return intersectPacketSIMD(box, packet, mask, tNear);
+        }
+#endif
+
+        return intersectPacketScalar(box, packet, mask, tNear);
+    }
+}
+
+/// <summary>
+/// Grow the box to fit a point.
+/// </summary>
+/// <param name="point">The point.</param>
+void AABB::grow(const Vec3f &point)
+{
+    min = Vec3f(std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z));
+    max = Vec3f(std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z));
+}
+
+/// <summary>
+/// Grow the box to fit another box.
+/// </summary>
+/// <param name="box">The other box.</param>
+void AABB::grow(const AABB &box)
+{
+    if (box.min.x <= box.max.x)
+    {
+        grow(box.min);
+        grow(box.max);
+    }
+}
+
+/// <summary>
+/// Get half of the box's surface area, which is all the SAH needs.
+/// </summary>
+/// <returns>Half the surface area, or 0 for an empty box.</returns>
+float AABB::area() const
+{
+    if (min.x > max.x)
+    {
+        return 0.0f;
+    }
+
+    Vec3f extent = max - min;
+
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+/// <summary>
+/// Build the BVH from scratch.
+/// </summary>
+/// <param name="spheres">The spheres. Queries must be given the same spheres.</param>
+void BVH::build(const std::vector<Sphere> &spheres)
+{
+    int sphereAmount = static_cast<int>(spheres.size());
+
+    nodes.clear();
+    parents.clear();
+    heights.clear();
+    freeNodes.clear();
+    indices.resize(sphereAmount);
+    sphereBounds.resize(sphereAmount);
+    centroids.resize(sphereAmount);
+    sphereLeaves.resize(sphereAmount);
+
+    if (sphereAmount == 0)
+    {
+        leafSpheres.clear();
+        return;
+    }
+
+    std::iota(indices.begin(), indices.end(), 0);
+
+    for (int i = 0; i < sphereAmount; ++i)
+    {
+        setSphereBounds(spheres, i);
+    }
+
+    // A binary tree with one sphere per leaf has 2n - 1 nodes, which is
+    // the most there can be. Reserving them all keeps node references valid
+    nodes.reserve(sphereAmount * 2 - 1);
+    parents.reserve(sphereAmount * 2 - 1);
+    heights.reserve(sphereAmount * 2 - 1);
+    nodes.emplace_back();
+    parents.push_back(-1);
+    heights.push_back(1);
+    nodes[0].leftOrFirst = 0;
+    nodes[0].count = sphereAmount;
+
+    updateBounds(0);
+    subdivide(0, 1);
+
+    // Copy the spheres out in leaf order, so each leaf's spheres sit together
+    leafSpheres.resize(sphereAmount);
+
+    for (int i = 0; i < sphereAmount; ++i)
+    {
+        leafSpheres.set(i, spheres[indices[i]], indices[i]);
+    }
+}
+
+/// <summary>
+/// Fit a leaf's box around its spheres.
+/// </summary>
+/// <param name="nodeIndex">The leaf.</param>
+void BVH::updateBounds(int nodeIndex)
+{
+    BVHNode &node = nodes[nodeIndex];
+    node.bounds = AABB();
+
+    for (int i = 0; i < node.count; ++i)
+    {
+        node.bounds.grow(sphereBounds[indices[node.leftOrFirst + i]]);
+    }
+}
+
+/// <summary>
+/// Find the cheapest split of a node by the SAH. Each axis is split into bins
+/// across the spread of the spheres' centres and only the bin edges are tried.
+/// </summary>
+/// <param name="node">The node to split.</param>
+/// <param name="bestAxis">The axis to split on.</param>
+/// <param name="bestPosition">Where to split along the axis.</param>
+/// <returns>The cost of the split, or INFINITY if the spheres can't be split.</returns>
+float BVH::findBestSplit(const BVHNode &node, int &bestAxis, float &bestPosition) const
+{
+    float bestCost = INFINITY;
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float boundsMin = INFINITY;
+        float boundsMax = -INFINITY;
+
+        for (int i = 0; i < node.count; ++i)
+        {
+            float centroid = getAxis(centroids[indices[node.leftOrFirst + i]], axis);
+            boundsMin = std::min(boundsMin, centroid);
+            boundsMax = std::max(boundsMax, centroid);
+        }
+
+        if (boundsMin == boundsMax)
+        {
+            continue;
+        }
+
+        AABB binBounds[BIN_AMOUNT];
+        int binCounts[BIN_AMOUNT] = {};
+        float scale = BIN_AMOUNT / (boundsMax - boundsMin);
+
+        for (int i = 0; i < node.count; ++i)
+        {
+            int sphereIndex = indices[node.leftOrFirst + i];
+            int bin = std::min(BIN_AMOUNT - 1, static_cast<int>((getAxis(centroids[sphereIndex], axis) - boundsMin) * scale));
+
+            binCounts[bin]++;
+            binBounds[bin].grow(sphereBounds[sphereIndex]);
+        }
+
+        // Sweep from both ends so every split's cost comes from one pass
+        float leftAreas[BIN_AMOUNT - 1];
+        float rightAreas[BIN_AMOUNT - 1];
+        int leftCounts[BIN_AMOUNT - 1];
+        int rightCounts[BIN_AMOUNT - 1];
+        AABB leftBox;
+        AABB rightBox;
+        int leftSum = 0;
+        int rightSum = 0;
+
+        for (int i = 0; i < BIN_AMOUNT - 1; ++i)
+        {
+            leftSum += binCounts[i];
+            leftBox.grow(binBounds[i]);
+            leftCounts[i] = leftSum;
+            leftAreas[i] = leftBox.area();
+
+            rightSum += binCounts[BIN_AMOUNT - 1 - i];
+            rightBox.grow(binBounds[BIN_AMOUNT - 1 - i]);
+            rightCounts[BIN_AMOUNT - 2 - i] = rightSum;
+            rightAreas[BIN_AMOUNT - 2 - i] = rightBox.area();
+        }
+
+        for (int i = 0; i < BIN_AMOUNT - 1; ++i)
+        {
+            if (leftCounts[i] == 0 || rightCounts[i] == 0)
+            {
+                continue;
+            }
+
+            float cost = leftCounts[i] * leftAreas[i] + rightCounts[i] * rightAreas[i];
+
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestPosition = boundsMin + (i + 1) / scale;
+            }
+        }
+    }
+
+    return bestCost;
+}
+
+/// <summary>
+/// Split a node in two if that makes it cheaper to trace, then do the same to its children.
+/// </summary>
+/// <param name="nodeIndex">The node to split.</param>
+/// <param name="level">How deep the node is, 1 for the root.</param>
+void BVH::subdivide(int nodeIndex, int level)
+{
+    BVHNode &node = nodes[nodeIndex];
+
+    // Assume this stays a leaf. If it's split, its children take the spheres over
+    for (int i = 0; i < node.count; ++i)
+    {
+        sphereLeaves[indices[node.leftOrFirst + i]] = nodeIndex;
+    }
+
+    if (node.count <= LEAF_SIZE || level >= MAX_DEPTH)
+    {
+        return;
+    }
+
+    int axis = 0;
+    float position = 0.0f;
+    float splitCost = findBestSplit(node, axis, position);
+
+    // Testing every sphere in the leaf is cheaper than any split
+    if (splitCost >= node.count * node.bounds.area())
+    {
+        return;
+    }
+
+    // Partition the node's spheres in place around the split
+    int i = node.leftOrFirst;
+    int j = i + node.count - 1;
+
+    while (i <= j)
+    {
+        if (getAxis(centroids[indices[i]], axis) < position)
+        {
+            i++;
+        }
+        else
+        {
+            std::swap(indices[i], indices[j--]);
+        }
+    }
+
+    int leftCount = i - node.leftOrFirst;
+
+    if (leftCount == 0 || leftCount == node.count)
+    {
+        return;
+    }
+
+    int leftIndex = static_cast<int>(nodes.size());
+
+    nodes.emplace_back();
+    nodes.emplace_back();
+    parents.push_back(nodeIndex);
+    parents.push_back(nodeIndex);
+    heights.push_back(1);
+    heights.push_back(1);
+
+    nodes[leftIndex].leftOrFirst = node.leftOrFirst;
+    nodes[leftIndex].count = leftCount;
+    nodes[leftIndex + 1].leftOrFirst = i;
+    nodes[leftIndex + 1].count = node.count - leftCount;
+
+    node.leftOrFirst = leftIndex;
+    node.count = 0;
+
+    updateBounds(leftIndex);
+    updateBounds(leftIndex + 1);
+
+    subdivide(leftIndex, level + 1);
+    subdivide(leftIndex + 1, level + 1);
+
+    heights[nodeIndex] = 1 + std::max(heights[leftIndex], heights[leftIndex + 1]);
+}
+
+/// <summary>
+/// Update the BVH after a sphere has moved or changed size. Only the boxes
+/// above the sphere's leaf are refitted, the tree's shape stays the same,
+/// so this is quick but the tree gets worse if the sphere moves a long way.
+/// </summary>
+/// <param name="spheres">The spheres the BVH was built from.</param>
+/// <param name="sphereIndex">The sphere that changed.</param>
+void BVH::refit(const std::vector<Sphere> &spheres, int sphereIndex)
+{
+    const BVHNode &leaf = nodes[sphereLeaves[sphereIndex]];
+
+    for (int i = leaf.leftOrFirst; i < leaf.leftOrFirst + leaf.count; ++i)
+    {
+        if (indices[i] == sphereIndex)
+        {
+            leafSpheres.set(i, spheres[sphereIndex], sphereIndex);
+            break;
+        }
+    }
+
+    setSphereBounds(spheres, sphereIndex);
+    refitUpwards(sphereLeaves[sphereIndex]);
+}
+
+/// <summary>
+/// Add a sphere to the BVH without rebuilding it. The sphere either joins
+/// a leaf with room for it or is paired with an existing node under a new
+/// parent, wherever that adds the least to the SAH cost.
+/// </summary>
+/// <param name="spheres">The spheres the BVH was built from, with the new one added to the end.</param>
+/// <param name="sphereIndex">The new sphere.</param>
+void BVH::insert(const std::vector<Sphere> &spheres, int sphereIndex)
+{
+    sphereBounds.resize(spheres.size());
+    centroids.resize(spheres.size());
+    sphereLeaves.resize(spheres.size());
+
+    setSphereBounds(spheres, sphereIndex);
+
+    const AABB &box = sphereBounds[sphereIndex];
+
+    if (nodes.empty())
+    {
+        nodes.emplace_back();
+        parents.push_back(-1);
+        heights.push_back(1);
+        nodes[0].leftOrFirst = static_cast<int>(indices.size());
+        nodes[0].count = 1;
+        nodes[0].bounds = box;
+        appendSphere(spheres, sphereIndex);
+        sphereLeaves[sphereIndex] = 0;
+
+        return;
+    }
+
+    // Walk down to where the new sphere costs the least by the SAH. At each
+    // node it can either pair up with the whole node under a new parent, or
+    // go further down. Every box above it grows either way, which is the
+    // cost carried down to the children
+    int nodeIndex = 0;
+    float inheritedCost = 0.0f;
+
+    while (nodes[nodeIndex].count == 0)
+    {
+        const BVHNode &node = nodes[nodeIndex];
+        AABB combined = node.bounds;
+
+        combined.grow(box);
+
+        float pairCost = combined.area() + inheritedCost;
+        float childInheritedCost = inheritedCost + combined.area() - node.bounds.area();
+        float childCosts[2];
+
+        for (int i = 0; i < 2; ++i)
+        {
+            const BVHNode &child = nodes[node.leftOrFirst + i];
+            AABB grown = child.bounds;
+
+            grown.grow(box);
+
+            // A leaf with room takes the sphere in, otherwise it pairs up with it
+            childCosts[i] = (child.count > 0 && child.count < LEAF_SIZE ? grown.area() - child.bounds.area() : grown.area()) + childInheritedCost;
+        }
+
+        if (pairCost < childCosts[0] && pairCost < childCosts[1])
+        {
+            break;
+        }
+
+        nodeIndex = node.leftOrFirst + (childCosts[1] < childCosts[0] ? 1 : 0);
+        inheritedCost = childInheritedCost;
+    }
+
+    if (nodes[nodeIndex].count > 0 && nodes[nodeIndex].count < LEAF_SIZE)
+    {
+        BVHNode &leaf = nodes[nodeIndex];
+
+        // A leaf's spheres must be next to each other, so unless the leaf
+        // is already at the end, copy its spheres there to make room.
+        // The old copy is left unused until the next build
+        if (leaf.leftOrFirst + leaf.count != static_cast<int>(indices.size()))
+        {
+            int first = static_cast<int>(indices.size());
+
+            for (int i = 0; i < leaf.count; ++i)
+            {
+                appendSlot(leaf.leftOrFirst + i);
+            }
+
+            leaf.leftOrFirst = first;
+        }
+
+        appendSphere(spheres, sphereIndex);
+        leaf.count++;
+        sphereLeaves[sphereIndex] = nodeIndex;
+    }
+    else
+    {
+        // The node moves down to be the left child under a new parent,
+        // and the new sphere gets a leaf of its own on the right
+        int leftIndex = allocateNodePair();
+
+        nodes[leftIndex] = nodes[nodeIndex];
+        parents[leftIndex] = nodeIndex;
+        heights[leftIndex] = heights[nodeIndex];
+        setParent(leftIndex);
+
+        nodes[leftIndex + 1].leftOrFirst = static_cast<int>(indices.size());
+        nodes[leftIndex + 1].count = 1;
+        nodes[leftIndex + 1].bounds = box;
+        parents[leftIndex + 1] = nodeIndex;
+        heights[leftIndex + 1] = 1;
+        appendSphere(spheres, sphereIndex);
+        sphereLeaves[sphereIndex] = leftIndex + 1;
+
+        nodes[nodeIndex].leftOrFirst = leftIndex;
+        nodes[nodeIndex].count = 0;
+    }
+
+    refitUpwards(nodeIndex);
+
+    // Pairing moves a whole branch down a level. In the rare case that
+    // takes the tree past the depth the traversal can handle, start again
+    if (heights[0] > MAX_DEPTH)
+    {
+        build(spheres);
+    }
+}
+
+/// <summary>
+/// Take a sphere out of the BVH without rebuilding it. This matches removing
+/// a sphere by moving the last sphere into its place, so the last sphere's
+/// index changes to this one. Remove the sphere from the BVH before the vector.
+/// If its leaf ends up empty, the leaf's sibling takes their parent's place.
+/// </summary>
+/// <param name="sphereIndex">The sphere to remove.</param>
+void BVH::remove(int sphereIndex)
+{
+    int leafIndex = sphereLeaves[sphereIndex];
+    BVHNode &leaf = nodes[leafIndex];
+    int last = leaf.leftOrFirst + leaf.count - 1;
+
+    for (int i = leaf.leftOrFirst; i <= last; ++i)
+    {
+        if (indices[i] == sphereIndex)
+        {
+            indices[i] = indices[last];
+            leafSpheres.copy(last, i);
+            break;
+        }
+    }
+
+    leaf.count--;
+
+    if (leaf.count > 0)
+    {
+        refitUpwards(leafIndex);
+    }
+    else if (leafIndex == 0)
+    {
+        // That was the only sphere left
+        nodes.clear();
+        parents.clear();
+        heights.clear();
+        freeNodes.clear();
+        indices.clear();
+        leafSpheres.clear();
+    }
+    else
+    {
+        int parentIndex = parents[leafIndex];
+        int leftIndex = nodes[parentIndex].leftOrFirst;
+        int siblingIndex = leafIndex == leftIndex ? leftIndex + 1 : leftIndex;
+
+        // Move the sibling up into the parent's place
+        nodes[parentIndex] = nodes[siblingIndex];
+        heights[parentIndex] = heights[siblingIndex];
+        setParent(parentIndex);
+
+        freeNodes.push_back(leftIndex);
+
+        if (parents[parentIndex] >= 0)
+        {
+            refitUpwards(parents[parentIndex]);
+        }
+    }
+
+    // Move the last sphere into the removed sphere's place
+    int lastSphere = static_cast<int>(sphereBounds.size()) - 1;
+
+    if (sphereIndex != lastSphere)
+    {
+        const BVHNode &lastLeaf = nodes[sphereLeaves[lastSphere]];
+
+        for (int i = 0; i < lastLeaf.count; ++i)
+        {
+            if (indices[lastLeaf.leftOrFirst + i] == lastSphere)
+            {
+                indices[lastLeaf.leftOrFirst + i] = sphereIndex;
+                leafSpheres.setSphereIndex(lastLeaf.leftOrFirst + i, sphereIndex);
+                break;
+            }
+        }
+
+        sphereBounds[sphereIndex] = sphereBounds[lastSphere];
+        centroids[sphereIndex] = centroids[lastSphere];
+        sphereLeaves[sphereIndex] = sphereLeaves[lastSphere];
+    }
+
+    sphereBounds.pop_back();
+    centroids.pop_back();
+    sphereLeaves.pop_back();
+}
+
+/// <summary>
+/// Work out a sphere's box and centre.
+/// </summary>
+/// <param name="spheres">The spheres.</param>
+/// <param name="sphereIndex">The sphere.</param>
+void BVH::setSphereBounds(const std::vector<Sphere> &spheres, int sphereIndex)
+{
+    const Sphere &sphere = spheres[sphereIndex];
+    Vec3f radius(sphere.radius);
+
+    sphereBounds[sphereIndex] = AABB();
+    sphereBounds[sphereIndex].grow(sphere.center - radius);
+    sphereBounds[sphereIndex].grow(sphere.center + radius);
+    centroids[sphereIndex] = sphere.center;
+}
+
+/// <summary>
+/// Refit a node's box and height, then its parent's and so on up to the root,
+/// rebalancing each node on the way. This stops early once a node comes out
+/// the same as it was.
+/// </summary>
+/// <param name="nodeIndex">The first node to refit.</param>
+void BVH::refitUpwards(int nodeIndex)
+{
+    while (nodeIndex >= 0)
+    {
+        AABB oldBounds = nodes[nodeIndex].bounds;
+        int oldHeight = heights[nodeIndex];
+
+        if (nodes[nodeIndex].count == 0)
+        {
+            rotate(nodeIndex);
+        }
+
+        updateNode(nodeIndex);
+
+        if (sameBounds(oldBounds, nodes[nodeIndex].bounds) && oldHeight == heights[nodeIndex])
+        {
+            return;
+        }
+
+        nodeIndex = parents[nodeIndex];
+    }
+}
+
+/// <summary>
+/// Work out a node's box and height from its spheres or its children.
+/// </summary>
+/// <param name="nodeIndex">The node.</param>
+void BVH::updateNode(int nodeIndex)
+{
+    BVHNode &node = nodes[nodeIndex];
+
+    if (node.count > 0)
+    {
+        updateBounds(nodeIndex);
+        heights[nodeIndex] = 1;
+    }
+    else
+    {
+        node.bounds = nodes[node.leftOrFirst].bounds;
+        node.bounds.grow(nodes[node.leftOrFirst + 1].bounds);
+        heights[nodeIndex] = 1 + std::max(heights[node.leftOrFirst], heights[node.leftOrFirst + 1]);
+    }
+}
+
+/// <summary>
+/// Keep inserts from building long chains. If one child is more than a level
+/// taller than the other, the shorter child swaps places with the taller
+/// child's own taller child, which moves that branch up a level.
+/// </summary>
+/// <param name="nodeIndex">The node to rebalance. It must not be a leaf.</param>
+void BVH::rotate(int nodeIndex)
+{
+    int left = nodes[nodeIndex].leftOrFirst;
+    int right = left + 1;
+    int balance = heights[right] - heights[left];
+
+    if (balance >= -1 && balance <= 1)
+    {
+        return;
+    }
+
+    int tallChild = balance > 0 ? right : left;
+    int shortChild = balance > 0 ? left : right;
+    int grandchild = nodes[tallChild].leftOrFirst;
+
+    if (heights[grandchild + 1] > heights[grandchild])
+    {
+        grandchild++;
+    }
+
+    swapNodes(shortChild, grandchild);
+    updateNode(tallChild);
+}
+
+/// <summary>
+/// Swap two nodes, along with everything below them.
+/// </summary>
+/// <param name="a">The first node.</param>
+/// <param name="b">The second node.</param>
+void BVH::swapNodes(int a, int b)
+{
+    std::swap(nodes[a], nodes[b]);
+    std::swap(heights[a], heights[b]);
+    setParent(a);
+    setParent(b);
+}
+
+/// <summary>
+/// Add a sphere to the end of the leaf order.
+/// </summary>
+/// <param name="spheres">The spheres.</param>
+/// <param name="sphereIndex">The sphere.</param>
+void BVH::appendSphere(const std::vector<Sphere> &spheres, int sphereIndex)
+{
+    indices.push_back(sphereIndex);
+    leafSpheres.resize(static_cast<int>(indices.size()));
+    leafSpheres.set(leafSpheres.getSize() - 1, spheres[sphereIndex], sphereIndex);
+}
+
+/// <summary>
+/// Copy a slot in the leaf order to the end.
+/// </summary>
+/// <param name="slot">The slot to copy.</param>
+void BVH::appendSlot(int slot)
+{
+    indices.push_back(indices[slot]);
+    leafSpheres.resize(static_cast<int>(indices.size()));
+    leafSpheres.copy(slot, leafSpheres.getSize() - 1);
+}
+
+/// <summary>
+/// Point whatever is below a node back at it, after the node has moved.
+/// </summary>
+/// <param name="nodeIndex">The node's new index.</param>
+void BVH::setParent(int nodeIndex)
+{
+    const BVHNode &node = nodes[nodeIndex];
+
+    if (node.count > 0)
+    {
+        for (int i = 0; i < node.count; ++i)
+        {
+            sphereLeaves[indices[node.leftOrFirst + i]] = nodeIndex;
+        }
+    }
+    else
+    {
+        parents[node.leftOrFirst] = nodeIndex;
+        parents[node.leftOrFirst + 1] = nodeIndex;
+    }
+}
+
+/// <summary>
+/// Get two nodes next to each other, for a new pair of children.
+/// Pairs freed by remove() are used first.
+/// </summary>
+/// <returns>The index of the first node.</returns>
+int BVH::allocateNodePair()
+{
+    if (!freeNodes.empty())
+    {
+        int nodeIndex = freeNodes.back();
+        freeNodes.pop_back();
+
+        return nodeIndex;
+    }
+
+    int nodeIndex = static_cast<int>(nodes.size());
+
+    nodes.emplace_back();
+    nodes.emplace_back();
+    parents.push_back(-1);
+    parents.push_back(-1);
+    heights.push_back(1);
+    heights.push_back(1);
+
+    return nodeIndex;
+}
+
+/// <summary>
+/// Find the closest sphere a ray hits. Children are visited nearest first,
+/// and anything further away than the closest hit so far is skipped.
+/// </summary>
+/// <param name="rayOrigin">The origin point of the ray.</param>
+/// <param name="rayDir">The direction of the ray.</param>
+/// <param name="tNear">The distance to the closest hit. Only hits closer than its starting value count.</param>
+/// <param name="hitIndex">The index of the sphere that was hit.</param>
+/// <returns>True if a sphere was hit.</returns>
+bool BVH::closestHit(const Vec3f &rayOrigin, const Vec3f &rayDir, float &tNear, int &hitIndex) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    // A small scene is a single leaf, which is quicker to test without its box
+    if (nodes[0].count > 0)
+    {
+        return leafSpheres.closestHit(0, nodes[0].count, rayOrigin, rayDir, tNear, hitIndex);
+    }
+
+    Vec3f invDir(1.0f / rayDir.x, 1.0f / rayDir.y, 1.0f / rayDir.z);
+
+    if (intersectBox(nodes[0].bounds, rayOrigin, invDir) >= tNear)
+    {
+        return false;
+    }
+
+    int stack[STACK_SIZE];
+    int stackSize = 0;
+    int nodeIndex = 0;
+    bool hit = false;
+
+    while (true)
+    {
+        const BVHNode &node = nodes[nodeIndex];
+
+        if (node.count > 0)
+        {
+            hit |= leafSpheres.closestHit(node.leftOrFirst, node.count, rayOrigin, rayDir, tNear, hitIndex);
+        }
+        else
+        {
+            int nearChild = node.leftOrFirst;
+            int farChild = node.leftOrFirst + 1;
+            float nearDistance = intersectBox(nodes[nearChild].bounds, rayOrigin, invDir);
+            float farDistance = intersectBox(nodes[farChild].bounds, rayOrigin, invDir);
+
+            if (farDistance < nearDistance)
+            {
+                std::swap(nearChild, farChild);
+                std::swap(nearDistance, farDistance);
+            }
+
+            if (nearDistance < tNear)
+            {
+                if (farDistance < tNear)
+                {
+                    stack[stackSize++] = farChild;
+                }
+
+                nodeIndex = nearChild;
+                continue;
+            }
+        }
+
+        // Pop the next node that could still hold a closer hit
+        bool found = false;
+
+        while (stackSize > 0 && !found)
+        {
+            nodeIndex = stack[--stackSize];
+            found = intersectBox(nodes[nodeIndex].bounds, rayOrigin, invDir) < tNear;
+        }
+
+        if (!found)
+        {
+            return hit;
+        }
+    }
+}
+
+/// <summary>
+/// Check whether a ray hits any sphere at all, stopping at the first one found.
+/// This is for shadow rays, where it doesn't matter which sphere is in the way.
+/// Like Sphere::intersect, a sphere counts wherever it is along the ray.
+/// </summary>
+/// <param name="rayOrigin">The origin point of the ray.</param>
+/// <param name="rayDir">The direction of the ray.</param>
+/// <param name="ignoreIndex">A sphere to leave out, such as the light itself, or -1.</param>
+/// <param name="hitIndex">Set to the index of the sphere found, left alone if there wasn't one.</param>
+/// <returns>True if a sphere was hit.</returns>
+bool BVH::anyHit(const Vec3f &rayOrigin, const Vec3f &rayDir, int ignoreIndex, int &hitIndex) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    Vec3f invDir(1.0f / rayDir.x, 1.0f / rayDir.y, 1.0f / rayDir.z);
+
+    int stack[STACK_SIZE];
+    int stackSize = 0;
+
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const BVHNode &node = nodes[stack[--stackSize]];
+
+        if (intersectBox(node.bounds, rayOrigin, invDir) == INFINITY)
+        {
+            continue;
+        }
+
+        if (node.count > 0)
+        {
+            if (leafSpheres.anyHit(node.leftOrFirst, node.count, rayOrigin, rayDir, ignoreIndex, hitIndex))
+            {
+                return true;
+            }
+        }
+        else
+        {
+            stack[stackSize++] = node.leftOrFirst + 1;
+            stack[stackSize++] = node.leftOrFirst;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Find the closest sphere each ray in a packet hits. Each node is tested
+/// against all the rays that could still reach it at once, and is skipped as
+/// soon as none can. The results are exactly the same as calling closestHit()
+/// for each ray.
+/// </summary>
+/// <param name="packet">The rays. Only active rays are traced.</param>
+/// <param name="tNear">The distance to each ray's closest hit. Only hits closer than its starting value count.</param>
+/// <param name="hitIndex">The index of the sphere each ray hit, left alone for rays that hit nothing.</param>
+void BVH::closestHitPacket(const RayPacket &packet, float *tNear, int *hitIndex) const
+{
+    if (nodes.empty() || packet.active == 0)
+    {
+        return;
+    }
+
+    // Like closestHit(), a single leaf is tested without its box
+    if (nodes[0].count > 0)
+    {
+        for (int i = 0; i < packet.amount; ++i)
+        {
+            if (packet.active & (std::uint64_t(1) << i))
+            {
+                leafSpheres.closestHit(0, nodes[0].count, packet.getOrigin(i), packet.getDir(i), tNear[i], hitIndex[i]);
+            }
+        }
+
+        return;
+    }
+
+    int stack[STACK_SIZE];
+    std::uint64_t stackMasks[STACK_SIZE]; // The rays that reached each node's parent
+    int stackSize = 0;
+
+    stack[stackSize] = 0;
+    stackMasks[stackSize++] = packet.active;
+
+    while (stackSize > 0)
+    {
+        --stackSize;
+
+        const BVHNode &node = nodes[stack[stackSize]];
+        std::uint64_t mask = intersectPacket(node.bounds, packet, stackMasks[stackSize], tNear);
+
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        if (node.count > 0)
+        {
+            for (int i = 0; i < packet.amount; ++i)
+            {
+                if (mask & (std::uint64_t(1) << i))
+                {
+                    leafSpheres.closestHit(node.leftOrFirst, node.count, packet.getOrigin(i), packet.getDir(i), tNear[i], hitIndex[i]);
+                }
+            }
+        }
+        else
+        {
+            // Visit the child nearer to the first ray first, which is usually the nearer one for all of them
+            int first = 0;
+
+            while ((mask & (std::uint64_t(1) << first)) == 0)
+            {
+                first++;
+            }
+
+            int nearChild = node.leftOrFirst;
+            int farChild = node.leftOrFirst + 1;
+            Vec3f between = (nodes[farChild].bounds.min + nodes[farChild].bounds.max) - (nodes[nearChild].bounds.min + nodes[nearChild].bounds.max);
+
+            if (between.dot(packet.getDir(first)) < 0)
+            {
+                std::swap(nearChild, farChild);
+            }
+
+            stack[stackSize] = farChild;
+            stackMasks[stackSize++] = mask;
+            stack[stackSize] = nearChild;
+            stackMasks[stackSize++] = mask;
+        }
+    }
+}
+
+/// <summary>
+/// Check which rays in a packet hit any sphere at all, like anyHit(). Rays stop
+/// being traced as soon as they hit something, and the whole packet stops once
+/// every ray has.
+/// </summary>
+/// <param name="packet">The rays. Only active rays are traced.</param>
+/// <param name="ignoreIndex">A sphere to leave out, such as the light itself, or -1.</param>
+/// <param name="hitIndex">The index of the sphere each ray found, left alone for rays that found none.</param>
+/// <returns>A mask of the rays that hit a sphere.</returns>
+std::uint64_t BVH::anyHitPacket(const RayPacket &packet, int ignoreIndex, int *hitIndex) const
+{
+    std::uint64_t blocked = 0;
+
+    if (nodes.empty() || packet.active == 0)
+    {
+        return blocked;
+    }
+
+    int stack[STACK_SIZE];
+    std::uint64_t stackMasks[STACK_SIZE];
+    int stackSize = 0;
+
+    stack[stackSize] = 0;
+    stackMasks[stackSize++] = packet.active;
+
+    while (stackSize > 0)
+    {
+        --stackSize;
+
+        const BVHNode &node = nodes[stack[stackSize]];
+        std::uint64_t mask = intersectPacket(node.bounds, packet, stackMasks[stackSize] & ~blocked, nullptr);
+
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        if (node.count > 0)
+        {
+            for (int i = 0; i < packet.amount; ++i)
+            {
+                std::uint64_t bit = std::uint64_t(1) << i;
+
+                if ((mask & bit) && leafSpheres.anyHit(node.leftOrFirst, node.count, packet.getOrigin(i), packet.getDir(i), ignoreIndex, hitIndex[i]))
+                {
+                    blocked |= bit;
+                }
+            }
+
+            if (blocked == packet.active)
+            {
+                return blocked;
+            }
+        }
+        else
+        {
+            stack[stackSize] = node.leftOrFirst + 1;
+            stackMasks[stackSize++] = mask;
+            stack[stackSize] = node.leftOrFirst;
+            stackMasks[stackSize++] = mask;
+        }
+    }
+
+    return blocked;
+}
+
+/// <summary>
+/// Get the number of nodes in the tree.
+/// </summary>
+/// <returns>The number of nodes.</returns>
+int BVH::getNodeAmount() const
+{
+    return static_cast<int>(nodes.size() - freeNodes.size() * 2);
+}
+
+/// <summary>
+/// Get the number of levels in the tree.
+/// </summary>
+/// <returns>The depth, 0 for an empty tree.</returns>
+int BVH::getDepth() const
+{
+    return nodes.empty() ? 0 : heights[0];
+}
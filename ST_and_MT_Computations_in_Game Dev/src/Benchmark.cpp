@@ -0,0 +1,311 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+	/// <summary>
+	/// Get a percentile of some sorted samples, interpolating between the
+	/// two nearest samples.
+	/// </summary>
+	/// <param name="sorted">The samples, sorted from lowest to highest.</param>
+	/// <param name="percent">The percentile, between 0 and 100.</param>
+	/// <returns>The percentile.</returns>
+	double percentile(const std::vector<double> &sorted, double percent)
+	{
+		if (sorted.empty())
+		{
+			return 0.0;
+		}
+
+		double position = (sorted.size() - 1) * percent / 100.0;
+		std::size_t lower = static_cast<std::size_t>(position);
+		std::size_t upper = std::min(lower + 1, sorted.size() - 1);
+		double fraction = position - lower;
+
+		return sorted[lower] + (sorted[upper] - sorted[lower]) * fraction;
+	}
+
+	/// <summary>
+	/// Get the two-sided 95% critical value of Student's t-distribution.
+	/// </summary>
+	/// <param name="degreesOfFreedom">Degrees of freedom.</param>
+	/// <returns>The critical value.</returns>
+	double tCritical95(double degreesOfFreedom)
+	{
+		static const double TABLE[30] =
+		{
+			12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+			2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+			2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+		};
+
+		if (degreesOfFreedom < 1.0)
+		{
+			return TABLE[0];
+		}
+
+		if (degreesOfFreedom <= 30.0)
+		{
+			// Round down, which errs on the side of a wider interval
+			return TABLE[static_cast<int>(degreesOfFreedom) - 1];
+		}
+
+		if (degreesOfFreedom <= 40.0) { return 2.021; }
+		if (degreesOfFreedom <= 60.0) { return 2.000; }
+		if (degreesOfFreedom <= 120.0) { return 1.980; }
+
+		return 1.960;
+	}
+}
+
+/// <summary>
+/// Run a workload, first for the warmup runs and then for the timed ones.
+/// The workload times itself, so anything it needs to set up can be left
+/// out of the time.
+/// </summary>
+/// <param name="workload">The workload. It returns the time it took in milliseconds.</param>
+/// <param name="settings">The number of warmup and timed runs.</param>
+/// <returns>The time of each timed run in milliseconds.</returns>
+std::vector<double> Benchmark::run(const std::function<double()> &workload, const BenchmarkSettings &settings)
+{
+	for (int i = 0; i < settings.warmup; ++i)
+	{
+		workload();
+	}
+
+	std::vector<double> samples;
+	samples.reserve(std::max(settings.repetitions, 0));
+
+	for (int i = 0; i < settings.repetitions; ++i)
+	{
+		samples.push_back(workload());
+	}
+
+	return samples;
+}
+
+/// <summary>
+/// Sum up a set of samples. Outliers are left out of every value except the outlier count.
+/// </summary>
+/// <param name="samples">The samples in milliseconds.</param>
+/// <returns>The summary. The confidence interval is for the mean, at 95%.</returns>
+BenchmarkSummary Benchmark::summarise(std::vector<double> samples)
+{
+	BenchmarkSummary summary;
+
+	if (samples.empty())
+	{
+		return summary;
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	// Tukey's fences. With fewer than 4 samples the quartiles mean very
+	// little, so everything is kept
+	if (samples.size() >= 4)
+	{
+		double q1 = percentile(samples, 25.0);
+		double q3 = percentile(samples, 75.0);
+		double iqr = q3 - q1;
+		double lowFence = q1 - 1.5 * iqr;
+		double highFence = q3 + 1.5 * iqr;
+
+		std::size_t before = samples.size();
+
+		samples.erase(std::remove_if(samples.begin(), samples.end(), [=](double sample)
+			{
+				return sample < lowFence || sample > highFence;
+			}), samples.end());
+
+		summary.outliers = static_cast<int>(before - samples.size());
+	}
+
+	double sum = 0.0;
+
+	for (double sample : samples)
+	{
+		sum += sample;
+	}
+
+	summary.samples = static_cast<int>(samples.size());
+	summary.min = samples.front();
+	summary.median = percentile(samples, 50.0);
+	summary.p95 = percentile(samples, 95.0);
+	summary.mean = sum / samples.size();
+
+	if (samples.size() > 1)
+	{
+		double squares = 0.0;
+
+		for (double sample : samples)
+		{
+			squares += (sample - summary.mean) * (sample - summary.mean);
+		}
+
+		summary.stddev = std::sqrt(squares / (samples.size() - 1));
+	}
+
+	double margin = tCritical95(samples.size() - 1.0) * summary.stddev / std::sqrt(static_cast<double>(samples.size()));
+	summary.ciLow = summary.mean - margin;
+	summary.ciHigh = summary.mean + margin;
+
+	return summary;
+}
+
+/// <summary>
+/// Compare a result against an older one with Welch's t-test, which
+/// doesn't need both sets of samples to be equally noisy.
+/// </summary>
+/// <param name="baseline">The older result.</param>
+/// <param name="current">The newer result.</param>
+/// <param name="thresholdPercent">The smallest change in the median that counts, as a percentage.</param>
+/// <returns>How the median changed and whether it counts as a regression or improvement.</returns>
+BenchmarkComparison Benchmark::compare(const BenchmarkSummary &baseline, const BenchmarkSummary &current, double thresholdPercent)
+{
+	BenchmarkComparison comparison;
+
+	if (baseline.samples == 0 || current.samples == 0 || baseline.median <= 0.0)
+	{
+		return comparison;
+	}
+
+	comparison.changePercent = 100.0 * (current.median - baseline.median) / baseline.median;
+
+	double baselineVariance = baseline.stddev * baseline.stddev / baseline.samples;
+	double currentVariance = current.stddev * current.stddev / current.samples;
+	double error = std::sqrt(baselineVariance + currentVariance);
+
+	if (error <= 0.0)
+	{
+		// No spread at all, so any difference is real
+		comparison.significant = current.mean != baseline.mean;
+	}
+	else
+	{
+		double t = (current.mean - baseline.mean) / error;
+
+		// Welch-Satterthwaite degrees of freedom
+		double denominator = 0.0;
+
+		if (baseline.samples > 1)
+		{
+			denominator += baselineVariance * baselineVariance / (baseline.samples - 1);
+		}
+
+		if (current.samples > 1)
+		{
+			denominator += currentVariance * currentVariance / (current.samples - 1);
+		}
+
+		double degreesOfFreedom = denominator > 0.0 ? (error * error) * (error * error) / denominator : 1.0;
+
+		comparison.significant = std::abs(t) > tCritical95(degreesOfFreedom);
+	}
+
+	bool bigEnough = std::abs(comparison.changePercent) > thresholdPercent;
+
+	comparison.regression = comparison.significant && bigEnough && comparison.changePercent > 0.0;
+	comparison.improvement = comparison.significant && bigEnough && comparison.changePercent < 0.0;
+
+	return comparison;
+}
+
+/// <summary>
+/// Save results as CSV with a header row.
+/// </summary>
+/// <param name="path">The file to write.</param>
+/// <param name="results">The results.</param>
+/// <returns>True if the file was written.</returns>
+bool Benchmark::saveResults(const std::string &path, const std::vector<BenchmarkResult> &results)
+{
+	std::ofstream file(path);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	file << std::fixed << std::setprecision(4);
+	file << "workload,threads,samples,outliers,min,median,p95,mean,stddev,ci_low,ci_high\n";
+
+	for (auto &result : results)
+	{
+		const BenchmarkSummary &summary = result.summary;
+
+		file << result.workload << "," << result.threads << "," << summary.samples << "," << summary.outliers << ","
+			<< summary.min << "," << summary.median << "," << summary.p95 << "," << summary.mean << ","
+			<< summary.stddev << "," << summary.ciLow << "," << summary.ciHigh << "\n";
+	}
+
+	return file.good();
+}
+
+/// <summary>
+/// Load results saved by saveResults().
+/// </summary>
+/// <param name="path">The file to read.</param>
+/// <param name="results">Filled with the results.</param>
+/// <returns>True if the file was read and every row was complete.</returns>
+bool Benchmark::loadResults(const std::string &path, std::vector<BenchmarkResult> &results)
+{
+	std::ifstream file(path);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	results.clear();
+
+	std::string line;
+
+	// Skip the header row
+	std::getline(file, line);
+
+	while (std::getline(file, line))
+	{
+		if (line.empty())
+		{
+			continue;
+		}
+
+		std::istringstream iss(line);
+		std::vector<std::string> fields;
+		std::string field;
+
+		while (std::getline(iss, field, ','))
+		{
+			fields.push_back(field);
+		}
+
+		if (fields.size() != 11)
+		{
+			return false;
+		}
+
+		BenchmarkResult result;
+		BenchmarkSummary &summary = result.summary;
+
+		result.workload = fields[0];
+		result.threads = std::atoi(fields[1].c_str());
+		summary.samples = std::atoi(fields[2].c_str());
+		summary.outliers = std::atoi(fields[3].c_str());
+		summary.min = std::atof(fields[4].c_str());
+		summary.median = std::atof(fields[5].c_str());
+		summary.p95 = std::atof(fields[6].c_str());
+		summary.mean = std::atof(fields[7].c_str());
+		summary.stddev = std::atof(fields[8].c_str());
+		summary.ciLow = std::atof(fields[9].c_str());
+		summary.ciHigh = std::atof(fields[10].c_str());
+
+		results.push_back(result);
+	}
+
+	return true;
+}
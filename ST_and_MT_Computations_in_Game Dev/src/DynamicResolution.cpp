@@ -0,0 +1,301 @@
+#include "DynamicResolution.h"
+#include "Timer.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    // The resolution never goes below a quarter of the output's width and height
+    const float MIN_SCALE = 0.25f;
+    const float MAX_SCALE = 1.0f;
+
+    // The time a frame takes goes with its pixels, so the square root of budget / time
+    // would fit the budget exactly. Half of that is taken each frame, in log terms, so
+    // the scale settles rather than overshooting, and it shrinks faster than it grows
+    const double GAIN = 0.25;
+    const double MAX_SHRINK = 0.8;
+    const double MAX_GROW = 1.05;
+
+    // Frames this much under the budget grow the scale, so it doesn't flicker around the budget
+    const double HEADROOM = 1.1;
+
+    // A bounce can add a lot, so they're only put back with plenty of time to spare
+    const double BOUNCE_HEADROOM = 1.5;
+
+    // How much of each new frame's time goes into the average, smoothing out single slow frames
+    const double SMOOTHING = 0.5;
+
+    /// <summary>
+    /// Blend two RGBA pixels, all 4 channels at once: red and blue, then green and
+    /// alpha, each get 16 bits of a 32 bit number, which is enough for a channel
+    /// times a weight out of 256.
+    /// </summary>
+    /// <param name="first">The first pixel.</param>
+    /// <param name="second">The second pixel.</param>
+    /// <param name="weight">How much of the second pixel to use, out of 256.</param>
+    /// <returns>The blended pixel, rounded.</returns>
+    uint32_t blendPixels(uint32_t first, uint32_t second, uint32_t weight)
+    {
+        const uint32_t lowChannels = 0x00FF00FF;
+        const uint32_t half = 0x00800080;
+
+        uint32_t redBlue = ((first & lowChannels) * (256 - weight) + (second & lowChannels) * weight + half) >> 8;
+        uint32_t greenAlpha = ((first >> 8 & lowChannels) * (256 - weight) + (second >> 8 & lowChannels) * weight + half);
+
+        return (redBlue & lowChannels) | (greenAlpha & ~lowChannels);
+    }
+
+    /// <summary>
+    /// Read an RGBA pixel as one number.
+    /// </summary>
+    /// <param name="pixel">The pixel's first byte.</param>
+    /// <returns>The pixel.</returns>
+    uint32_t loadPixel(const uint8_t *pixel)
+    {
+        uint32_t value;
+        std::memcpy(&value, pixel, sizeof(value));
+
+        return value;
+    }
+}
+
+/// <summary>
+/// Render one frame at the current resolution and bounces, scale it up into the
+/// pixel array, then adjust the resolution and bounces for the next frame.
+/// The scene's max bounces is the most it uses, and is left as it was.
+/// </summary>
+/// <param name="scene">The scene, which must be built.</param>
+/// <param name="threadPool">The pool to render on.</param>
+/// <param name="threads">The most threads to use, including this one, 1 to render on this thread only.</param>
+/// <param name="tileSize">The size of each job's tile, in rendered pixels.</param>
+/// <param name="pixelArray">Set to the RGBA pixels of the frame at the output's size.</param>
+/// <param name="outputW">The width of the output.</param>
+/// <param name="outputH">The height of the output.</param>
+/// <param name="exposure">What each colour is multiplied by when it's resolved.</param>
+/// <param name="softClip">True to squeeze colours above 1 in rather than clamping them.</param>
+/// <returns>The time taken in milliseconds.</returns>
+double DynamicResolution::renderFrame(RayScene &scene, ThreadPool &threadPool, int threads, Grain2D tileSize, std::vector<uint8_t> &pixelArray, int outputW, int outputH, float exposure, bool softClip)
+{
+    PROFILE_SCOPE("Raytracer Real-Time Frame");
+
+    Timer timer("Raytracer Real-Time Frame");
+
+    int maxBounces = scene.maxBounces;
+
+    if (bounces == 0 || bounces > maxBounces)
+    {
+        bounces = maxBounces;
+    }
+
+    renderW = std::max(1, static_cast<int>(outputW * scale + 0.5f));
+    renderH = std::max(1, static_cast<int>(outputH * scale + 0.5f));
+
+    if (hdrBuffer.getWidth() != renderW || hdrBuffer.getHeight() != renderH)
+    {
+        hdrBuffer.resize(renderW, renderH);
+    }
+
+    // The frame's bounces are only used for this render
+    scene.maxBounces = bounces;
+
+    if (scene.useBins)
+    {
+        scene.binSpheres(renderW, renderH);
+    }
+
+    if (threads > 1)
+    {
+        parallelFor2D(threadPool, { 0, 0, renderW, renderH }, tileSize, [&](const Range2D &tile)
+        {
+            scene.renderSection(hdrBuffer, { tile.beginX, tile.beginY }, { tile.endX, tile.endY });
+        }, threads);
+    }
+    else
+    {
+        scene.renderSection(hdrBuffer, { 0, 0 }, { renderW, renderH });
+    }
+
+    scene.maxBounces = maxBounces;
+
+    pixelArray.resize(outputW * outputH * 4);
+
+    if (renderW == outputW && renderH == outputH)
+    {
+        hdrBuffer.resolve(pixelArray.data(), 0, 0, renderW, renderH, exposure, softClip);
+    }
+    else
+    {
+        renderPixels.resize(renderW * renderH * 4);
+        hdrBuffer.resolve(renderPixels.data(), 0, 0, renderW, renderH, exposure, softClip);
+
+        // Line each output column up with the render by its middle, so the image doesn't shift as it scales
+        columns.resize(outputW);
+
+        for (int x = 0; x < outputW; ++x)
+        {
+            float renderX = std::max(0.0f, (x + 0.5f) * renderW / outputW - 0.5f);
+            int left = std::min(static_cast<int>(renderX), renderW - 1);
+
+            columns[x] = { left, std::min(left + 1, renderW - 1), static_cast<int>((renderX - left) * 256) };
+        }
+
+        if (threads > 1)
+        {
+            parallelFor(threadPool, 0, outputH, 0, [&](int begin, int end)
+            {
+                upscale(pixelArray, outputW, outputH, begin, end);
+            }, threads);
+        }
+        else
+        {
+            upscale(pixelArray, outputW, outputH, 0, outputH);
+        }
+    }
+
+    double frameMs = timer.stop();
+    update(frameMs, maxBounces);
+
+    return frameMs;
+}
+
+/// <summary>
+/// Go back to full resolution and the scene's max bounces, and forget the frames so far.
+/// </summary>
+void DynamicResolution::reset()
+{
+    scale = MAX_SCALE;
+    bounces = 0;
+    averageMs = 0.0;
+}
+
+/// <summary>
+/// Get the resolution the next frame will be rendered at.
+/// </summary>
+/// <returns>The fraction of the output's width and height, from 0.25 to 1.</returns>
+float DynamicResolution::getScale() const
+{
+    return scale;
+}
+
+/// <summary>
+/// Get the bounces the next frame will be rendered with.
+/// </summary>
+/// <returns>The bounces, or 0 before the first frame.</returns>
+int DynamicResolution::getBounces() const
+{
+    return bounces;
+}
+
+/// <summary>
+/// Get the width the last frame was rendered at.
+/// </summary>
+/// <returns>The width in pixels.</returns>
+int DynamicResolution::getRenderW() const
+{
+    return renderW;
+}
+
+/// <summary>
+/// Get the height the last frame was rendered at.
+/// </summary>
+/// <returns>The height in pixels.</returns>
+int DynamicResolution::getRenderH() const
+{
+    return renderH;
+}
+
+/// <summary>
+/// Get the smoothed time the last few frames took, which the controller compares with the budget.
+/// </summary>
+/// <returns>The time in milliseconds.</returns>
+double DynamicResolution::getAverageMs() const
+{
+    return averageMs;
+}
+
+/// <summary>
+/// The feedback controller. Over budget, the scale shrinks, or once it's as small
+/// as it goes, a bounce is taken off. Comfortably under budget, a bounce is put
+/// back, or once they're all back, the scale grows.
+/// </summary>
+/// <param name="frameMs">The time the last frame took.</param>
+/// <param name="maxBounces">The most bounces to use.</param>
+void DynamicResolution::update(double frameMs, int maxBounces)
+{
+    averageMs = averageMs > 0.0 ? averageMs + (frameMs - averageMs) * SMOOTHING : frameMs;
+
+    double ratio = budgetMs / std::max(averageMs, 0.001);
+
+    if (ratio < 1.0)
+    {
+        if (scale > MIN_SCALE)
+        {
+            scale = std::max(MIN_SCALE, scale * static_cast<float>(std::max(MAX_SHRINK, std::pow(ratio, GAIN))));
+        }
+        else if (bounces > 1)
+        {
+            // The average is of frames with more bounces, so it starts again
+            bounces--;
+            averageMs = 0.0;
+        }
+    }
+    else if (ratio > HEADROOM)
+    {
+        if (bounces < maxBounces)
+        {
+            if (ratio > BOUNCE_HEADROOM)
+            {
+                bounces++;
+                averageMs = 0.0;
+            }
+        }
+        else
+        {
+            scale = std::min(MAX_SCALE, scale * static_cast<float>(std::min(MAX_GROW, std::pow(ratio, GAIN))));
+        }
+    }
+}
+
+/// <summary>
+/// Scale some rows of the rendered pixels up to the output's size. Each output pixel
+/// is a blend of the 4 rendered pixels around it, weighted by how close it is to each.
+/// For each output row, the rendered rows above and below it are blended down once,
+/// so each output pixel only has to blend the two pixels of that row either side of it.
+/// </summary>
+/// <param name="pixelArray">The RGBA pixels of the output.</param>
+/// <param name="outputW">The width of the output.</param>
+/// <param name="outputH">The height of the output.</param>
+/// <param name="beginY">The first row to fill.</param>
+/// <param name="endY">One past the last row to fill.</param>
+void DynamicResolution::upscale(std::vector<uint8_t> &pixelArray, int outputW, int outputH, int beginY, int endY) const
+{
+    std::vector<uint32_t> blendedRow(renderW);
+
+    for (int y = beginY; y < endY; ++y)
+    {
+        float renderY = std::max(0.0f, (y + 0.5f) * renderH / outputH - 0.5f);
+        int top = std::min(static_cast<int>(renderY), renderH - 1);
+        int bottom = std::min(top + 1, renderH - 1);
+        int weightY = static_cast<int>((renderY - top) * 256);
+
+        const uint8_t *topRow = &renderPixels[top * renderW * 4];
+        const uint8_t *bottomRow = &renderPixels[bottom * renderW * 4];
+        uint8_t *outputRow = &pixelArray[y * outputW * 4];
+
+        for (int x = 0; x < renderW; ++x)
+        {
+            blendedRow[x] = blendPixels(loadPixel(&topRow[x * 4]), loadPixel(&bottomRow[x * 4]), weightY);
+        }
+
+        for (int x = 0; x < outputW; ++x)
+        {
+            const Column &column = columns[x];
+            uint32_t pixel = blendPixels(blendedRow[column.left], blendedRow[column.right], column.weight);
+
+            std::memcpy(&outputRow[x * 4], &pixel, sizeof(pixel));
+        }
+    }
+}
@@ -0,0 +1,289 @@
+#include "HDRBuffer.h"
+#include "SphereSoA.h"
+#include "SIMD.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Soft clipping leaves colours up to this alone, and squeezes everything brighter in below 1
+    const float SOFT_CLIP_KNEE = 0.8f;
+    const float SOFT_CLIP_RANGE = 1.0f - SOFT_CLIP_KNEE;
+
+    /// <summary>
+    /// Mirror the digits of a number, written in some base, around the decimal point.
+    /// Going up from 1, the results spread out evenly between 0 and 1.
+    /// </summary>
+    /// <param name="index">The number.</param>
+    /// <param name="base">The base, which should be prime.</param>
+    /// <returns>The mirrored number, from 0 to 1.</returns>
+    double radicalInverse(int index, int base)
+    {
+        double result = 0.0;
+        double digitValue = 1.0 / base;
+
+        while (index > 0)
+        {
+            result += (index % base) * digitValue;
+            index /= base;
+            digitValue /= base;
+        }
+
+        return result;
+    }
+
+    /// <summary>
+    /// Turn one part of a pixel's summed colour into the value the pixel array holds.
+    /// </summary>
+    /// <param name="sum">The red, green or blue sum.</param>
+    /// <param name="count">The number of samples, at least 1.</param>
+    /// <param name="exposure">What the average is multiplied by.</param>
+    /// <param name="softClip">True to squeeze colours above 1 in rather than clamping them.</param>
+    /// <returns>The value from 0 to 255.</returns>
+    uint8_t toneMap(float sum, float count, float exposure, bool softClip)
+    {
+        float colour = sum / count * exposure;
+
+        if (softClip && colour > SOFT_CLIP_KNEE)
+        {
+            float over = (colour - SOFT_CLIP_KNEE) / SOFT_CLIP_RANGE;
+            colour = SOFT_CLIP_KNEE + SOFT_CLIP_RANGE * (over / (1.0f + over));
+        }
+
+        return (uint8_t)(std::min(1.0f, colour) * 255);
+    }
+}
+
+/// <summary>
+/// Change the size of the image. Every pixel is left with no samples.
+/// </summary>
+/// <param name="width">The width of the image.</param>
+/// <param name="height">The height of the image.</param>
+void HDRBuffer::resize(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+
+    values.assign(static_cast<std::size_t>(width) * height * 4, 0.0f);
+}
+
+/// <summary>
+/// Get the width of the image.
+/// </summary>
+/// <returns>The width.</returns>
+int HDRBuffer::getWidth() const
+{
+    return width;
+}
+
+/// <summary>
+/// Get the height of the image.
+/// </summary>
+/// <returns>The height.</returns>
+int HDRBuffer::getHeight() const
+{
+    return height;
+}
+
+/// <summary>
+/// Get how many samples a pixel has.
+/// </summary>
+/// <param name="x">The pixel's X coordinate.</param>
+/// <param name="y">The pixel's Y coordinate.</param>
+/// <returns>The number of samples.</returns>
+int HDRBuffer::getSamples(int x, int y) const
+{
+    return static_cast<int>(values[(static_cast<std::size_t>(y) * width + x) * 4 + 3]);
+}
+
+/// <summary>
+/// Get the average colour of a pixel's samples, before exposure and tone mapping.
+/// </summary>
+/// <param name="x">The pixel's X coordinate.</param>
+/// <param name="y">The pixel's Y coordinate.</param>
+/// <returns>The average colour, black if it has no samples.</returns>
+Vec3f HDRBuffer::getAverage(int x, int y) const
+{
+    const float *pixel = &values[(static_cast<std::size_t>(y) * width + x) * 4];
+    float count = std::max(pixel[3], 1.0f);
+
+    return Vec3f(pixel[0] / count, pixel[1] / count, pixel[2] / count);
+}
+
+/// <summary>
+/// Replace all of a pixel's samples with one.
+/// </summary>
+/// <param name="x">The pixel's X coordinate.</param>
+/// <param name="y">The pixel's Y coordinate.</param>
+/// <param name="colour">The sample's colour.</param>
+void HDRBuffer::setSample(int x, int y, const Vec3f &colour)
+{
+    float *pixel = &values[(static_cast<std::size_t>(y) * width + x) * 4];
+
+    pixel[0] = colour.x;
+    pixel[1] = colour.y;
+    pixel[2] = colour.z;
+    pixel[3] = 1.0f;
+}
+
+/// <summary>
+/// Add another sample to a pixel.
+/// </summary>
+/// <param name="x">The pixel's X coordinate.</param>
+/// <param name="y">The pixel's Y coordinate.</param>
+/// <param name="colour">The sample's colour.</param>
+void HDRBuffer::addSample(int x, int y, const Vec3f &colour)
+{
+    float *pixel = &values[(static_cast<std::size_t>(y) * width + x) * 4];
+
+    pixel[0] += colour.x;
+    pixel[1] += colour.y;
+    pixel[2] += colour.z;
+    pixel[3] += 1.0f;
+}
+
+/// <summary>
+/// Turn part of the image into RGBA8 pixels: average each pixel's samples,
+/// multiply by the exposure, then clamp or soft clip to 1.
+/// </summary>
+/// <param name="pixels">Where the pixels go, row after row with no gaps between them.</param>
+/// <param name="beginX">The left edge of the part.</param>
+/// <param name="beginY">The top edge of the part.</param>
+/// <param name="endX">The right edge of the part, not included.</param>
+/// <param name="endY">The bottom edge of the part, not included.</param>
+/// <param name="exposure">What each average colour is multiplied by.</param>
+/// <param name="softClip">True to squeeze colours above 1 in below it, so bright areas keep some detail.</param>
+void HDRBuffer::resolve(uint8_t *pixels, int beginX, int beginY, int endX, int endY, float exposure, bool softClip) const
+{
+    int rowWidth = endX - beginX;
+
+    for (int y = beginY; y < endY; ++y)
+    {
+        int first = y * width + beginX;
+        uint8_t *row = pixels + static_cast<std::size_t>(y - beginY) * rowWidth * 4;
+
+        if (SphereSoA::isSIMDEnabled())
+        {
+            resolveSIMD(row, first, rowWidth, exposure, softClip);
+        }
+        else
+        {
+            resolveScalar(row, first, rowWidth, exposure, softClip);
+        }
+    }
+}
+
+/// <summary>
+/// Get where in its pixel a sample's ray should go. The first goes through the
+/// middle, like a render without extra samples. The rest follow a Halton sequence,
+/// which covers the pixel evenly however many samples there end up being.
+/// </summary>
+/// <param name="sample">How many samples the pixel already has.</param>
+/// <param name="offsetX">Set to the offset from the pixel's left edge, from 0 to 1.</param>
+/// <param name="offsetY">Set to the offset from the pixel's top edge, from 0 to 1.</param>
+void HDRBuffer::getSampleOffset(int sample, double &offsetX, double &offsetY)
+{
+    if (sample == 0)
+    {
+        offsetX = 0.5;
+        offsetY = 0.5;
+        return;
+    }
+
+    offsetX = radicalInverse(sample, 2);
+    offsetY = radicalInverse(sample, 3);
+}
+
+/// <summary>
+/// The one pixel at a time version of resolve, for one row.
+/// </summary>
+void HDRBuffer::resolveScalar(uint8_t *pixels, int first, int amount, float exposure, bool softClip) const
+{
+    for (int i = 0; i < amount; ++i)
+    {
+        const float *pixel = &values[static_cast<std::size_t>(first + i) * 4];
+        float count = std::max(pixel[3], 1.0f);
+
+        pixels[i * 4] = toneMap(pixel[0], count, exposure, softClip);
+        pixels[i * 4 + 1] = toneMap(pixel[1], count, exposure, softClip);
+        pixels[i * 4 + 2] = toneMap(pixel[2], count, exposure, softClip);
+        pixels[i * 4 + 3] = 255;
+    }
+}
+
+#ifdef USE_AVX
+
+namespace
+{
+    /// <summary>
+    /// Resolve 2 pixels held in one 8 float register, the same way as toneMap.
+    /// </summary>
+    /// <param name="pair">The 2 pixels' sums and sample counts.</param>
+    /// <param name="exposure">What each average colour is multiplied by.</param>
+    /// <param name="softClip">True to squeeze colours above 1 in rather than clamping them.</param>
+    /// <returns>The 2 pixels' RGBA values, from 0 to 255.</returns>
+    AVX_FUNCTION __m256i resolvePair(const float *pair, float exposure, bool softClip)
+    {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 knee = _mm256_set1_ps(SOFT_CLIP_KNEE);
+        const __m256 range = _mm256_set1_ps(SOFT_CLIP_RANGE);
+        const __m256 scale = _mm256_set1_ps(255.0f);
+
+        __m256 sums = _mm256_loadu_ps(pair);
+
+        // Copy each pixel's sample count across its 4 lanes
+        __m256 counts = _mm256_max_ps(_mm256_permute_ps(sums, _MM_SHUFFLE(3, 3, 3, 3)), one);
+        __m256 colours = _mm256_mul_ps(_mm256_div_ps(sums, counts), _mm256_set1_ps(exposure));
+
+        if (softClip)
+        {
+            __m256 over = _mm256_div_ps(_mm256_sub_ps(colours, knee), range);
+            __m256 clipped = _mm256_add_ps(knee, _mm256_mul_ps(range, _mm256_div_ps(over, _mm256_add_ps(one, over))));
+
+            colours = _mm256_blendv_ps(colours, clipped, _mm256_cmp_ps(colours, knee, _CMP_GT_OQ));
+        }
+
+        __m256 scaled = _mm256_mul_ps(_mm256_min_ps(colours, one), scale);
+
+        // The counts' lanes become alpha
+        scaled = _mm256_blend_ps(scaled, scale, 0x88);
+
+        return _mm256_cvttps_epi32(scaled);
+    }
+}
+
+/// <summary>
+/// The AVX version of resolve, for one row. Each 8 float register holds 2 pixels,
+/// and 4 pixels are packed down to 16 bytes at a time. The last few pixels of
+/// the row are done one at a time.
+/// </summary>
+AVX_FUNCTION void HDRBuffer::resolveSIMD(uint8_t *pixels, int first, int amount, float exposure, bool softClip) const
+{
+    int i = 0;
+
+    for (; i + 4 <= amount; i += 4)
+    {
+        const float *pixel = &values[static_cast<std::size_t>(first + i) * 4];
+        __m256i a = resolvePair(pixel, exposure, softClip);
+        __m256i b = resolvePair(pixel + 8, exposure, softClip);
+
+        __m128i shortsA = _mm_packus_epi32(_mm256_castsi256_si128(a), _mm256_extractf128_si256(a, 1));
+        __m128i shortsB = _mm_packus_epi32(_mm256_castsi256_si128(b), _mm256_extractf128_si256(b, 1));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + i * 4), _mm_packus_epi16(shortsA, shortsB));
+    }
+
+    resolveScalar(pixels + i * 4, first + i, amount - i, exposure, softClip);
+}
+
+#else
+
+/// <summary>
+/// Without AVX the SIMD path is never turned on, so this is never called.
+/// </summary>
+void HDRBuffer::resolveSIMD(uint8_t *pixels, int first, int amount, float exposure, bool softClip) const
+{
+    resolveScalar(pixels, first, amount, exposure, softClip);
+}
+
+#endif
@@ -3,7 +3,9 @@
 /// <summary>
 /// ParticleEffect constructor.
 /// </summary>
-ParticleEffect::ParticleEffect(sf::Time &dt) : dt(dt)
+/// <param name="dt">Delta time.</param>
+/// <param name="threadPool">The thread pool shared by all tests.</param>
+ParticleEffect::ParticleEffect(sf::Time &dt, ThreadPool &threadPool) : threadPool(&threadPool), poolStats(threadPool), scalingPanel(threadPool, "Particle Effect"), dt(dt)
 {
 	// This is where the particles will be rendered
 	renderTexture = std::make_unique<sf::Texture>();
@@ -14,9 +16,10 @@ ParticleEffect::ParticleEffect(sf::Time &dt) : dt(dt)
 	pixelsPtr = &pixels;
 	scrW = 1280;
 
-	threadAmount = std::thread::hardware_concurrency() - 1; // Subtract 1 to leave a spare thread
-
-	threadPool = std::make_unique<ThreadPool>(threadAmount);
+	// The main thread updates generators too while it waits, so there is
+	// one generator for each pool thread plus one
+	threadAmount = static_cast<int>(threadPool.getThreadAmount()) + 1;
+	threadLimit = threadAmount;
 
 	// Amount of thread gen is equal to the amount of available threads
 	threadGens.resize(threadAmount);
@@ -55,56 +58,59 @@ void ParticleEffect::update(const sf::Time &dt)
 	// Set every value to 0
 	std::fill(pixels.begin(), pixels.end(), 0);
 
-	// Store futures in here
-	std::vector<std::future<void>> futures;
+	// Only one frame every half a second is measured, so the readouts can be read
+	bool measuring = clTimer > sf::seconds(0.5f);
+
+	if (measuring)
+	{
+		poolStats.begin();
+		perfCounters.begin();
+	}
 
 	Timer timer("Particle Effect Update");
 
-	// Update particles
+	updateGenerators(multiThreaded, threadLimit);
+
+	if (measuring)
+	{
+		ms = timer.stop();
+		poolStats.end();
+		perfCounters.end();
+		clTimer = sf::Time::Zero;
+	}
+}
+
+/// <summary>
+/// Update every particle once.
+/// </summary>
+/// <param name="multiThreaded">False for single-threaded and true for multi-threaded.</param>
+/// <param name="threadLimit">The most threads to use when multi-threaded.</param>
+void ParticleEffect::updateGenerators(bool multiThreaded, int threadLimit)
+{
 	if (!multiThreaded)
 	{
 		for (int i = 0; i < threadGens.size(); ++i)
 		{
 			// Single threaded
+			PROFILE_SCOPE("Particle Generator");
+			PERF_SCOPE(perfCounters.getTotals());
 			threadGens.at(i)->update(scrW, threadAmount);
 		}
-
-		if (clTimer > sf::seconds(0.5f))
-		{
-			ms = timer.stop();
-			clTimer = sf::Time::Zero;
-		}
 	}
 	else
 	{
-		for (int i = 0; i < threadGens.size(); ++i)
-		{
-			// Multi threaded
-			auto f = threadPool->addJob([=]
+		// Multi threaded, one generator per chunk. This thread updates
+		// generators too until they're all finished
+		parallelFor(*threadPool, 0, static_cast<int>(threadGens.size()), 1, [this](int begin, int end)
+			{
+				for (int i = begin; i < end; ++i)
 				{
-					threadGens.at(i)->update(scrW, threadAmount);
-				});
-
-			futures.push_back(std::move(f));
-		}
+					PROFILE_SCOPE("Particle Generator");
+					PERF_SCOPE(perfCounters.getTotals());
+					threadGens[i]->update(scrW, threadAmount);
+				}
+			}, threadLimit);
 	}
-
-	if (multiThreaded)
-	{
-		// Wait for all threads to finish
-		for (auto &future : futures)
-		{
-			future.wait();
-		}
-
-		if (clTimer > sf::seconds(0.5f))
-		{
-			ms = timer.stop();
-			clTimer = sf::Time::Zero;
-		}
-	}
-
-	renderTexture->update(pixels.data());
 }
 
 /// <summary>
@@ -183,6 +189,10 @@ void ParticleEffect::handleUI()
 
 			ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
+			ImGui::SliderInt("Thread Limit##096", &threadLimit, 1, threadAmount);
+
+			ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
 			ImGui::SeparatorText("Particle Update Time##018");
 
 			ImGui::Dummy(ImVec2(0.0f, 8.0f));
@@ -192,6 +202,12 @@ void ParticleEffect::handleUI()
 			ImGui::Text(milliSecs.c_str());
 
 			ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+			poolStats.handleUI();
+
+			perfCounters.handleUI();
+
+			scalingPanel.handleUI([this](int threads) { return runAtThreads(threads); });
 		}
 	}
 
@@ -241,7 +257,25 @@ void ParticleEffect::handleUI()
 	startPosition.x = mousePos.x;
 	startPosition.y = mousePos.y;
 
+	// The pixels are uploaded here rather than in update(), which can run
+	// on a worker thread
+	renderTexture->update(pixels.data());
+
 	ImGui::Image(*renderTexture);
 
 	ImGui::End();
 }
+
+/// <summary>
+/// Update every particle once on a given number of threads, for the scaling sweep.
+/// </summary>
+/// <param name="threads">The number of threads to use, 1 for the single-threaded path.</param>
+/// <returns>The time taken in milliseconds.</returns>
+double ParticleEffect::runAtThreads(int threads)
+{
+	Timer timer("Particle Effect Sweep");
+
+	updateGenerators(threads > 1, threads);
+
+	return timer.stop();
+}
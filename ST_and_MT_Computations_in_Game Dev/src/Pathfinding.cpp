@@ -3,7 +3,8 @@
 /// <summary>
 /// Pathfinding constructor.
 /// </summary>
-Pathfinding::Pathfinding()
+/// <param name="threadPool">The thread pool shared by all tests.</param>
+Pathfinding::Pathfinding(ThreadPool &threadPool) : threadPool(&threadPool), poolStats(threadPool), scalingPanel(threadPool, "Pathfinding")
 {
  	// Configure tile map
 	tileSet = std::make_unique<sf::Texture>();
@@ -23,7 +24,8 @@ Pathfinding::Pathfinding()
 	main_RT = std::make_unique<sf::RenderTexture>();
 	main_RT->create(SCREEN_WIDTH, SCREEN_HEIGHT);
 
-	threadPool = std::make_unique<ThreadPool>(std::thread::hardware_concurrency());
+	// Use every pool thread plus the main thread until the user lowers it
+	threadLimit = static_cast<int>(threadPool.getThreadAmount()) + 1;
 
 	loadDemoBots();
 }
@@ -236,6 +238,10 @@ void Pathfinding::handleUI()
 
 				ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
+				ImGui::SliderInt("Thread Limit##095", &threadLimit, 1, static_cast<int>(threadPool->getThreadAmount()) + 1);
+
+				ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
 				ImGui::SeparatorText("Execution Time##037");
 
 				ImGui::Dummy(ImVec2(0.0f, 8.0f));
@@ -245,6 +251,12 @@ void Pathfinding::handleUI()
 				ImGui::Text(milliSecs.c_str());
 
 				ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+				poolStats.handleUI();
+
+				perfCounters.handleUI();
+
+				scalingPanel.handleUI([this](int threads) { return runAtThreads(threads); });
 			}
 		}
 	}
@@ -508,41 +520,53 @@ void Pathfinding::writeBotPositionsToFile()
 /// <param name="multiThreaded">False for single-threaded and true for multi-threaded.</param>
 void Pathfinding::startPathfinding(bool multiThreaded)
 {
-	// Store futures in here
-	std::vector<std::future<void>> futures;
+	PROFILE_SCOPE("Pathfinding");
 
+	poolStats.begin();
+	perfCounters.begin();
 	Timer timer("Pathfinding");
 
 	if (multiThreaded)
 	{
-		for (auto &bot : bots)
-		{
-			// This lambda adds a block of code to the thread pool as a job
-			auto f = threadPool->addJob([=]
+		// One bot per chunk, as searches can take very different amounts of time.
+		// The main thread searches too until every bot is done
+		parallelFor(*threadPool, 0, static_cast<int>(bots.size()), 1, [this](int begin, int end)
+			{
+				for (int i = begin; i < end; ++i)
 				{
-					bot->startPathfinding(destinationNode.x, destinationNode.y);
-				});
-
-			futures.push_back(std::move(f));
-		}
+					PROFILE_SCOPE("Bot Search");
+					PERF_SCOPE(perfCounters.getTotals());
+					bots[i]->startPathfinding(destinationNode.x, destinationNode.y);
+				}
+			}, threadLimit);
 	}
 	else
 	{
 		for (auto &bot : bots)
 		{
+			PROFILE_SCOPE("Bot Search");
+			PERF_SCOPE(perfCounters.getTotals());
 			bot->startPathfinding(destinationNode.x, destinationNode.y);
 		}
-
-		ms = timer.stop();
 	}
 
-	if (multiThreaded)
-	{
-		for (auto &future : futures)
-		{
-			future.wait();
-		}
+	ms = timer.stop();
+	poolStats.end();
+	perfCounters.end();
+}
 
-		ms = timer.stop();
-	}
+/// <summary>
+/// Run pathfinding for every bot on a given number of threads, for the scaling sweep.
+/// </summary>
+/// <param name="threads">The number of threads to use, 1 for the single-threaded path.</param>
+/// <returns>The time taken in milliseconds.</returns>
+double Pathfinding::runAtThreads(int threads)
+{
+	int savedLimit = threadLimit;
+
+	threadLimit = threads;
+	startPathfinding(threads > 1);
+	threadLimit = savedLimit;
+
+	return ms;
 }
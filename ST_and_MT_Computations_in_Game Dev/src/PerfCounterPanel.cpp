@@ -0,0 +1,130 @@
+#include "PerfCounterPanel.h"
+
+/// <summary>
+/// PerfCounterPanel constructor.
+/// </summary>
+PerfCounterPanel::PerfCounterPanel()
+{
+
+}
+
+/// <summary>
+/// PerfCounterPanel destructor.
+/// </summary>
+PerfCounterPanel::~PerfCounterPanel()
+{
+
+}
+
+/// <summary>
+/// Clear the totals at the start of a run.
+/// </summary>
+void PerfCounterPanel::begin()
+{
+	totals.reset();
+}
+
+/// <summary>
+/// Keep the totals from the run that just finished.
+/// </summary>
+void PerfCounterPanel::end()
+{
+	runValues = totals.get();
+}
+
+/// <summary>
+/// Draw the switch for counting and the counts from the last run.
+/// Misses are also shown per thousand instructions, which doesn't change
+/// with the amount of work like the raw counts do.
+/// </summary>
+void PerfCounterPanel::handleUI()
+{
+	ImGui::PushID(this);
+
+	ImGui::SeparatorText("Hardware Counters");
+
+	ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+	bool enabled = PerfCounters::isEnabled();
+
+	if (ImGui::Checkbox("Count Events", &enabled))
+	{
+		PerfCounters::setEnabled(enabled);
+	}
+
+	ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+	if (runValues.scopes == 0)
+	{
+		ImGui::Text("Turn counting on and run the test\nto see its counters");
+		ImGui::Dummy(ImVec2(0.0f, 8.0f));
+		ImGui::PopID();
+
+		return;
+	}
+
+	if (!PerfCounters::isAvailable())
+	{
+		// Context switches come from getrusage, so they still work
+		ImGui::TextWrapped("Hardware counters aren't available here. They need Linux and perf_event_paranoid set low enough to allow them");
+		ImGui::Dummy(ImVec2(0.0f, 8.0f));
+	}
+
+	double perKiloInstruction = runValues.instructions > 0 ? 1000.0 / runValues.instructions : 0.0;
+
+	ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit;
+
+	if (ImGui::BeginTable("Counters", 3, flags))
+	{
+		ImGui::TableSetupColumn("Counter");
+		ImGui::TableSetupColumn("Total");
+		ImGui::TableSetupColumn("Per 1k Instructions");
+		ImGui::TableHeadersRow();
+
+		auto row = [&](const char *name, std::uint64_t value, bool showRate)
+		{
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text(name);
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", static_cast<unsigned long long>(value));
+			ImGui::TableNextColumn();
+
+			if (showRate)
+			{
+				ImGui::Text("%.3f", value * perKiloInstruction);
+			}
+			else
+			{
+				ImGui::Text("-");
+			}
+		};
+
+		row("Cycles", runValues.cycles, false);
+		row("Instructions", runValues.instructions, false);
+		row("LLC Misses", runValues.cacheMisses, true);
+		row("Branch Misses", runValues.branchMisses, true);
+		row("Context Switches", runValues.contextSwitches, false);
+		row("Scopes", runValues.scopes, false);
+
+		ImGui::EndTable();
+	}
+
+	if (runValues.cycles > 0)
+	{
+		ImGui::Text("Instructions per cycle: %.2f", static_cast<double>(runValues.instructions) / runValues.cycles);
+	}
+
+	ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+	ImGui::PopID();
+}
+
+/// <summary>
+/// Get the totals the test's PERF_SCOPEs add to.
+/// </summary>
+/// <returns>The totals.</returns>
+PerfCounterTotals &PerfCounterPanel::getTotals()
+{
+	return totals;
+}
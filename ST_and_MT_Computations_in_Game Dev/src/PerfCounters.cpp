@@ -0,0 +1,258 @@
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+namespace
+{
+	std::atomic<bool> countingEnabled{ false };
+
+#ifdef __linux__
+	const int COUNTER_AMOUNT = 4;
+
+	// The order here is the order of PerfSample::values
+	const std::uint64_t COUNTER_CONFIGS[COUNTER_AMOUNT] =
+	{
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+
+	// One group of counters per thread. The first counter that opens leads
+	// the group, so they're all switched on and off the PMU together and
+	// can be read with one system call
+	struct ThreadCounters
+	{
+		int fds[COUNTER_AMOUNT] = { -1, -1, -1, -1 };
+		std::uint64_t ids[COUNTER_AMOUNT] = {};
+		int leader = -1;
+		int openAmount = 0;
+
+		ThreadCounters()
+		{
+			for (int i = 0; i < COUNTER_AMOUNT; ++i)
+			{
+				perf_event_attr attr;
+				std::memset(&attr, 0, sizeof(attr));
+
+				attr.size = sizeof(attr);
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = COUNTER_CONFIGS[i];
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+				// This thread only, on whichever CPU it runs on
+				fds[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0));
+
+				if (fds[i] >= 0)
+				{
+					ioctl(fds[i], PERF_EVENT_IOC_ID, &ids[i]);
+
+					if (leader < 0)
+					{
+						leader = fds[i];
+					}
+
+					openAmount++;
+				}
+			}
+		}
+
+		~ThreadCounters()
+		{
+			for (int fd : fds)
+			{
+				if (fd >= 0)
+				{
+					close(fd);
+				}
+			}
+		}
+	};
+
+	std::atomic<bool> available{ false };
+
+	/// <summary>
+	/// Get the calling thread's counters, opening them the first time.
+	/// </summary>
+	/// <returns>The counters.</returns>
+	ThreadCounters &getThreadCounters()
+	{
+		thread_local ThreadCounters counters;
+
+		if (counters.openAmount > 0)
+		{
+			available.store(true, std::memory_order_relaxed);
+		}
+
+		return counters;
+	}
+#endif
+}
+
+/// <summary>
+/// Reset every total to 0.
+/// </summary>
+void PerfCounterTotals::reset()
+{
+	cycles.store(0);
+	instructions.store(0);
+	cacheMisses.store(0);
+	branchMisses.store(0);
+	contextSwitches.store(0);
+	scopes.store(0);
+}
+
+/// <summary>
+/// Add a scope's counts. Any thread can call this.
+/// </summary>
+/// <param name="values">The counts to add.</param>
+void PerfCounterTotals::add(const PerfCounterValues &values)
+{
+	cycles.fetch_add(values.cycles, std::memory_order_relaxed);
+	instructions.fetch_add(values.instructions, std::memory_order_relaxed);
+	cacheMisses.fetch_add(values.cacheMisses, std::memory_order_relaxed);
+	branchMisses.fetch_add(values.branchMisses, std::memory_order_relaxed);
+	contextSwitches.fetch_add(values.contextSwitches, std::memory_order_relaxed);
+	scopes.fetch_add(values.scopes, std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Get the totals.
+/// </summary>
+/// <returns>The totals.</returns>
+PerfCounterValues PerfCounterTotals::get() const
+{
+	PerfCounterValues values;
+
+	values.cycles = cycles.load();
+	values.instructions = instructions.load();
+	values.cacheMisses = cacheMisses.load();
+	values.branchMisses = branchMisses.load();
+	values.contextSwitches = contextSwitches.load();
+	values.scopes = scopes.load();
+
+	return values;
+}
+
+/// <summary>
+/// Turn counting on or off for every PERF_SCOPE.
+/// </summary>
+/// <param name="enabled">True to count.</param>
+void PerfCounters::setEnabled(bool enabled)
+{
+	countingEnabled.store(enabled);
+}
+
+/// <summary>
+/// Check whether PERF_SCOPEs are counting.
+/// </summary>
+/// <returns>True while counting is turned on.</returns>
+bool PerfCounters::isEnabled()
+{
+	return countingEnabled.load(std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Check whether any thread has managed to open hardware counters.
+/// Until a scope has run with counting turned on, this is false.
+/// </summary>
+/// <returns>True if hardware counters are working.</returns>
+bool PerfCounters::isAvailable()
+{
+#ifdef __linux__
+	return available.load(std::memory_order_relaxed);
+#else
+	return false;
+#endif
+}
+
+/// <summary>
+/// Read the calling thread's counters.
+/// </summary>
+/// <returns>The counters so far. Anything that couldn't be read is 0.</returns>
+PerfSample PerfCounters::read()
+{
+	PerfSample sample;
+
+#ifdef __linux__
+	ThreadCounters &counters = getThreadCounters();
+
+	if (counters.leader >= 0)
+	{
+		// nr, time enabled, time running, then a value and ID for each counter
+		std::uint64_t buffer[3 + 2 * COUNTER_AMOUNT] = {};
+
+		if (::read(counters.leader, buffer, sizeof(buffer)) > 0)
+		{
+			std::uint64_t amount = buffer[0];
+			sample.timeEnabled = buffer[1];
+			sample.timeRunning = buffer[2];
+
+			// Match each value to its counter by ID, as any counter that
+			// failed to open is missing from the group
+			for (std::uint64_t i = 0; i < amount && i < COUNTER_AMOUNT; ++i)
+			{
+				std::uint64_t value = buffer[3 + i * 2];
+				std::uint64_t id = buffer[4 + i * 2];
+
+				for (int c = 0; c < COUNTER_AMOUNT; ++c)
+				{
+					if (counters.fds[c] >= 0 && counters.ids[c] == id)
+					{
+						sample.values[c] = value;
+					}
+				}
+			}
+		}
+	}
+
+	rusage usage;
+
+	if (getrusage(RUSAGE_THREAD, &usage) == 0)
+	{
+		sample.contextSwitches = usage.ru_nvcsw + usage.ru_nivcsw;
+	}
+#endif
+
+	return sample;
+}
+
+/// <summary>
+/// Work out the counts between two samples taken on the same thread.
+/// </summary>
+/// <param name="start">The sample at the start of the scope.</param>
+/// <param name="end">The sample at the end of the scope.</param>
+/// <returns>The counts for one scope.</returns>
+PerfCounterValues PerfCounters::difference(const PerfSample &start, const PerfSample &end)
+{
+	PerfCounterValues values;
+
+	std::uint64_t enabledTime = end.timeEnabled - start.timeEnabled;
+	std::uint64_t runningTime = end.timeRunning - start.timeRunning;
+
+	// Scale up for the time the counters weren't on the PMU
+	double scale = runningTime > 0 ? static_cast<double>(enabledTime) / runningTime : 1.0;
+
+	auto scaled = [&](int i)
+	{
+		return static_cast<std::uint64_t>((end.values[i] - start.values[i]) * scale);
+	};
+
+	values.cycles = scaled(0);
+	values.instructions = scaled(1);
+	values.cacheMisses = scaled(2);
+	values.branchMisses = scaled(3);
+	values.contextSwitches = end.contextSwitches - start.contextSwitches;
+	values.scopes = 1;
+
+	return values;
+}
@@ -0,0 +1,160 @@
+#include "PoolStatsPanel.h"
+
+/// <summary>
+/// PoolStatsPanel constructor.
+/// </summary>
+/// <param name="threadPool">The pool to watch.</param>
+PoolStatsPanel::PoolStatsPanel(ThreadPool &threadPool) : threadPool(&threadPool)
+{
+
+}
+
+/// <summary>
+/// PoolStatsPanel destructor.
+/// </summary>
+PoolStatsPanel::~PoolStatsPanel()
+{
+	threadPool->stopHighWaterWatch(highWaterWatch);
+}
+
+/// <summary>
+/// Take a snapshot of the pool's counters at the start of a run, and start
+/// watching the queue depths. A run that was never ended is dropped.
+/// </summary>
+void PoolStatsPanel::begin()
+{
+	threadPool->stopHighWaterWatch(highWaterWatch);
+	highWaterWatch = threadPool->startHighWaterWatch();
+	startStats = threadPool->getStats();
+	startTimepoint = std::chrono::steady_clock::now();
+}
+
+/// <summary>
+/// Work out what each thread did since begin() was called.
+/// </summary>
+void PoolStatsPanel::end()
+{
+	std::vector<ThreadStats> endStats = threadPool->getStats();
+	std::vector<std::uint64_t> highWater = threadPool->stopHighWaterWatch(highWaterWatch);
+	highWaterWatch = -1;
+
+	runNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTimepoint).count());
+
+	runStats.resize(endStats.size());
+
+	for (std::size_t i = 0; i < endStats.size() && i < startStats.size(); ++i)
+	{
+		runStats[i].jobsExecuted = endStats[i].jobsExecuted - startStats[i].jobsExecuted;
+		runStats[i].jobsStolen = endStats[i].jobsStolen - startStats[i].jobsStolen;
+		runStats[i].busyNs = endStats[i].busyNs - startStats[i].busyNs;
+		runStats[i].parkedNs = endStats[i].parkedNs - startStats[i].parkedNs;
+		runStats[i].waitNs = endStats[i].waitNs - startStats[i].waitNs;
+		runStats[i].lockWaitNs = endStats[i].lockWaitNs - startStats[i].lockWaitNs;
+		runStats[i].queueHighWater = i < highWater.size() ? highWater[i] : 0;
+	}
+}
+
+/// <summary>
+/// Draw the results of the last run as a table, one row per thread.
+/// Times are shown as a share of the whole run.
+/// </summary>
+void PoolStatsPanel::handleUI()
+{
+	ImGui::PushID(this);
+
+	ImGui::SeparatorText("Thread Pool");
+
+	ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+	if (runStats.empty() || runNs <= 0.0)
+	{
+		ImGui::Text("Run the test to see how the\nthreads were used");
+		ImGui::Dummy(ImVec2(0.0f, 8.0f));
+		ImGui::PopID();
+
+		return;
+	}
+
+	std::uint64_t totalJobs = 0;
+	std::uint64_t totalSteals = 0;
+	std::uint64_t totalBusyNs = 0;
+
+	for (auto &stats : runStats)
+	{
+		totalJobs += stats.jobsExecuted;
+		totalSteals += stats.jobsStolen;
+		totalBusyNs += stats.busyNs;
+	}
+
+	// Every worker plus the thread that waited on the run
+	double utilisation = 100.0 * totalBusyNs / (runNs * runStats.size());
+
+	ImGui::Text("Jobs: %llu  Steals: %llu", static_cast<unsigned long long>(totalJobs), static_cast<unsigned long long>(totalSteals));
+	ImGui::Text("Utilisation: %.1f%%", utilisation);
+
+	ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+	ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit;
+
+	if (ImGui::BeginTable("Stats", 7, flags))
+	{
+		ImGui::TableSetupColumn("Thread");
+		ImGui::TableSetupColumn("Jobs");
+		ImGui::TableSetupColumn("Stolen");
+		ImGui::TableSetupColumn("Busy");
+		ImGui::TableSetupColumn("Idle");
+		ImGui::TableSetupColumn("Lock Wait");
+		ImGui::TableSetupColumn("Queue Peak");
+		ImGui::TableHeadersRow();
+
+		for (std::size_t i = 0; i < runStats.size(); ++i)
+		{
+			const ThreadStats &stats = runStats[i];
+			bool isWorker = i + 1 < runStats.size();
+
+			ImGui::TableNextRow();
+
+			ImGui::TableNextColumn();
+
+			if (isWorker)
+			{
+				ImGui::Text("Worker %zu", i);
+			}
+			else
+			{
+				// Threads outside the pool, usually the main thread
+				ImGui::Text("Caller");
+			}
+
+			// Workers are idle while parked, callers while waiting on their batch
+			double idleNs = static_cast<double>(isWorker ? stats.parkedNs : stats.waitNs);
+
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", static_cast<unsigned long long>(stats.jobsExecuted));
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", static_cast<unsigned long long>(stats.jobsStolen));
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f%%", 100.0 * stats.busyNs / runNs);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f%%", 100.0 * idleNs / runNs);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3fms", stats.lockWaitNs * 1e-6);
+			ImGui::TableNextColumn();
+
+			if (isWorker)
+			{
+				ImGui::Text("%llu", static_cast<unsigned long long>(stats.queueHighWater));
+			}
+			else
+			{
+				ImGui::Text("-");
+			}
+		}
+
+		ImGui::EndTable();
+	}
+
+	ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+	ImGui::PopID();
+}
@@ -0,0 +1,271 @@
+#include "Profiler.h"
+
+#include <fstream>
+#include <iomanip>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <mutex>
+
+namespace
+{
+	// Zones each thread can hold in one capture
+	const std::size_t BUFFER_CAPACITY = 1 << 16;
+
+	struct ProfileEvent
+	{
+		const char *label;
+		Timer::Clock::time_point start;
+		Timer::Clock::time_point end;
+	};
+
+	// Only the thread that owns a buffer writes to it. It publishes each
+	// event by bumping count afterwards, so a reader never sees half an event
+	struct ThreadBuffer
+	{
+		std::unique_ptr<ProfileEvent[]> events{ new ProfileEvent[BUFFER_CAPACITY] };
+		std::atomic<std::size_t> count{ 0 };
+		std::atomic<std::size_t> dropped{ 0 };
+		std::atomic<std::uint32_t> capture{ 0 };
+		std::size_t id = 0;
+		std::string name;
+	};
+
+	// Buffers are never freed, so a capture can still be saved after the
+	// threads that wrote it have finished
+	std::mutex registryMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+	std::atomic<bool> capturing{ false };
+	std::atomic<std::uint32_t> currentCapture{ 0 };
+	Timer::Clock::time_point captureStart;
+
+	thread_local ThreadBuffer *threadBuffer = nullptr;
+
+	/// <summary>
+	/// Get the calling thread's buffer, creating it the first time.
+	/// </summary>
+	/// <returns>The buffer.</returns>
+	ThreadBuffer &getThreadBuffer()
+	{
+		if (threadBuffer == nullptr)
+		{
+			std::unique_lock<std::mutex> lock{ registryMutex };
+
+			buffers.push_back(std::make_unique<ThreadBuffer>());
+			threadBuffer = buffers.back().get();
+			threadBuffer->id = buffers.size();
+			threadBuffer->name = "Thread " + std::to_string(threadBuffer->id);
+		}
+
+		return *threadBuffer;
+	}
+
+	/// <summary>
+	/// Get the number of events a buffer holds for the current capture.
+	/// </summary>
+	/// <param name="buffer">The buffer to check.</param>
+	/// <returns>The number of events, or 0 if they're from an older capture.</returns>
+	std::size_t getCaptureCount(const ThreadBuffer &buffer)
+	{
+		if (buffer.capture.load(std::memory_order_acquire) != currentCapture.load())
+		{
+			return 0;
+		}
+
+		return buffer.count.load(std::memory_order_acquire);
+	}
+
+	/// <summary>
+	/// Write a string as a JSON string, escaping anything that needs it.
+	/// </summary>
+	/// <param name="file">The file to write to.</param>
+	/// <param name="text">The string to write.</param>
+	void writeJsonString(std::ofstream &file, const char *text)
+	{
+		file << '"';
+
+		for (const char *c = text; *c != '\0'; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+			{
+				file << '\\';
+			}
+
+			file << *c;
+		}
+
+		file << '"';
+	}
+
+	/// <summary>
+	/// Get the microseconds between the start of the capture and a time point.
+	/// </summary>
+	/// <param name="timepoint">The time point.</param>
+	/// <returns>The time in microseconds.</returns>
+	double toMicroseconds(Timer::Clock::time_point timepoint)
+	{
+		return std::chrono::duration<double, std::micro>(timepoint - captureStart).count();
+	}
+}
+
+/// <summary>
+/// Start a new capture. Zones from any earlier capture are thrown away.
+/// </summary>
+void Profiler::startCapture()
+{
+	captureStart = Timer::Clock::now();
+	currentCapture.fetch_add(1);
+	capturing.store(true);
+}
+
+/// <summary>
+/// Stop recording zones. Zones that have already started are still recorded.
+/// </summary>
+void Profiler::stopCapture()
+{
+	capturing.store(false);
+}
+
+/// <summary>
+/// Check whether zones are being recorded.
+/// </summary>
+/// <returns>True while a capture is running.</returns>
+bool Profiler::isCapturing()
+{
+	return capturing.load(std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Save the current capture as a Chrome trace.
+/// Each thread gets its own row, named with setThreadName() if it was given one.
+/// </summary>
+/// <param name="path">The file to write.</param>
+/// <returns>True if the file was written.</returns>
+bool Profiler::saveChromeTrace(const std::string &path)
+{
+	std::ofstream file(path);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	bool first = true;
+
+	std::unique_lock<std::mutex> lock{ registryMutex };
+
+	for (auto &buffer : buffers)
+	{
+		// Name the thread's row
+		file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id << ",\"args\":{\"name\":";
+		writeJsonString(file, buffer->name.c_str());
+		file << "}}";
+
+		first = false;
+
+		std::size_t count = getCaptureCount(*buffer);
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			const ProfileEvent &event = buffer->events[i];
+
+			file << ",\n{\"name\":";
+			writeJsonString(file, event.label);
+			file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+				<< ",\"ts\":" << toMicroseconds(event.start)
+				<< ",\"dur\":" << toMicroseconds(event.end) - toMicroseconds(event.start) << "}";
+		}
+	}
+
+	file << "\n]}\n";
+
+	return file.good();
+}
+
+/// <summary>
+/// Get the number of zones recorded in the current capture.
+/// </summary>
+/// <returns>The number of zones.</returns>
+std::size_t Profiler::getEventAmount()
+{
+	std::unique_lock<std::mutex> lock{ registryMutex };
+
+	std::size_t amount = 0;
+
+	for (auto &buffer : buffers)
+	{
+		amount += getCaptureCount(*buffer);
+	}
+
+	return amount;
+}
+
+/// <summary>
+/// Get the number of zones lost in the current capture because a thread's buffer was full.
+/// </summary>
+/// <returns>The number of zones dropped.</returns>
+std::size_t Profiler::getDroppedAmount()
+{
+	std::unique_lock<std::mutex> lock{ registryMutex };
+
+	std::size_t amount = 0;
+
+	for (auto &buffer : buffers)
+	{
+		if (buffer->capture.load(std::memory_order_acquire) == currentCapture.load())
+		{
+			amount += buffer->dropped.load(std::memory_order_relaxed);
+		}
+	}
+
+	return amount;
+}
+
+/// <summary>
+/// Name the calling thread's row in saved traces.
+/// </summary>
+/// <param name="name">The name to show.</param>
+void Profiler::setThreadName(const char *name)
+{
+	ThreadBuffer &buffer = getThreadBuffer();
+
+	std::unique_lock<std::mutex> lock{ registryMutex };
+	buffer.name = name;
+}
+
+/// <summary>
+/// Record a finished zone on the calling thread.
+/// The first zone a thread records in a new capture clears out its old ones.
+/// </summary>
+/// <param name="label">The zone name.</param>
+/// <param name="start">When the zone started.</param>
+/// <param name="end">When the zone finished.</param>
+void Profiler::record(const char *label, Timer::Clock::time_point start, Timer::Clock::time_point end)
+{
+	ThreadBuffer &buffer = getThreadBuffer();
+	std::uint32_t capture = currentCapture.load();
+
+	if (buffer.capture.load(std::memory_order_relaxed) != capture)
+	{
+		// The count is cleared before the buffer is marked as part of the new
+		// capture, so a reader never pairs old events with the new capture
+		buffer.count.store(0, std::memory_order_relaxed);
+		buffer.dropped.store(0, std::memory_order_relaxed);
+		buffer.capture.store(capture, std::memory_order_release);
+	}
+
+	std::size_t count = buffer.count.load(std::memory_order_relaxed);
+
+	if (count == BUFFER_CAPACITY)
+	{
+		buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	buffer.events[count] = { label, start, end };
+	buffer.count.store(count + 1, std::memory_order_release);
+}
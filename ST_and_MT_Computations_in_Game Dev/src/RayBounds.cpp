@@ -0,0 +1,311 @@
+#include "RayBounds.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Added to every sphere's radius, relative to how far away it is, to cover rounding in the rays
+    const float RADIUS_MARGIN = 1e-4f;
+
+    /// <summary>
+    /// Check whether a box has had anything added to it.
+    /// </summary>
+    /// <param name="box">The box.</param>
+    /// <returns>True if it holds no points.</returns>
+    bool isEmpty(const AABB &box)
+    {
+        return box.min.x > box.max.x;
+    }
+
+    /// <summary>
+    /// Get the middle of a box.
+    /// </summary>
+    /// <param name="box">The box.</param>
+    /// <returns>The middle point.</returns>
+    Vec3f getCenter(const AABB &box)
+    {
+        return (box.min + box.max) * 0.5f;
+    }
+
+    /// <summary>
+    /// Get the distance from the middle of a box to its corners.
+    /// </summary>
+    /// <param name="box">The box.</param>
+    /// <returns>Half the length of its diagonal.</returns>
+    float getHalfDiagonal(const AABB &box)
+    {
+        return (box.max - box.min).length() * 0.5f;
+    }
+
+    /// <summary>
+    /// Check whether a sphere could touch a cone: every ray from one point that is
+    /// within some angle of an axis, up to some length.
+    /// </summary>
+    /// <param name="apex">The point the cone starts at.</param>
+    /// <param name="axis">The cone's axis, normalized.</param>
+    /// <param name="angle">The largest angle between a ray and the axis, in radians.</param>
+    /// <param name="length">How far the rays go.</param>
+    /// <param name="center">The center of the sphere.</param>
+    /// <param name="radius">The radius of the sphere.</param>
+    /// <returns>False only if the sphere is definitely outside the cone.</returns>
+    bool coneMayHit(const Vec3f &apex, const Vec3f &axis, float angle, float length, const Vec3f &center, float radius)
+    {
+        Vec3f offset = center - apex;
+        float distance = offset.length();
+
+        radius += RADIUS_MARGIN * distance;
+
+        if (distance <= radius)
+        {
+            return true;
+        }
+
+        if (distance - radius > length)
+        {
+            return false;
+        }
+
+        float cosine = std::max(-1.0f, std::min(1.0f, axis.dot(offset) / distance));
+
+        return std::acos(cosine) <= angle + std::asin(radius / distance) + RADIUS_MARGIN;
+    }
+
+    /// <summary>
+    /// Check whether a sphere could touch a bundle of rays, one axis at a time.
+    /// On each axis, a ray's point at distance t lies between the lowest origin plus
+    /// t times the lowest direction and the highest origin plus t times the highest
+    /// direction. Each axis limits the distances at which that range can reach the
+    /// sphere's box, and a ray can only touch the sphere if some distance suits all three.
+    /// </summary>
+    /// <param name="bundle">The rays.</param>
+    /// <param name="center">The center of the sphere.</param>
+    /// <param name="radius">The radius of the sphere.</param>
+    /// <returns>False only if the sphere is definitely outside the bundle.</returns>
+    bool slabsMayHit(const RayBundle &bundle, const Vec3f &center, float radius)
+    {
+        float tMin = 0.0f;
+        float tMax = bundle.maxLength;
+
+        radius += RADIUS_MARGIN * ((center - bundle.origins.min).length() + (center - bundle.origins.max).length());
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const float *c = &center.x;
+            const float *originMin = &bundle.origins.min.x;
+            const float *originMax = &bundle.origins.max.x;
+            const float *dirMin = &bundle.directions.min.x;
+            const float *dirMax = &bundle.directions.max.x;
+
+            // How far along this axis the sphere's box is from the origins
+            float low = c[axis] - radius - originMax[axis];
+            float high = c[axis] + radius - originMin[axis];
+
+            // The lowest point has to reach no further than high
+            if (dirMin[axis] > 0)
+            {
+                tMax = std::min(tMax, high / dirMin[axis]);
+            }
+            else if (dirMin[axis] < 0)
+            {
+                tMin = std::max(tMin, high / dirMin[axis]);
+            }
+            else if (high < 0)
+            {
+                return false;
+            }
+
+            // The highest point has to reach at least as far as low
+            if (dirMax[axis] > 0)
+            {
+                tMin = std::max(tMin, low / dirMax[axis]);
+            }
+            else if (dirMax[axis] < 0)
+            {
+                tMax = std::min(tMax, low / dirMax[axis]);
+            }
+            else if (low > 0)
+            {
+                return false;
+            }
+        }
+
+        return tMin <= tMax;
+    }
+}
+
+/// <summary>
+/// Add a ray to the bundle.
+/// </summary>
+/// <param name="origin">The origin point of the ray.</param>
+/// <param name="dir">The direction of the ray, normalized.</param>
+/// <param name="length">How far the ray went before hitting something, INFINITY if it didn't.</param>
+void RayBundle::add(const Vec3f &origin, const Vec3f &dir, float length)
+{
+    origins.grow(origin);
+    directions.grow(dir);
+    maxLength = std::max(maxLength, length);
+}
+
+/// <summary>
+/// Add every ray in another bundle to this one.
+/// </summary>
+/// <param name="bundle">The other bundle.</param>
+void RayBundle::merge(const RayBundle &bundle)
+{
+    origins.grow(bundle.origins);
+    directions.grow(bundle.directions);
+    maxLength = std::max(maxLength, bundle.maxLength);
+}
+
+/// <summary>
+/// Check whether any ray in the bundle could have touched a sphere.
+/// The rays are treated as one cone from the middle of their origins,
+/// wide enough to hold every direction, with the sphere grown by the
+/// distance from the middle to the furthest origin. That is close for
+/// rays that start near each other, but loose when the origins spread
+/// over a large area, like reflections off the ground, so they are also
+/// tested one axis at a time. Either test can rule the sphere out.
+/// </summary>
+/// <param name="center">The center of the sphere.</param>
+/// <param name="radius">The radius of the sphere.</param>
+/// <returns>False only if no ray in the bundle touched the sphere.</returns>
+bool RayBundle::mayHit(const Vec3f &center, float radius) const
+{
+    if (isEmpty(origins))
+    {
+        return false;
+    }
+
+    if (!slabsMayHit(*this, center, radius))
+    {
+        return false;
+    }
+
+    Vec3f axis = getCenter(directions);
+
+    if (axis.length2() == 0)
+    {
+        return true;
+    }
+
+    axis.normalize();
+
+    // The directions all lie inside the box, and a cone narrower than a half
+    // space holds the whole box as long as it holds the box's corners
+    float minCosine = 1.0f;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        Vec3f corner(i & 1 ? directions.max.x : directions.min.x, i & 2 ? directions.max.y : directions.min.y, i & 4 ? directions.max.z : directions.min.z);
+        float cornerLength = corner.length();
+
+        if (cornerLength == 0)
+        {
+            return true;
+        }
+
+        minCosine = std::min(minCosine, axis.dot(corner) / cornerLength);
+    }
+
+    if (minCosine <= 0)
+    {
+        return true;
+    }
+
+    return coneMayHit(getCenter(origins), axis, std::acos(minCosine), maxLength, center, radius + getHalfDiagonal(origins));
+}
+
+/// <summary>
+/// Forget every ray.
+/// </summary>
+void RayBounds::clear()
+{
+    *this = RayBounds();
+}
+
+/// <summary>
+/// Add every ray from other bounds to these.
+/// </summary>
+/// <param name="bounds">The other bounds.</param>
+void RayBounds::merge(const RayBounds &bounds)
+{
+    for (int i = 0; i < DEPTHS; ++i)
+    {
+        bounces[i].merge(bounds.bounces[i]);
+    }
+
+    shadows.merge(bounds.shadows);
+}
+
+/// <summary>
+/// Add a reflection or refraction ray.
+/// </summary>
+/// <param name="depth">How many bounces it took to spawn the ray, at least 1.</param>
+/// <param name="origin">The origin point of the ray.</param>
+/// <param name="dir">The direction of the ray, normalized.</param>
+/// <param name="length">How far the ray went before hitting something, INFINITY if it didn't.</param>
+void RayBounds::addBounce(int depth, const Vec3f &origin, const Vec3f &dir, float length)
+{
+    bounces[std::min(depth, DEPTHS) - 1].add(origin, dir, length);
+}
+
+/// <summary>
+/// Add a shadow ray. Shadow rays don't stop at the light, so they have no length.
+/// </summary>
+/// <param name="origin">The origin point of the ray.</param>
+/// <param name="dir">The direction of the ray, towards a light's center.</param>
+void RayBounds::addShadow(const Vec3f &origin, const Vec3f &dir)
+{
+    shadows.add(origin, dir, INFINITY);
+}
+
+/// <summary>
+/// Check whether any ray could have touched a sphere.
+/// Shadow rays from a box of points to a light also all lie in a cone
+/// from the light that is just wide enough to hold the box. They don't
+/// stop at the light, so past it they lie in the same cone pointing away.
+/// </summary>
+/// <param name="center">The center of the sphere.</param>
+/// <param name="radius">The radius of the sphere.</param>
+/// <param name="lights">The centers of the lights the shadow rays went to.</param>
+/// <returns>False only if no ray touched the sphere.</returns>
+bool RayBounds::mayHit(const Vec3f &center, float radius, const std::vector<Vec3f> &lights) const
+{
+    for (int i = 0; i < DEPTHS; ++i)
+    {
+        if (bounces[i].mayHit(center, radius))
+        {
+            return true;
+        }
+    }
+
+    if (!shadows.mayHit(center, radius))
+    {
+        return false;
+    }
+
+    Vec3f pointsCenter = getCenter(shadows.origins);
+    float pointsRadius = getHalfDiagonal(shadows.origins);
+
+    for (const Vec3f &light : lights)
+    {
+        Vec3f axis = pointsCenter - light;
+        float distance = axis.length();
+
+        if (distance <= pointsRadius)
+        {
+            return true;
+        }
+
+        axis = axis * (1.0f / distance);
+        float angle = std::asin(pointsRadius / distance);
+
+        if (coneMayHit(light, axis, angle, distance + pointsRadius, center, radius) || coneMayHit(light, -axis, angle, INFINITY, center, radius))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,1223 @@
+#include "RayScene.h"
+
+#include <cstdlib>
+#include <random>
+
+namespace
+{
+    /// <summary>
+    /// Get a random looking offset for one of a pixel's samples. It's worked out
+    /// from the pixel and sample rather than drawn from a generator, so rendering
+    /// the same scene again gives exactly the same image.
+    /// </summary>
+    /// <param name="x">The pixel's X coordinate.</param>
+    /// <param name="y">The pixel's Y coordinate.</param>
+    /// <param name="sample">Which of the pixel's samples it is.</param>
+    /// <param name="jitterX">Set to the offset across, from 0 to 1.</param>
+    /// <param name="jitterY">Set to the offset down, from 0 to 1.</param>
+    void getJitter(int x, int y, int sample, float &jitterX, float &jitterY)
+    {
+        std::uint32_t hash = static_cast<std::uint32_t>(x) * 73856093u ^ static_cast<std::uint32_t>(y) * 19349663u ^ static_cast<std::uint32_t>(sample) * 83492791u;
+
+        hash ^= hash >> 16;
+        hash *= 0x7feb352du;
+        hash ^= hash >> 15;
+        hash *= 0x846ca68bu;
+        hash ^= hash >> 16;
+
+        jitterX = (hash & 0xFFFF) / 65536.0f;
+        jitterY = (hash >> 16) / 65536.0f;
+    }
+
+    /// <summary>
+    /// Turn part of a colour into the value the pixel array holds.
+    /// </summary>
+    /// <param name="value">The red, green or blue part of the colour.</param>
+    /// <returns>The value from 0 to 255.</returns>
+    uint8_t toByte(float value)
+    {
+        return (uint8_t)(std::min(1.0f, value) * 255);
+    }
+}
+
+/// <summary>
+/// RayScene constructor.
+/// Sets up the demo scene.
+/// </summary>
+RayScene::RayScene()
+{
+    // This sphere acts as the ground
+    spheres.push_back(Sphere(Vec3f(0.0, -10000, -5), 10000, Vec3f(0.149, 0.509, 0.192), 1, 0, 0));
+
+    // Some other spheres
+    spheres.push_back(Sphere(Vec3f(-3.0, 0.4, -10.0), 0.4, Vec3f(0.835, 0.443, 0.125), 0.1, 1, 0));
+    spheres.push_back(Sphere(Vec3f(-2.3, 0.2, -15.0), 0.2, Vec3f(0.713, 0.227, 0.631), 0.2, 1, 0));
+    spheres.push_back(Sphere(Vec3f(0.2, 2.3, -24.0), 2.3, Vec3f(0.721, 0.721, 0.721), 1, 1, 0));
+    spheres.push_back(Sphere(Vec3f(14.1, 6.0, -53.0), 6.0, Vec3f(0.835, 0.443, 0.125), 0.1, 0.7, 0));
+    spheres.push_back(Sphere(Vec3f(-59.1, 24.0, -204.0), 24.0, Vec3f(0.443, 0.835, 0.125), 0.1, 0.7, 0));
+}
+
+/// <summary>
+/// RayScene destructor.
+/// </summary>
+RayScene::~RayScene()
+{
+
+}
+
+/// <summary>
+/// Build the BVH and the list of lights from the spheres.
+/// This must be called whenever spheres are added, removed or edited.
+/// </summary>
+void RayScene::build()
+{
+    bvh.build(spheres);
+    bins.ready = false;
+    lights.clear();
+
+    for (int i = 0; i < static_cast<int>(spheres.size()); ++i)
+    {
+        if (spheres[i].emissionColour.x > 0)
+        {
+            lights.push_back(i);
+        }
+    }
+}
+
+/// <summary>
+/// Add a sphere to the end of the scene.
+/// </summary>
+/// <param name="sphere">The sphere.</param>
+void RayScene::addSphere(const Sphere &sphere)
+{
+    spheres.push_back(sphere);
+    bvh.insert(spheres, static_cast<int>(spheres.size()) - 1);
+    bins.ready = false;
+
+    if (sphere.emissionColour.x > 0)
+    {
+        lights.push_back(static_cast<int>(spheres.size()) - 1);
+    }
+}
+
+/// <summary>
+/// Remove a sphere. To keep this quick, the last sphere is moved into
+/// its place rather than moving every sphere after it down by one.
+/// </summary>
+/// <param name="index">The sphere to remove.</param>
+void RayScene::removeSphere(int index)
+{
+    int last = static_cast<int>(spheres.size()) - 1;
+
+    bvh.remove(index);
+    bins.ready = false;
+
+    lights.erase(std::remove(lights.begin(), lights.end(), index), lights.end());
+    std::replace(lights.begin(), lights.end(), last, index);
+
+    spheres[index] = spheres[last];
+    spheres.pop_back();
+}
+
+/// <summary>
+/// Update the scene after a sphere has been edited.
+/// </summary>
+/// <param name="index">The sphere that was edited.</param>
+void RayScene::updateSphere(int index)
+{
+    bvh.refit(spheres, index);
+    bins.ready = false;
+
+    auto light = std::find(lights.begin(), lights.end(), index);
+    bool isLight = spheres[index].emissionColour.x > 0;
+
+    if (isLight && light == lights.end())
+    {
+        lights.push_back(index);
+    }
+    else if (!isLight && light != lights.end())
+    {
+        lights.erase(light);
+    }
+}
+
+/// <summary>
+/// Add lots of small random spheres sitting on the ground in front of the camera,
+/// and a light to see them by. Call build() afterwards.
+/// </summary>
+/// <param name="amount">The number of spheres to add.</param>
+/// <param name="seed">The random seed, so the same scene can be made again.</param>
+void RayScene::scatterSpheres(int amount, unsigned int seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    spheres.reserve(spheres.size() + amount);
+
+    for (int i = 0; i < amount; ++i)
+    {
+        float radius = 0.05f + unit(random) * 0.25f;
+        float depth = 5.0f + unit(random) * 195.0f;
+
+        // Spread further apart the further away they are, to fill the view
+        Vec3f center(position(random) * depth * 0.6f, radius, -depth);
+        Vec3f colour(unit(random), unit(random), unit(random));
+
+        // Most are diffuse, a few are glass or mirrors
+        float material = unit(random);
+        float reflection = material < 0.1f ? 1.0f : 0.0f;
+        float transparency = material < 0.05f ? 0.8f : 0.0f;
+
+        spheres.push_back(Sphere(center, radius, colour, reflection, transparency, 0));
+    }
+
+    // A light high above them all, as the diffuse spheres would be black without one
+    if (amount > 0)
+    {
+        spheres.push_back(Sphere(Vec3f(0.0f, 150.0f, -50.0f), 5.0f, Vec3f(0.0f), 0, 0, Vec3f(1.5f)));
+    }
+}
+
+/// <summary>
+/// Get the BVH, as of the last call to build().
+/// </summary>
+/// <returns>The BVH.</returns>
+const BVH &RayScene::getBVH() const
+{
+    return bvh;
+}
+
+/// <summary>
+/// Get the spheres that give off light.
+/// </summary>
+/// <returns>Their indices.</returns>
+const std::vector<int> &RayScene::getLights() const
+{
+    return lights;
+}
+
+/// <summary>
+/// Sort the spheres into bins, one for each 8x8 block of pixels, by which
+/// blocks' camera rays could hit them. Bins covered by more than
+/// MAX_BIN_SPHERES spheres are left empty and marked to use the BVH.
+/// This must be called again after the spheres, camera or image size
+/// change, or camera rays go back to using the BVH until it is.
+/// </summary>
+/// <param name="renderW">The width of the image.</param>
+/// <param name="renderH">The height of the image.</param>
+void RayScene::binSpheres(int renderW, int renderH)
+{
+    if (bins.ready && bins.renderW == renderW && bins.renderH == renderH && bins.rayOrigin == rayOrigin && bins.fov == fov)
+    {
+        return;
+    }
+
+    int sphereAmount = static_cast<int>(spheres.size());
+    int rows = (renderH + PACKET_SIZE - 1) / PACKET_SIZE;
+
+    bins.columns = (renderW + PACKET_SIZE - 1) / PACKET_SIZE;
+    bins.counts.assign(bins.columns * rows, 0);
+    bins.starts.resize(bins.columns * rows);
+
+    // Each sphere's first and last bins across and down
+    std::vector<sf::Vector2i> firstBins(sphereAmount);
+    std::vector<sf::Vector2i> endBins(sphereAmount);
+
+    for (int i = 0; i < sphereAmount; ++i)
+    {
+        sf::Vector2i pixTL;
+        sf::Vector2i pixBR;
+        getFootprint(spheres[i], renderW, renderH, pixTL, pixBR);
+
+        if (pixTL.x >= pixBR.x || pixTL.y >= pixBR.y)
+        {
+            firstBins[i] = endBins[i] = { 0, 0 };
+            continue;
+        }
+
+        firstBins[i] = { pixTL.x / PACKET_SIZE, pixTL.y / PACKET_SIZE };
+        endBins[i] = { (pixBR.x - 1) / PACKET_SIZE + 1, (pixBR.y - 1) / PACKET_SIZE + 1 };
+
+        for (int y = firstBins[i].y; y < endBins[i].y; ++y)
+        {
+            for (int x = firstBins[i].x; x < endBins[i].x; ++x)
+            {
+                bins.counts[y * bins.columns + x]++;
+            }
+        }
+    }
+
+    // Crowded bins get no room, so most of the spheres far away are never copied
+    int total = 0;
+
+    for (std::size_t bin = 0; bin < bins.counts.size(); ++bin)
+    {
+        if (bins.counts[bin] > MAX_BIN_SPHERES)
+        {
+            bins.counts[bin] = -1;
+        }
+
+        bins.starts[bin] = total;
+        total += std::max(bins.counts[bin], 0);
+        bins.counts[bin] = std::min(bins.counts[bin], 0);
+    }
+
+    // Filling each bin counts it back up, in sphere order
+    bins.spheres.resize(total);
+
+    for (int i = 0; i < sphereAmount; ++i)
+    {
+        for (int y = firstBins[i].y; y < endBins[i].y; ++y)
+        {
+            for (int x = firstBins[i].x; x < endBins[i].x; ++x)
+            {
+                int bin = y * bins.columns + x;
+
+                if (bins.counts[bin] >= 0)
+                {
+                    bins.spheres.set(bins.starts[bin] + bins.counts[bin]++, spheres[i], i);
+                }
+            }
+        }
+    }
+
+    bins.renderW = renderW;
+    bins.renderH = renderH;
+    bins.rayOrigin = rayOrigin;
+    bins.fov = fov;
+    bins.ready = true;
+}
+
+/// <summary>
+/// Work out which pixels' camera rays could hit a sphere. The camera looks
+/// straight down -Z, so a sphere in front of it lands inside its bounding
+/// box's corners.
+/// </summary>
+/// <param name="sphere">The sphere.</param>
+/// <param name="renderW">The width of the image.</param>
+/// <param name="renderH">The height of the image.</param>
+/// <param name="pixTL">Set to the upper-left corner of the pixels.</param>
+/// <param name="pixBR">Set to the lower-right corner of the pixels, the whole image if the sphere reaches behind the camera.</param>
+void RayScene::getFootprint(const Sphere &sphere, int renderW, int renderH, sf::Vector2i &pixTL, sf::Vector2i &pixBR) const
+{
+    if (sphere.center.z + sphere.radius >= rayOrigin.z - 1e-3f)
+    {
+        pixTL = { 0, 0 };
+        pixBR = { renderW, renderH };
+
+        return;
+    }
+
+    float aspectRatio = static_cast<float>(renderW) / static_cast<float>(renderH);
+    float angle = std::tan(PI * 0.5f * fov / 180.0f);
+    float minX = INFINITY;
+    float minY = INFINITY;
+    float maxX = -INFINITY;
+    float maxY = -INFINITY;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        Vec3f corner = sphere.center + Vec3f(i & 1 ? sphere.radius : -sphere.radius, i & 2 ? sphere.radius : -sphere.radius, i & 4 ? sphere.radius : -sphere.radius);
+        Vec3f offset = corner - rayOrigin;
+
+        // Where the corner is on the image, in pixels, undoing the sums for camera rays
+        float x = (offset.x / -offset.z / (angle * aspectRatio) + 1) * 0.5f * renderW - 0.5f;
+        float y = (1 - offset.y / -offset.z / angle) * 0.5f * renderH - 0.5f;
+
+        minX = std::min(minX, x);
+        minY = std::min(minY, y);
+        maxX = std::max(maxX, x);
+        maxY = std::max(maxY, y);
+    }
+
+    // Round out, with a pixel to spare for rounding in the rays
+    pixTL = { std::clamp(static_cast<int>(std::floor(minX)) - 1, 0, renderW), std::clamp(static_cast<int>(std::floor(minY)) - 1, 0, renderH) };
+    pixBR = { std::clamp(static_cast<int>(std::ceil(maxX)) + 2, 0, renderW), std::clamp(static_cast<int>(std::ceil(maxY)) + 2, 0, renderH) };
+}
+
+/// <summary>
+/// Check whether a section of the image needs rendering again after some spheres
+/// were edited: if its last render didn't finish, if an edited sphere could cover
+/// its pixels, or if any of its rays could have gone near an edited sphere.
+/// </summary>
+/// <param name="pixTL">The coordinate of the upper-left corner of the section.</param>
+/// <param name="pixBR">The coordinate of the lower-right corner of the section.</param>
+/// <param name="finished">False if the section's last render didn't finish.</param>
+/// <param name="bounds">Where the section's rays went in its last render.</param>
+/// <param name="editedSpheres">Each edited sphere before and after the edit.</param>
+/// <param name="footprints">Each edited sphere's footprint, from RayScene::getFootprint().</param>
+/// <param name="lights">The centers of the lights the shadow rays went to.</param>
+/// <returns>True if the section could look different.</returns>
+bool isSectionDirty(sf::Vector2i pixTL, sf::Vector2i pixBR, bool finished, const RayBounds &bounds, const std::vector<Sphere> &editedSpheres, const std::vector<Footprint> &footprints, const std::vector<Vec3f> &lights)
+{
+    if (!finished)
+    {
+        return true;
+    }
+
+    for (std::size_t i = 0; i < editedSpheres.size(); ++i)
+    {
+        const Footprint &footprint = footprints[i];
+
+        if (pixTL.x < footprint.pixBR.x && footprint.pixTL.x < pixBR.x && pixTL.y < footprint.pixBR.y && footprint.pixTL.y < pixBR.y)
+        {
+            return true;
+        }
+
+        if (bounds.mayHit(editedSpheres[i].center, editedSpheres[i].radius, lights))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Mix utility function.
+/// </summary>
+/// <param name="a">First value to mix.</param>
+/// <param name="b">Second value to mix.</param>
+/// <param name="mix">Mix value.</param>
+/// <returns>The resulting mixed value.</returns>
+float RayScene::mix(const float &a, const float &b, const float &mix) const
+{
+	return b * mix + a * (1 - mix);
+}
+
+/// <summary>
+/// Find the point and surface normal where a ray hits a sphere. The normal is
+/// flipped to face back along the ray if the ray started inside the sphere.
+/// </summary>
+/// <param name="rayOrigin">The origin point of the ray.</param>
+/// <param name="rayDir">The direction of the ray.</param>
+/// <param name="tNear">The distance along the ray to the hit.</param>
+/// <param name="sphere">The sphere that was hit.</param>
+/// <param name="pHit">The point of intersection.</param>
+/// <param name="nHit">The normal at the intersection point.</param>
+/// <returns>True if the ray hit the inside of the sphere.</returns>
+bool RayScene::getHitPoint(const Vec3f &rayOrigin, const Vec3f &rayDir, float tNear, const Sphere &sphere, Vec3f &pHit, Vec3f &nHit) const
+{
+    pHit = rayOrigin + rayDir * tNear;
+    nHit = pHit - sphere.center;
+
+    nHit.normalize();
+
+    // If the normal and the view direction are not opposite to each other then
+    // reverse the normal direction. That also means we are inside the sphere
+    if (rayDir.dot(nHit) > 0)
+    {
+        nHit = -nHit;
+        return true;
+    }
+
+    return false;
+}
+
+/// <summary>
+/// This is the main trace function. It takes a ray as argument (defined by its origin
+/// and direction). We test if this ray intersects any of the geometry in the scene.
+/// If the ray intersects an object, we compute the intersection point, the normal
+/// at the intersection point, and shade this point using this information.
+/// The function returns a colour for the ray. If no intersection occurs, the background
+/// colour is returned.
+/// </summary>
+/// <param name="rayOrigin">The origin point of the ray.</param>
+/// <param name="rayDir">The direction of the ray.</param>
+/// <param name="depth">Depth of recursion.</param>
+/// <returns>The ray colour.</returns>
+Vec3f RayScene::trace(const Vec3f &rayOrigin, const Vec3f &rayDir, const int &depth) const
+{
+    std::vector<WaveRay> wave{ { rayOrigin, rayDir, Vec3f(1), 0, depth } };
+    std::vector<Vec3f> colours(1, Vec3f(0));
+
+    traceWaves(wave, colours, nullptr, nullptr);
+
+    return colours[0];
+}
+
+/// <summary>
+/// Trace rays and every reflection and refraction ray they spawn, one bounce at a time.
+/// Each wave's rays are sorted by the sphere they hit before shading, so rays shading the
+/// same material are handled together.
+/// </summary>
+/// <param name="wave">The rays to trace. It's left empty.</param>
+/// <param name="colours">The pixel colours, which each ray's colour is added to.</param>
+/// <param name="bounds">Where to record the rays traced, or nullptr.</param>
+/// <param name="shadowCache">The spheres that last blocked shadow rays, or nullptr to not use any.</param>
+void RayScene::traceWaves(std::vector<WaveRay> &wave, std::vector<Vec3f> &colours, RayBounds *bounds, ShadowCache *shadowCache) const
+{
+    std::vector<WaveRay> nextWave;
+    std::vector<float> tNear;
+    std::vector<int> hitIndex;
+    std::vector<std::uint64_t> order; // The sphere each ray hit (plus 1, so misses come first) above the ray's index
+
+    while (!wave.empty())
+    {
+        int amount = static_cast<int>(wave.size());
+
+        tNear.assign(amount, INFINITY);
+        hitIndex.assign(amount, -1);
+        order.resize(amount);
+
+        for (int i = 0; i < amount; ++i)
+        {
+            bvh.closestHit(wave[i].origin, wave[i].dir, tNear[i], hitIndex[i]);
+            order[i] = (static_cast<std::uint64_t>(hitIndex[i] + 1) << 32) | static_cast<std::uint64_t>(i);
+
+            if (bounds && wave[i].depth > 0)
+            {
+                bounds->addBounce(wave[i].depth, wave[i].origin, wave[i].dir, hitIndex[i] < 0 ? INFINITY : tNear[i]);
+            }
+        }
+
+        // Ties keep the wave's order, so each pixel adds its colours up in the same order every time
+        std::sort(order.begin(), order.end());
+
+        for (std::uint64_t key : order)
+        {
+            int i = static_cast<int>(key & 0xFFFFFFFF);
+            const WaveRay &ray = wave[i];
+
+            if (hitIndex[i] < 0)
+            {
+                colours[ray.pixel] += ray.weight * backgroundColour;
+                continue;
+            }
+
+            const Sphere &sphere = spheres[hitIndex[i]];
+            Vec3f pHit;
+            Vec3f nHit;
+            bool inside = getHitPoint(ray.origin, ray.dir, tNear[i], sphere, pHit, nHit);
+
+            shade(ray, hitIndex[i], pHit, nHit, inside, nullptr, 0, colours, nextWave, bounds, shadowCache);
+        }
+
+        wave.swap(nextWave);
+        nextWave.clear();
+    }
+}
+
+/// <summary>
+/// Find the cache slot for shadow rays from a surface to a light. If the slot
+/// belonged to another surface or light, it's handed over and emptied.
+/// </summary>
+/// <param name="shadowCache">The cache.</param>
+/// <param name="surface">The index of the sphere the shadow rays start on.</param>
+/// <param name="light">The light's place in the list of lights.</param>
+/// <returns>The sphere that last blocked the way, -1 if none has yet. It can be written to.</returns>
+int &RayScene::getCachedOccluder(ShadowCache &shadowCache, int surface, int light) const
+{
+    int slot = (surface * 31 + light) & (ShadowCache::SIZE - 1);
+
+    if (shadowCache.surfaces[slot] != surface || shadowCache.lights[slot] != light)
+    {
+        shadowCache.surfaces[slot] = surface;
+        shadowCache.lights[slot] = light;
+        shadowCache.occluders[slot] = -1;
+    }
+
+    return shadowCache.occluders[slot];
+}
+
+/// <summary>
+/// Check whether anything is in the way of a shadow ray. The sphere that last
+/// blocked a ray from the same surface to the same light is tried first, with the
+/// same test the BVH uses, so the answer is the same whether or not it's cached.
+/// </summary>
+/// <param name="shadowOrigin">Where the shadow ray starts, just off the surface.</param>
+/// <param name="lightDirection">The direction to the light's center, normalized.</param>
+/// <param name="surface">The index of the sphere the shadow ray starts on.</param>
+/// <param name="light">The light's place in the list of lights.</param>
+/// <param name="shadowCache">The spheres that last blocked shadow rays, or nullptr to go straight to the BVH.</param>
+/// <returns>True if any sphere other than the light itself is in the way.</returns>
+bool RayScene::isShadowed(const Vec3f &shadowOrigin, const Vec3f &lightDirection, int surface, int light, ShadowCache *shadowCache) const
+{
+    int hitIndex = -1;
+
+    if (!shadowCache)
+    {
+        return bvh.anyHit(shadowOrigin, lightDirection, lights[light], hitIndex);
+    }
+
+    int &occluder = getCachedOccluder(*shadowCache, surface, light);
+    float t0 = INFINITY;
+    float t1 = INFINITY;
+
+    if (occluder >= 0 && spheres[occluder].intersect(shadowOrigin, lightDirection, t0, t1))
+    {
+        return true;
+    }
+
+    if (bvh.anyHit(shadowOrigin, lightDirection, lights[light], hitIndex))
+    {
+        occluder = hitIndex;
+
+        return true;
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Work out the colour where a ray hits a sphere. Shading depends on the surface
+/// property (is it transparent, reflective or diffuse?). Diffuse surfaces add their
+/// colour straight away, while reflective and transparent ones add reflection and
+/// refraction rays to the next wave, weighted by how much they add to the pixel.
+/// </summary>
+/// <param name="ray">The ray.</param>
+/// <param name="sphereIndex">The index of the sphere that was hit.</param>
+/// <param name="pHit">The point of intersection.</param>
+/// <param name="nHit">The normal at the intersection point, facing back along the ray.</param>
+/// <param name="inside">Whether the ray hit the inside of the sphere.</param>
+/// <param name="shadowMasks">For each light, a mask of the rays in this ray's packet whose shadow ray
+/// was blocked, or nullptr to trace the shadow rays here.</param>
+/// <param name="rayIndex">This ray's place in its packet.</param>
+/// <param name="colours">The pixel colours.</param>
+/// <param name="nextWave">Where reflection and refraction rays are added.</param>
+/// <param name="bounds">Where to record the shadow rays, or nullptr.</param>
+/// <param name="shadowCache">The spheres that last blocked shadow rays, or nullptr to not use any.</param>
+void RayScene::shade(const WaveRay &ray, int sphereIndex, const Vec3f &pHit, const Vec3f &nHit, bool inside, const std::uint64_t *shadowMasks, int rayIndex, std::vector<Vec3f> &colours, std::vector<WaveRay> &nextWave, RayBounds *bounds, ShadowCache *shadowCache) const
+{
+    const Sphere &sphere = spheres[sphereIndex];
+    Vec3f surfaceColour = 0; // The colour of the surface at the ray intersection point
+
+    if ((sphere.transparency > 0 || sphere.reflection > 0) && ray.depth < maxBounces)
+    {
+        float facingRatio = -ray.dir.dot(nHit);
+
+        // Change the mix value to tweak the effect
+        float fresnelEffect = mix(pow(1 - facingRatio, 3), 1, 0.1);
+
+        // The result is a mix of reflection and refraction (if the sphere is transparent)
+        Vec3f reflectionWeight = ray.weight * sphere.surfaceColour * fresnelEffect;
+        Vec3f refractionWeight = ray.weight * sphere.surfaceColour * ((1 - fresnelEffect) * sphere.transparency);
+
+        // Compute reflection direction (no need to normalize because all vectors
+        // are already normalized)
+        if (std::max({ reflectionWeight.x, reflectionWeight.y, reflectionWeight.z }) > minContribution)
+        {
+            Vec3f reflDir = ray.dir - nHit * 2 * ray.dir.dot(nHit);
+            reflDir.normalize();
+
+            nextWave.push_back({ pHit + nHit * BIAS, reflDir, reflectionWeight, ray.pixel, ray.depth + 1 });
+        }
+
+        // If the sphere is also transparent then compute refraction ray (transmission)
+        if (sphere.transparency && std::max({ refractionWeight.x, refractionWeight.y, refractionWeight.z }) > minContribution)
+        {
+            float ior = 1.1;
+            float eta = (inside) ? ior : 1 / ior; // Are we inside or outside the surface?
+            float cosI = -nHit.dot(ray.dir);
+            float k = 1 - eta * eta * (1 - cosI * cosI);
+
+            Vec3f refrDir = ray.dir * eta + nHit * (eta * cosI - std::sqrt(k));
+            refrDir.normalize();
+
+            nextWave.push_back({ pHit - nHit * BIAS, refrDir, refractionWeight, ray.pixel, ray.depth + 1 });
+        }
+    }
+    else
+    {
+        // It's a diffuse object so there's no need to trace any more
+        for (std::size_t i = 0; i < lights.size(); ++i)
+        {
+            const Sphere &light = spheres[lights[i]];
+            Vec3f transmission = 1;
+            Vec3f lightDirection = light.center - pHit;
+            lightDirection.normalize();
+
+            if (bounds)
+            {
+                bounds->addShadow(pHit + nHit * BIAS, lightDirection);
+            }
+
+            // Any sphere other than the light itself casts a shadow
+            bool blocked = shadowMasks ? ((shadowMasks[i] >> rayIndex) & 1) != 0 : isShadowed(pHit + nHit * BIAS, lightDirection, sphereIndex, static_cast<int>(i), shadowCache);
+
+            if (blocked)
+            {
+                transmission = 0;
+            }
+
+            surfaceColour += sphere.surfaceColour * transmission * std::max(0.0f, nHit.dot(lightDirection)) * light.emissionColour;
+        }
+    }
+
+    colours[ray.pixel] += ray.weight * (surfaceColour + sphere.emissionColour);
+}
+
+/// <summary>
+/// Raytrace a section of the image.
+/// We compute a camera ray for each pixel of the image,
+/// trace it and return a colour. If the ray hits a sphere, we return the colour of the
+/// sphere at the intersection point, otherwise we return the background colour.
+/// The section is rendered in 64x64 chunks, which keeps the waves of bounces small.
+/// For a quick preview, only every step'th pixel across and down can be traced, each
+/// one filling the step x step block below and to the right of it. Pixels already traced
+/// for a coarser preview can be skipped, as their colour won't change.
+/// </summary>
+/// <param name="pixelArray">The RGBA pixels of the whole image.</param>
+/// <param name="renderW">The width of the whole image.</param>
+/// <param name="renderH">The height of the whole image.</param>
+/// <param name="pixTL">The coordinate of the upper-left corner of the section.</param>
+/// <param name="pixBR">The coordinate of the lower-right corner of the section.</param>
+/// <param name="step">Trace pixels whose coordinates are both multiples of this.</param>
+/// <param name="skipStep">Skip pixels whose coordinates are both multiples of this, or 0 to skip none.</param>
+/// <param name="bounds">Where to record the rays traced other than camera rays, or nullptr.</param>
+void RayScene::renderSection(std::vector<uint8_t> &pixelArray, int renderW, int renderH, sf::Vector2i pixTL, sf::Vector2i pixBR, int step, int skipStep, RayBounds *bounds) const
+{
+	renderChunks(&pixelArray, nullptr, renderW, renderH, pixTL, pixBR, step, skipStep, bounds, false);
+}
+
+/// <summary>
+/// Raytrace a section of the image into an HDR buffer, the same way as into pixels.
+/// Each traced pixel, and the rest of its block in a preview, is left with its one
+/// new sample. With accumulate, every pixel of the section gets one more sample
+/// instead, whose ray goes through the point of the pixel that sample is due.
+/// </summary>
+/// <param name="hdrBuffer">The whole image.</param>
+/// <param name="pixTL">The coordinate of the upper-left corner of the section.</param>
+/// <param name="pixBR">The coordinate of the lower-right corner of the section.</param>
+/// <param name="step">Trace pixels whose coordinates are both multiples of this. Must be 1 to accumulate.</param>
+/// <param name="skipStep">Skip pixels whose coordinates are both multiples of this, or 0 to skip none.</param>
+/// <param name="bounds">Where to record the rays traced other than camera rays, or nullptr.</param>
+/// <param name="accumulate">True to add a sample to every pixel rather than replacing them.</param>
+void RayScene::renderSection(HDRBuffer &hdrBuffer, sf::Vector2i pixTL, sf::Vector2i pixBR, int step, int skipStep, RayBounds *bounds, bool accumulate) const
+{
+	renderChunks(nullptr, &hdrBuffer, hdrBuffer.getWidth(), hdrBuffer.getHeight(), pixTL, pixBR, step, skipStep, bounds, accumulate);
+}
+
+/// <summary>
+/// Split a section of the image into chunks and render each one.
+/// </summary>
+/// <param name="pixelArray">The RGBA pixels of the whole image, or nullptr to render into hdrBuffer.</param>
+/// <param name="hdrBuffer">The HDR pixels of the whole image, or nullptr to render into pixelArray.</param>
+/// <param name="renderW">The width of the whole image.</param>
+/// <param name="renderH">The height of the whole image.</param>
+/// <param name="pixTL">The coordinate of the upper-left corner of the section.</param>
+/// <param name="pixBR">The coordinate of the lower-right corner of the section.</param>
+/// <param name="step">Trace pixels whose coordinates are both multiples of this.</param>
+/// <param name="skipStep">Skip pixels whose coordinates are both multiples of this, or 0 to skip none.</param>
+/// <param name="bounds">Where to record the rays traced other than camera rays, or nullptr.</param>
+/// <param name="accumulate">True to add a sample to every pixel of hdrBuffer.</param>
+void RayScene::renderChunks(std::vector<uint8_t> *pixelArray, HDRBuffer *hdrBuffer, int renderW, int renderH, sf::Vector2i pixTL, sf::Vector2i pixBR, int step, int skipStep, RayBounds *bounds, bool accumulate) const
+{
+	// Start on the first traced pixel, so every chunk lines up with the grid
+	int firstX = (pixTL.x + step - 1) / step * step;
+	int firstY = (pixTL.y + step - 1) / step * step;
+	int chunkPixels = CHUNK_SIZE * step;
+
+	for (int chunkY = firstY; chunkY < pixBR.y; chunkY += chunkPixels)
+	{
+		for (int chunkX = firstX; chunkX < pixBR.x; chunkX += chunkPixels)
+		{
+			renderChunk(pixelArray, hdrBuffer, renderW, renderH, { chunkX, chunkY }, { std::min(chunkX + chunkPixels, pixBR.x), std::min(chunkY + chunkPixels, pixBR.y) }, step, skipStep, bounds, accumulate);
+		}
+	}
+}
+
+/// <summary>
+/// Raytrace a chunk of the image, no more than CHUNK_SIZE traced pixels on each side.
+/// With usePackets, each 8x8 block of traced pixels is one packet: first the camera
+/// rays, then the shadow rays from every diffuse sphere they hit towards each light.
+/// At full resolution, camera rays in a block whose bin isn't crowded only test the
+/// bin's spheres.
+/// With useShadowCache, the chunk's shadow rays share a ShadowCache.
+/// At full resolution, with aaGrid above 1, the pixels that stand out are then anti-aliased,
+/// unless accumulating, as extra samples will smooth them out anyway.
+/// The reflection and refraction rays from the whole chunk are then traced in waves.
+/// </summary>
+/// <param name="pixelArray">The RGBA pixels of the whole image, or nullptr to render into hdrBuffer.</param>
+/// <param name="hdrBuffer">The HDR pixels of the whole image, or nullptr to render into pixelArray.</param>
+/// <param name="renderW">The width of the whole image.</param>
+/// <param name="renderH">The height of the whole image.</param>
+/// <param name="pixTL">The coordinate of the upper-left corner of the chunk, a multiple of step.</param>
+/// <param name="pixBR">The coordinate of the lower-right corner of the chunk.</param>
+/// <param name="step">Trace pixels whose coordinates are both multiples of this.</param>
+/// <param name="skipStep">Skip pixels whose coordinates are both multiples of this, or 0 to skip none.</param>
+/// <param name="bounds">Where to record the rays traced other than camera rays, or nullptr.</param>
+/// <param name="accumulate">True to add a sample to every pixel of hdrBuffer.</param>
+void RayScene::renderChunk(std::vector<uint8_t> *pixelArray, HDRBuffer *hdrBuffer, int renderW, int renderH, sf::Vector2i pixTL, sf::Vector2i pixBR, int step, int skipStep, RayBounds *bounds, bool accumulate) const
+{
+	float invWidth = 1.0f / static_cast<float>(renderW);
+	float invHeight = 1.0f / static_cast<float>(renderH);
+	float aspectRatio = static_cast<float>(renderW) / static_cast<float>(renderH);
+	float angle = std::tan(PI * 0.5f * fov / 180.0f);
+
+	// The chunk's traced pixels, which are called samples here to tell them apart from all its pixels
+	int samplesW = (pixBR.x - pixTL.x + step - 1) / step;
+	int samplesH = (pixBR.y - pixTL.y + step - 1) / step;
+
+	// The ray through any point on the image, measured in pixels from its upper-left corner
+	auto pointRay = [&](double x, double y)
+	{
+		float xx = (2 * (x * invWidth) - 1) * angle * aspectRatio;
+		float yy = (1 - 2 * (y * invHeight)) * angle;
+
+		Vec3f rayDir(xx, yy, -1);
+		rayDir.normalize();
+
+		return rayDir;
+	};
+
+	// The ray through the middle of a pixel, or when accumulating, through wherever its next sample goes
+	auto cameraRay = [&](int x, int y)
+	{
+		double offsetX = 0.5;
+		double offsetY = 0.5;
+
+		if (accumulate)
+		{
+			HDRBuffer::getSampleOffset(hdrBuffer->getSamples(x, y), offsetX, offsetY);
+		}
+
+		return pointRay(x + offsetX, y + offsetY);
+	};
+
+	// Out of bounds check
+	auto inBounds = [&](int x, int y)
+	{
+		int index = (y * renderW + x);
+
+		return index >= 0 && index < renderW * renderH;
+	};
+
+	auto isSample = [&](int sampleX, int sampleY)
+	{
+		int x = pixTL.x + sampleX * step;
+		int y = pixTL.y + sampleY * step;
+
+		return inBounds(x, y) && !(skipStep > 0 && x % skipStep == 0 && y % skipStep == 0);
+	};
+
+	std::vector<Vec3f> colours(samplesW * samplesH, Vec3f(0));
+	std::vector<WaveRay> wave;
+
+	ShadowCache shadowCache;
+	ShadowCache *chunkShadowCache = useShadowCache ? &shadowCache : nullptr;
+
+	std::fill(std::begin(shadowCache.surfaces), std::end(shadowCache.surfaces), -1);
+
+	// Bins only line up with packets at full resolution
+	bool binned = useBins && step == 1 && bins.ready && bins.renderW == renderW && bins.renderH == renderH && bins.rayOrigin == rayOrigin && bins.fov == fov;
+
+	// A BVH that's a single leaf has no boxes for a packet to skip, so single rays are quicker
+	if (!usePackets || (bvh.getDepth() <= 1 && !binned))
+	{
+		for (int sampleY = 0; sampleY < samplesH; ++sampleY)
+		{
+			for (int sampleX = 0; sampleX < samplesW; ++sampleX)
+			{
+				if (isSample(sampleX, sampleY))
+				{
+					wave.push_back({ rayOrigin, cameraRay(pixTL.x + sampleX * step, pixTL.y + sampleY * step), Vec3f(1), sampleY * samplesW + sampleX, 0 });
+				}
+			}
+		}
+	}
+	else
+	{
+		RayPacket packet;
+		RayPacket shadowPacket;
+		float tNear[RayPacket::MAX_RAYS];
+		int hitIndex[RayPacket::MAX_RAYS];
+		Vec3f pHit[RayPacket::MAX_RAYS];
+		Vec3f nHit[RayPacket::MAX_RAYS];
+		bool inside[RayPacket::MAX_RAYS];
+		int occluders[RayPacket::MAX_RAYS];
+		std::vector<std::uint64_t> shadowMasks(lights.size());
+
+		for (int blockY = 0; blockY < samplesH; blockY += PACKET_SIZE)
+		{
+			for (int blockX = 0; blockX < samplesW; blockX += PACKET_SIZE)
+			{
+				int blockW = std::min(PACKET_SIZE, samplesW - blockX);
+				int blockH = std::min(PACKET_SIZE, samplesH - blockY);
+				int left = pixTL.x + blockX * step;
+				int top = pixTL.y + blockY * step;
+				int right = left + (blockW - 1) * step;
+				int bottom = top + (blockH - 1) * step;
+
+				packet.active = 0;
+				packet.amount = 0;
+
+				for (int y = 0; y < blockH; ++y)
+				{
+					for (int x = 0; x < blockW; ++x)
+					{
+						int ray = y * PACKET_SIZE + x;
+
+						if (isSample(blockX + x, blockY + y))
+						{
+							packet.setRay(ray, rayOrigin, cameraRay(left + x * step, top + y * step));
+							tNear[ray] = INFINITY;
+							hitIndex[ray] = -1;
+						}
+					}
+				}
+
+				if (packet.active == 0)
+				{
+					continue;
+				}
+
+				// A packet inside one bin that isn't crowded only tests that bin's spheres
+				int bin = left / PACKET_SIZE == right / PACKET_SIZE && top / PACKET_SIZE == bottom / PACKET_SIZE ? (top / PACKET_SIZE) * bins.columns + left / PACKET_SIZE : -1;
+
+				if (binned && bin >= 0 && bins.counts[bin] >= 0)
+				{
+					for (int ray = 0; ray < packet.amount; ++ray)
+					{
+						if (packet.active & (std::uint64_t(1) << ray))
+						{
+							bins.spheres.closestHit(bins.starts[bin], bins.counts[bin], packet.getOrigin(ray), packet.getDir(ray), tNear[ray], hitIndex[ray]);
+						}
+					}
+				}
+				else
+				{
+					// Every camera ray starts at the same point, so boxes outside the block's corners can be skipped.
+					// Accumulated samples can go anywhere in their pixels, so then the corners are the pixels' outer corners
+					Vec3f corners[4] = { cameraRay(left, top), cameraRay(right, top), cameraRay(right, bottom), cameraRay(left, bottom) };
+
+					if (accumulate)
+					{
+						corners[0] = pointRay(left, top);
+						corners[1] = pointRay(right + 1, top);
+						corners[2] = pointRay(right + 1, bottom + 1);
+						corners[3] = pointRay(left, bottom + 1);
+					}
+
+					packet.setFrustum(rayOrigin, corners);
+
+					bvh.closestHitPacket(packet, tNear, hitIndex);
+				}
+
+				// Find which rays hit a diffuse sphere, as those are the ones that need shadow rays
+				std::uint64_t diffuse = 0;
+
+				for (int ray = 0; ray < packet.amount; ++ray)
+				{
+					if ((packet.active & (std::uint64_t(1) << ray)) == 0 || hitIndex[ray] < 0)
+					{
+						continue;
+					}
+
+					const Sphere &sphere = spheres[hitIndex[ray]];
+					inside[ray] = getHitPoint(packet.getOrigin(ray), packet.getDir(ray), tNear[ray], sphere, pHit[ray], nHit[ray]);
+
+					// The same test as shade(), for rays at depth 0
+					if (!((sphere.transparency > 0 || sphere.reflection > 0) && maxBounces > 0))
+					{
+						diffuse |= std::uint64_t(1) << ray;
+					}
+				}
+
+				for (std::size_t i = 0; i < lights.size() && diffuse != 0; ++i)
+				{
+					int light = static_cast<int>(i);
+					std::uint64_t cached = 0; // Rays blocked by the sphere that blocked the last ray from their surface
+
+					shadowPacket.active = 0;
+					shadowPacket.amount = 0;
+
+					for (int ray = 0; ray < packet.amount; ++ray)
+					{
+						if (diffuse & (std::uint64_t(1) << ray))
+						{
+							Vec3f shadowOrigin = pHit[ray] + nHit[ray] * BIAS;
+							Vec3f lightDirection = spheres[lights[i]].center - pHit[ray];
+							lightDirection.normalize();
+
+							if (chunkShadowCache)
+							{
+								int occluder = getCachedOccluder(shadowCache, hitIndex[ray], light);
+								float t0 = INFINITY;
+								float t1 = INFINITY;
+
+								if (occluder >= 0 && spheres[occluder].intersect(shadowOrigin, lightDirection, t0, t1))
+								{
+									cached |= std::uint64_t(1) << ray;
+									continue;
+								}
+							}
+
+							shadowPacket.setRay(ray, shadowOrigin, lightDirection);
+							occluders[ray] = -1;
+						}
+					}
+
+					shadowMasks[i] = cached | bvh.anyHitPacket(shadowPacket, lights[i], occluders);
+
+					for (int ray = 0; chunkShadowCache && ray < shadowPacket.amount; ++ray)
+					{
+						if ((shadowPacket.active & (std::uint64_t(1) << ray)) && occluders[ray] >= 0)
+						{
+							getCachedOccluder(shadowCache, hitIndex[ray], light) = occluders[ray];
+						}
+					}
+				}
+
+				for (int ray = 0; ray < packet.amount; ++ray)
+				{
+					if ((packet.active & (std::uint64_t(1) << ray)) == 0)
+					{
+						continue;
+					}
+
+					WaveRay cameraWaveRay{ rayOrigin, packet.getDir(ray), Vec3f(1), (blockY + ray / PACKET_SIZE) * samplesW + blockX + ray % PACKET_SIZE, 0 };
+
+					if (hitIndex[ray] < 0)
+					{
+						colours[cameraWaveRay.pixel] += backgroundColour;
+					}
+					else
+					{
+						shade(cameraWaveRay, hitIndex[ray], pHit[ray], nHit[ray], inside[ray], shadowMasks.data(), ray, colours, wave, bounds, chunkShadowCache);
+					}
+				}
+			}
+		}
+	}
+
+	traceWaves(wave, colours, bounds, chunkShadowCache);
+
+	// Which samples have a colour to write, as anti-aliasing can add ones skipped above
+	std::vector<char> traced(samplesW * samplesH);
+
+	for (int sampleY = 0; sampleY < samplesH; ++sampleY)
+	{
+		for (int sampleX = 0; sampleX < samplesW; ++sampleX)
+		{
+			traced[sampleY * samplesW + sampleX] = isSample(sampleX, sampleY);
+		}
+	}
+
+	if (step == 1 && aaGrid > 1 && !accumulate)
+	{
+		antiAliasChunk(pixelArray, hdrBuffer, renderW, renderH, pixTL, pixBR, colours, traced, bounds, chunkShadowCache);
+	}
+
+	for (int sampleY = 0; sampleY < samplesH; ++sampleY)
+	{
+		for (int sampleX = 0; sampleX < samplesW; ++sampleX)
+		{
+			if (!traced[sampleY * samplesW + sampleX])
+			{
+				continue;
+			}
+
+			const Vec3f &pixel = colours[sampleY * samplesW + sampleX];
+			uint8_t r = toByte(pixel.x);
+			uint8_t g = toByte(pixel.y);
+			uint8_t b = toByte(pixel.z);
+			int x = pixTL.x + sampleX * step;
+			int y = pixTL.y + sampleY * step;
+
+			if (accumulate)
+			{
+				hdrBuffer->addSample(x, y, pixel);
+				continue;
+			}
+
+			// Fill the sample's block, which is just the one pixel unless this is a preview
+			for (int fillY = y; fillY < std::min(y + step, pixBR.y); ++fillY)
+			{
+				for (int fillX = x; fillX < std::min(x + step, pixBR.x); ++fillX)
+				{
+					if (!inBounds(fillX, fillY))
+					{
+						continue;
+					}
+
+					if (hdrBuffer)
+					{
+						hdrBuffer->setSample(fillX, fillY, pixel);
+						continue;
+					}
+
+					int index = (fillY * renderW + fillX);
+
+					// Update pixel array - RGBA
+					(*pixelArray)[index * 4] = r;
+					(*pixelArray)[(index * 4) + 1] = g;
+					(*pixelArray)[(index * 4) + 2] = b;
+					(*pixelArray)[(index * 4) + 3] = 255;
+				}
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Anti-alias a chunk rendered at full resolution. Each pixel is compared with the
+/// four next to it, as they would be shown, and any whose red, green or blue differs
+/// by more than aaThreshold is traced again: one ray in each cell of an aaGrid x aaGrid
+/// grid over the pixel, jittered inside its cell, with the results averaged. So flat
+/// areas cost nothing extra and only edges, shadow borders and fine detail get the
+/// extra samples. To find edges along the chunk's sides, the ring of pixels just
+/// outside it is traced too, though not written.
+/// </summary>
+/// <param name="pixelArray">The RGBA pixels of the whole image, for pixels filled by an earlier pass, or nullptr.</param>
+/// <param name="hdrBuffer">The HDR pixels of the whole image, used instead of pixelArray if it's nullptr.</param>
+/// <param name="renderW">The width of the whole image.</param>
+/// <param name="renderH">The height of the whole image.</param>
+/// <param name="pixTL">The coordinate of the upper-left corner of the chunk.</param>
+/// <param name="pixBR">The coordinate of the lower-right corner of the chunk.</param>
+/// <param name="colours">The colours traced for the chunk's pixels. Anti-aliased ones are replaced.</param>
+/// <param name="traced">Which pixels have a colour in colours. Anti-aliased ones are set.</param>
+/// <param name="bounds">Where to record the rays traced other than camera rays, or nullptr.</param>
+/// <param name="shadowCache">The spheres that last blocked shadow rays, or nullptr to not use any.</param>
+void RayScene::antiAliasChunk(const std::vector<uint8_t> *pixelArray, const HDRBuffer *hdrBuffer, int renderW, int renderH, sf::Vector2i pixTL, sf::Vector2i pixBR, std::vector<Vec3f> &colours, std::vector<char> &traced, RayBounds *bounds, ShadowCache *shadowCache) const
+{
+    float invWidth = 1.0f / static_cast<float>(renderW);
+    float invHeight = 1.0f / static_cast<float>(renderH);
+    float aspectRatio = static_cast<float>(renderW) / static_cast<float>(renderH);
+    float angle = std::tan(PI * 0.5f * fov / 180.0f);
+
+    // The same sums as renderChunk's camera rays, through any point on the image rather than just pixel centres
+    auto cameraRay = [&](double x, double y)
+    {
+        float xx = (2 * (x * invWidth) - 1) * angle * aspectRatio;
+        float yy = (1 - 2 * (y * invHeight)) * angle;
+
+        Vec3f rayDir(xx, yy, -1);
+        rayDir.normalize();
+
+        return rayDir;
+    };
+
+    int chunkW = pixBR.x - pixTL.x;
+    int chunkH = pixBR.y - pixTL.y;
+    int ringW = chunkW + 2;
+
+    // The chunk and the ring around it as they'd be shown, 3 values a pixel, -1 off the image
+    std::vector<int> shown(ringW * (chunkH + 2) * 3, -1);
+    std::vector<int> ringPixels; // Where each traced ring pixel goes in shown
+    std::vector<WaveRay> wave;
+
+    for (int y = -1; y <= chunkH; ++y)
+    {
+        for (int x = -1; x <= chunkW; ++x)
+        {
+            int pixelX = pixTL.x + x;
+            int pixelY = pixTL.y + y;
+            int ring = (y + 1) * ringW + x + 1;
+
+            if (pixelX < 0 || pixelY < 0 || pixelX >= renderW || pixelY >= renderH)
+            {
+                continue;
+            }
+
+            if (x < 0 || y < 0 || x >= chunkW || y >= chunkH)
+            {
+                wave.push_back({ rayOrigin, cameraRay(pixelX + 0.5, pixelY + 0.5), Vec3f(1), static_cast<int>(ringPixels.size()), 0 });
+                ringPixels.push_back(ring);
+            }
+            else if (traced[y * chunkW + x])
+            {
+                const Vec3f &pixel = colours[y * chunkW + x];
+
+                shown[ring * 3] = toByte(pixel.x);
+                shown[ring * 3 + 1] = toByte(pixel.y);
+                shown[ring * 3 + 2] = toByte(pixel.z);
+            }
+            else if (hdrBuffer)
+            {
+                // Skipped because an earlier, coarser pass already traced this pixel
+                Vec3f pixel = hdrBuffer->getAverage(pixelX, pixelY);
+
+                shown[ring * 3] = toByte(pixel.x);
+                shown[ring * 3 + 1] = toByte(pixel.y);
+                shown[ring * 3 + 2] = toByte(pixel.z);
+            }
+            else
+            {
+                int index = (pixelY * renderW + pixelX) * 4;
+
+                shown[ring * 3] = (*pixelArray)[index];
+                shown[ring * 3 + 1] = (*pixelArray)[index + 1];
+                shown[ring * 3 + 2] = (*pixelArray)[index + 2];
+            }
+        }
+    }
+
+    std::vector<Vec3f> ringColours(ringPixels.size(), Vec3f(0));
+
+    traceWaves(wave, ringColours, bounds, shadowCache);
+
+    for (std::size_t i = 0; i < ringPixels.size(); ++i)
+    {
+        shown[ringPixels[i] * 3] = toByte(ringColours[i].x);
+        shown[ringPixels[i] * 3 + 1] = toByte(ringColours[i].y);
+        shown[ringPixels[i] * 3 + 2] = toByte(ringColours[i].z);
+    }
+
+    // Find the pixels that stand out from a neighbour
+    int threshold = static_cast<int>(aaThreshold * 255);
+    const int neighbours[4] = { -1, 1, -ringW, ringW };
+    std::vector<int> standOut;
+
+    for (int y = 0; y < chunkH; ++y)
+    {
+        for (int x = 0; x < chunkW; ++x)
+        {
+            int ring = (y + 1) * ringW + x + 1;
+            bool differs = false;
+
+            for (int n = 0; n < 4 && !differs; ++n)
+            {
+                int neighbour = ring + neighbours[n];
+
+                for (int c = 0; c < 3 && shown[neighbour * 3] >= 0; ++c)
+                {
+                    differs |= std::abs(shown[ring * 3 + c] - shown[neighbour * 3 + c]) > threshold;
+                }
+            }
+
+            if (differs)
+            {
+                standOut.push_back(y * chunkW + x);
+            }
+        }
+    }
+
+    // Trace a jittered grid of samples over each of them
+    int gridSamples = aaGrid * aaGrid;
+    std::vector<Vec3f> sampleColours(standOut.size() * gridSamples, Vec3f(0));
+
+    for (std::size_t i = 0; i < standOut.size(); ++i)
+    {
+        int pixelX = pixTL.x + standOut[i] % chunkW;
+        int pixelY = pixTL.y + standOut[i] / chunkW;
+
+        for (int sample = 0; sample < gridSamples; ++sample)
+        {
+            float jitterX = 0.0f;
+            float jitterY = 0.0f;
+            getJitter(pixelX, pixelY, sample, jitterX, jitterY);
+
+            double x = pixelX + (sample % aaGrid + jitterX) / aaGrid;
+            double y = pixelY + (sample / aaGrid + jitterY) / aaGrid;
+
+            wave.push_back({ rayOrigin, cameraRay(x, y), Vec3f(1), static_cast<int>(i) * gridSamples + sample, 0 });
+        }
+    }
+
+    traceWaves(wave, sampleColours, bounds, shadowCache);
+
+    for (std::size_t i = 0; i < standOut.size(); ++i)
+    {
+        Vec3f sum = 0;
+
+        for (int sample = 0; sample < gridSamples; ++sample)
+        {
+            sum += sampleColours[i * gridSamples + sample];
+        }
+
+        colours[standOut[i]] = sum * (1.0f / gridSamples);
+        traced[standOut[i]] = 1;
+    }
+}
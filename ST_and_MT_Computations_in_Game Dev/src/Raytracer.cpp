@@ -1,36 +1,37 @@
 #include "Raytracer.h"
 
+namespace
+{
+    // How long the main thread spends rendering tiles each frame when
+    // single-threaded, leaving the rest of a 60 fps frame for the UI
+    const double FRAME_BUDGET_MS = 8.0;
+
+    // The first preview pass traces one pixel in every 8x8 block
+    const int PREVIEW_STEP = 8;
+}
+
 /// <summary>
 /// Raytracer constructor.
 /// </summary>
 /// <param name="w">The width of the render.</param>
 /// <param name="h">The height of the render.</param>
-Raytracer::Raytracer(int w, int h) : renderW(w), renderH(h)
+/// <param name="threadPool">The thread pool shared by all tests.</param>
+Raytracer::Raytracer(int w, int h, ThreadPool &threadPool) : renderW(w), renderH(h), threadPool(&threadPool), poolStats(threadPool), scalingPanel(threadPool, "Raytracer")
 {
 	renderTexture = std::make_unique<sf::Texture>();
 	renderTexture->create(renderW, renderH);
 
-	threadPool = std::make_unique<ThreadPool>(std::thread::hardware_concurrency());
+	// Use every pool thread plus the main thread until the user lowers it
+	threadLimit = static_cast<int>(threadPool.getThreadAmount()) + 1;
 
 	pixelArray.resize(renderW * renderH * 4);
 
     // Set startup defaults
     renderTileW = 64;
     renderTileH = 64;
-    maxBounces = 25;
-    backgroundColour = 1.0f;
-
-    // This sphere acts as the ground
-    spheres.push_back(Sphere(Vec3f(0.0, -10000, -5), 10000, Vec3f(0.149, 0.509, 0.192), 1, 0, 0));
-
-    // Some other spheres
-    spheres.push_back(Sphere(Vec3f(-3.0, 0.4, -10.0), 0.4, Vec3f(0.835, 0.443, 0.125), 0.1, 1, 0));
-    spheres.push_back(Sphere(Vec3f(-2.3, 0.2, -15.0), 0.2, Vec3f(0.713, 0.227, 0.631), 0.2, 1, 0));
-    spheres.push_back(Sphere(Vec3f(0.2, 2.3, -24.0), 2.3, Vec3f(0.721, 0.721, 0.721), 1, 1, 0));
-    spheres.push_back(Sphere(Vec3f(14.1, 6.0, -53.0), 6.0, Vec3f(0.835, 0.443, 0.125), 0.1, 0.7, 0));
-    spheres.push_back(Sphere(Vec3f(-59.1, 24.0, -204.0), 24.0, Vec3f(0.443, 0.835, 0.125), 0.1, 0.7, 0));
 
     // Render demo image
+    scene.build();
     render(multiThreaded);
 }
 
@@ -39,7 +40,8 @@ Raytracer::Raytracer(int w, int h) : renderW(w), renderH(h)
 /// </summary>
 Raytracer::~Raytracer()
 {
-
+    // The pool's threads may still be rendering into this object
+    cancelRender();
 }
 
 /// <summary>
@@ -49,6 +51,9 @@ void Raytracer::handleUI()
 {
     ImGui::PushItemWidth(0);
 
+    // Anything that changes the image restarts the render when previewing
+    bool changed = false;
+
     if (ImGui::CollapsingHeader("Raytracer"))
     {
         // Instructions
@@ -86,7 +91,7 @@ void Raytracer::handleUI()
             ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
             ImGui::SeparatorText("Tile Dimensions");
-            ImGui::TextWrapped("This only applies to multi-threaded rendering");
+            ImGui::TextWrapped("Tiles are rendered from the centre out, and each one is shown as soon as it's finished");
 
             ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
@@ -106,13 +111,13 @@ void Raytracer::handleUI()
 
             ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
-            ImGui::DragFloat("X", &rayOrigin.x);
-            ImGui::DragFloat("Y", &rayOrigin.y);
-            ImGui::DragFloat("Z", &rayOrigin.z);
+            changed |= ImGui::DragFloat("X", &scene.rayOrigin.x);
+            changed |= ImGui::DragFloat("Y", &scene.rayOrigin.y);
+            changed |= ImGui::DragFloat("Z", &scene.rayOrigin.z);
 
             ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
-            ImGui::ColorEdit3("Background Colour", backgroundColour.get());
+            changed |= ImGui::ColorEdit3("Background Colour", scene.backgroundColour.get());
 
             ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
@@ -121,44 +126,61 @@ void Raytracer::handleUI()
 
             ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
-            // Display all spheres in the scene in a selectable list
-            for (int i = 0; i < spheres.size(); i++)
-            {
-                std::string text = "Sphere " + std::to_string(i);
+            // Display all spheres in the scene in a selectable list.
+            // Only the visible rows are drawn, as scattered scenes can hold a lot of spheres
+            ImGui::BeginChild("Spheres##101", ImVec2(0.0f, 200.0f), true);
 
-                ImGui::Separator();
+            ImGuiListClipper clipper;
+            clipper.Begin(static_cast<int>(scene.spheres.size()));
 
-                if (ImGui::Selectable(text.c_str(), i == activeSphereIndex))
+            while (clipper.Step())
+            {
+                for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
                 {
-                    // If the user clicks on the sphere, set it as the active sphere
-                    activeSphereIndex = i;
+                    std::string text = "Sphere " + std::to_string(i);
+
+                    if (ImGui::Selectable(text.c_str(), i == activeSphereIndex))
+                    {
+                        // If the user clicks on the sphere, set it as the active sphere
+                        activeSphereIndex = i;
+                    }
                 }
             }
 
-            ImGui::Separator();
+            ImGui::EndChild();
 
             ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
             if (ImGui::Button("Add Sphere", ImVec2(110, 24)))
             {
-                spheres.push_back(Sphere(Vec3f(0, 0, 0), 3, Vec3f(0.5, 0.5, 0.5), 0, 0, 0));
+                Timer timer("Raytracer BVH Update");
+                scene.addSphere(Sphere(Vec3f(0, 0, 0), 3, Vec3f(0.5, 0.5, 0.5), 0, 0, 0));
+                bvhMs = timer.stop();
+                editedSpheres.push_back(scene.spheres.back());
+                lastEditedSphere = -1;
+                spheresChanged = true;
             }
 
             ImGui::SameLine();
 
             if (ImGui::Button("Delete Sphere", ImVec2(110, 24)))
             {
-                if (spheres.size() > 0)
+                if (scene.spheres.size() > 0)
                 {
-                    if (activeSphereIndex < spheres.size())
+                    if (activeSphereIndex >= 0 && activeSphereIndex < scene.spheres.size())
                     {
-                        auto itr = spheres.begin() + activeSphereIndex;
-                        spheres.erase(itr);
+                        // The last sphere takes the deleted sphere's number
+                        Timer timer("Raytracer BVH Update");
+                        editedSpheres.push_back(scene.spheres[activeSphereIndex]);
+                        lastEditedSphere = -1;
+                        scene.removeSphere(activeSphereIndex);
+                        bvhMs = timer.stop();
+                        spheresChanged = true;
                     }
 
-                    if (spheres.empty())
+                    if (activeSphereIndex >= scene.spheres.size())
                     {
-                        activeSphereIndex = -1;
+                        activeSphereIndex = static_cast<int>(scene.spheres.size()) - 1;
                     }
                 }
             }
@@ -171,6 +193,31 @@ void Raytracer::handleUI()
             }
 
             ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+            ImGui::SeparatorText("Scatter Spheres");
+            ImGui::TextWrapped("Add lots of small random spheres and a light, to test the BVH with a large scene");
+
+            ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+            ImGui::InputInt("Amount##102", &scatterAmount, 1000, 10000);
+
+            // Limit to a million spheres
+            scatterAmount = std::clamp(scatterAmount, 1, 1000000);
+
+            ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+            if (ImGui::Button("Scatter##103", ImVec2(110, 24)))
+            {
+                // Building from scratch is quicker than adding this many one at a time
+                Timer timer("Raytracer BVH Build");
+                scene.scatterSpheres(scatterAmount, static_cast<unsigned int>(scene.spheres.size()));
+                scene.build();
+                bvhMs = timer.stop();
+                spheresChanged = true;
+                fullRenderNeeded = true;
+            }
+
+            ImGui::Dummy(ImVec2(0.0f, 8.0f));
         }
 
         if (ImGui::CollapsingHeader("Render##055"))
@@ -181,20 +228,138 @@ void Raytracer::handleUI()
 
             ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
-            ImGui::InputInt("Max Bounces", &maxBounces);
+            ImGui::InputInt("Max Bounces", &scene.maxBounces);
 
             // Limit to a maximum of 128 potential bounces
-            maxBounces = std::clamp(maxBounces, 1, 128);
+            scene.maxBounces = std::clamp(scene.maxBounces, 1, 128);
+
+            ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+            ImGui::SliderFloat("Min Contribution##106", &scene.minContribution, 0.0f, 0.01f, "%.4f");
+
+            ImGui::TextWrapped("Reflections and refractions that would change a pixel by less than this aren't traced. 0 traces every bounce");
+
+            ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+            ImGui::SliderInt("AA Grid##111", &scene.aaGrid, 1, 4);
+
+            ImGui::BeginDisabled(scene.aaGrid <= 1);
+            ImGui::SliderFloat("AA Threshold##112", &scene.aaThreshold, 0.0f, 0.5f, "%.3f");
+            ImGui::EndDisabled();
+
+            ImGui::TextWrapped("Pixels whose colour differs from a neighbour's by more than the threshold are traced again with a grid of samples, 3 being 3x3. 1 turns anti-aliasing off");
+
+            ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+            bool useSIMD = SphereSoA::isSIMDEnabled();
+
+            ImGui::BeginDisabled(!SphereSoA::isSIMDAvailable());
+
+            if (ImGui::Checkbox("Use SIMD##104", &useSIMD))
+            {
+                SphereSoA::setSIMDEnabled(useSIMD);
+            }
+
+            ImGui::EndDisabled();
+
+            if (SphereSoA::isSIMDAvailable())
+            {
+                ImGui::TextWrapped("Tests 8 spheres at a time with AVX, or one at a time when turned off");
+            }
+            else
+            {
+                ImGui::TextWrapped("This CPU doesn't support AVX, so spheres are tested one at a time");
+            }
+
+            ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+            ImGui::Checkbox("Ray Packets##105", &scene.usePackets);
+
+            ImGui::TextWrapped("Traces camera and shadow rays in 8x8 packets, so each BVH node is tested against many rays at once");
+
+            ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+            ImGui::BeginDisabled(!scene.usePackets);
+            ImGui::Checkbox("Sphere Bins##109", &scene.useBins);
+            ImGui::EndDisabled();
+
+            ImGui::TextWrapped("Sorts the spheres by the 8x8 blocks of pixels they cover before rendering, so each packet of camera rays only tests the few spheres in its block");
+
+            ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+            ImGui::Checkbox("Shadow Cache##110", &scene.useShadowCache);
+
+            ImGui::TextWrapped("Shadow rays first test the sphere that blocked the last shadow ray from the same surface to the same light, before searching the BVH");
+
+            ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+            ImGui::Checkbox("Preview Refinement##108", &previewRefinement);
+
+            if (previewRefinement)
+            {
+                ImGui::TextWrapped("Changes to the camera or spheres re-render straight away, at 1/8 resolution first, then 1/4, 1/2 and full");
+            }
+            else
+            {
+                ImGui::TextWrapped("Any changes made will only be visible once the scene has been rendered");
+            }
+
+            ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+            if (ImGui::Checkbox("Progressive##113", &progressive))
+            {
+                progressivePaused = false;
+            }
+
+            ImGui::BeginDisabled(!progressive);
+            ImGui::SliderInt("Max Samples##114", &maxSamples, 2, 1024);
+            ImGui::EndDisabled();
+
+            ImGui::TextWrapped("Once the image has finished rendering, each frame adds another sample to every pixel, through a different point of it, until max samples or until something changes");
+
+            ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+            bool toneMapChanged = false;
+
+            toneMapChanged |= ImGui::SliderFloat("Exposure##115", &exposure, 0.1f, 4.0f, "%.2f");
+            toneMapChanged |= ImGui::Checkbox("Soft Clip##116", &softClip);
+
+            ImGui::TextWrapped("Colours are kept above 1 until they're shown. Exposure scales them, then soft clip squeezes the brightest in below 1 instead of clamping them");
+
+            // Only how the image is shown changes, so nothing is rendered again
+            if (toneMapChanged)
+            {
+                resolveNeeded = true;
+            }
 
             ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
-            ImGui::TextWrapped("Any changes made will only be visible once the scene has been rendered");
+            if (ImGui::Checkbox("Real-Time##118", &realTime))
+            {
+                if (realTime)
+                {
+                    cancelRender();
+                    dynamicResolution.reset();
+                }
+                else
+                {
+                    // Nothing about the real-time frames' rays was recorded
+                    fullRenderNeeded = true;
+                    startRender(multiThreaded);
+                }
+            }
+
+            ImGui::BeginDisabled(!realTime);
+            ImGui::SliderFloat("Frame Budget##119", &dynamicResolution.budgetMs, 4.0f, 33.0f, "%.1f ms");
+            ImGui::EndDisabled();
+
+            ImGui::TextWrapped("Renders every frame, at between 25%% and 100%% of the width and height, and with fewer bounces if that isn't enough, to stay within the budget. Frames are scaled up with bilinear filtering");
 
             ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
             if (ImGui::Button("Render##56", ImVec2(60, 24)))
             {
-                render(multiThreaded);
+                startRender(multiThreaded);
             }
 
             ImGui::Dummy(ImVec2(0.0f, 8.0f));
@@ -212,6 +377,10 @@ void Raytracer::handleUI()
 
                 ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
+                ImGui::SliderInt("Thread Limit##093", &threadLimit, 1, static_cast<int>(threadPool->getThreadAmount()) + 1);
+
+                ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
                 ImGui::SeparatorText("Execution Time##061");
 
                 ImGui::Dummy(ImVec2(0.0f, 8.0f));
@@ -219,14 +388,23 @@ void Raytracer::handleUI()
                 std::string milliSecs = "Time: " + std::to_string(ms) + "ms";
 
                 ImGui::Text(milliSecs.c_str());
+                ImGui::Text("BVH: %d nodes, %d deep", scene.getBVH().getNodeAmount(), scene.getBVH().getDepth());
+                ImGui::Text("Last BVH update: %.3fms", bvhMs);
+                ImGui::Text("Last render: %d of %d tiles", static_cast<int>(tiles.size()), static_cast<int>(tileBounds.size()));
 
                 ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+                poolStats.handleUI();
+
+                perfCounters.handleUI();
+
+                scalingPanel.handleUI([this](int threads) { return runAtThreads(threads); });
             }
         }
     }
 
     // Render sphere editor window if it's open
-    if (sphereEditWindowOpen)
+    if (sphereEditWindowOpen && activeSphereIndex >= 0 && activeSphereIndex < scene.spheres.size())
     {
         ImGui::Begin("Edit Sphere", &sphereEditWindowOpen);
 
@@ -239,37 +417,72 @@ void Raytracer::handleUI()
 
         ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
-        ImGui::DragFloat("Radius", &spheres[activeSphereIndex].radius);
-        spheres[activeSphereIndex].radius2 = spheres[activeSphereIndex].radius * spheres[activeSphereIndex].radius;
+        Sphere before = scene.spheres[activeSphereIndex];
+
+        // Moving, resizing or lighting the sphere means the BVH or light list needs updating
+        bool edited = false;
+
+        edited |= ImGui::DragFloat("Radius", &scene.spheres[activeSphereIndex].radius);
+        scene.spheres[activeSphereIndex].radius2 = scene.spheres[activeSphereIndex].radius * scene.spheres[activeSphereIndex].radius;
 
         ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
-        ImGui::DragFloat("X", &spheres[activeSphereIndex].center.x);
-        ImGui::DragFloat("Y", &spheres[activeSphereIndex].center.y);
-        ImGui::DragFloat("Z", &spheres[activeSphereIndex].center.z);
+        edited |= ImGui::DragFloat("X", &scene.spheres[activeSphereIndex].center.x);
+        edited |= ImGui::DragFloat("Y", &scene.spheres[activeSphereIndex].center.y);
+        edited |= ImGui::DragFloat("Z", &scene.spheres[activeSphereIndex].center.z);
 
         ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
-        ImGui::ColorEdit3("Colour", spheres[activeSphereIndex].surfaceColour.get());
+        // These don't touch the BVH, but still change the image
+        bool recoloured = false;
+
+        recoloured |= ImGui::ColorEdit3("Colour", scene.spheres[activeSphereIndex].surfaceColour.get());
 
         ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
-        ImGui::DragFloat("Reflection", &spheres[activeSphereIndex].reflection, 0.01f, 0.0f, 1.0f);
-        ImGui::DragFloat("Transparency", &spheres[activeSphereIndex].transparency, 0.01f, 0.0f, 1.0f);
+        recoloured |= ImGui::DragFloat("Reflection", &scene.spheres[activeSphereIndex].reflection, 0.01f, 0.0f, 1.0f);
+        recoloured |= ImGui::DragFloat("Transparency", &scene.spheres[activeSphereIndex].transparency, 0.01f, 0.0f, 1.0f);
 
         // Clamp values between 0.0 and 1.0
-        spheres[activeSphereIndex].reflection = std::clamp(spheres[activeSphereIndex].reflection, 0.0f, 1.0f);
-        spheres[activeSphereIndex].transparency = std::clamp(spheres[activeSphereIndex].transparency, 0.0f, 1.0f);
+        scene.spheres[activeSphereIndex].reflection = std::clamp(scene.spheres[activeSphereIndex].reflection, 0.0f, 1.0f);
+        scene.spheres[activeSphereIndex].transparency = std::clamp(scene.spheres[activeSphereIndex].transparency, 0.0f, 1.0f);
 
         ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
-        ImGui::ColorEdit3("Emission Colour", spheres[activeSphereIndex].emissionColour.get());
+        edited |= ImGui::ColorEdit3("Emission Colour", scene.spheres[activeSphereIndex].emissionColour.get());
+
+        if (edited)
+        {
+            Timer timer("Raytracer BVH Update");
+            scene.updateSphere(activeSphereIndex);
+            bvhMs = timer.stop();
+        }
+
+        if (edited || recoloured)
+        {
+            const Sphere &after = scene.spheres[activeSphereIndex];
+
+            // Dragging edits the sphere every frame. Only how it was at the last render and
+            // how it is now matter, so a second edit in a row replaces the first one's after
+            if (lastEditedSphere == activeSphereIndex)
+            {
+                editedSpheres.back() = after;
+            }
+            else
+            {
+                editedSpheres.push_back(before);
+                editedSpheres.push_back(after);
+                lastEditedSphere = activeSphereIndex;
+            }
+
+            spheresChanged = true;
+        }
 
         ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
         if (ImGui::Button("Render##064", ImVec2(60, 24)))
         {
-            render(multiThreaded);
+            startRender(multiThreaded);
         }
 
         ImGui::Dummy(ImVec2(0.0f, 8.0f));
@@ -277,10 +490,73 @@ void Raytracer::handleUI()
         ImGui::End();
     }
 
+    if (realTime)
+    {
+        renderRealTime();
+    }
+    else
+    {
+        if ((changed || spheresChanged) && previewRefinement)
+        {
+            startRender(multiThreaded);
+        }
+
+        updateRender();
+
+        // The HDR image can't be read while tiles are being rendered into it
+        if (resolveNeeded && !rendering)
+        {
+            resolveImage();
+        }
+
+        if (progressive && !progressivePaused && !rendering)
+        {
+            startAccumulation();
+        }
+    }
+
 	// Render output window
 	ImGui::Begin("Raytracer##077");
 
-    renderTexture->update(pixelArray.data());
+    if (rendering)
+    {
+        std::string progress;
+
+        if (accumulating)
+        {
+            progress = "Sample " + std::to_string(accumulatingSample) + ": " + std::to_string(finishedTiles.getPopped()) + " / " + std::to_string(workAmount) + " tiles";
+        }
+        else
+        {
+            // Show which pass is being shown, as 1/8 to 1/1 of full resolution
+            int pass = std::min(finishedTiles.getPopped() / static_cast<int>(tiles.size()), static_cast<int>(passSteps.size()) - 1);
+            progress = std::to_string(finishedTiles.getPopped()) + " / " + std::to_string(workAmount) + " tiles (1/" + std::to_string(passSteps[pass]) + " res)";
+        }
+
+        ImGui::ProgressBar(static_cast<float>(finishedTiles.getPopped()) / workAmount, ImVec2(-90.0f, 0.0f), progress.c_str());
+
+        ImGui::SameLine();
+
+        // Cancelling also stops samples being added, until the next render
+        if (ImGui::Button("Cancel##107", ImVec2(80, 0)))
+        {
+            cancelRender();
+            progressivePaused = true;
+        }
+    }
+    else if (realTime)
+    {
+        ImGui::Text("Real-time: %d x %d (%.0f%%), %d bounces, %.1f ms", dynamicResolution.getRenderW(), dynamicResolution.getRenderH(),
+            dynamicResolution.getScale() * 100.0f, dynamicResolution.getBounces(), dynamicResolution.getAverageMs());
+    }
+    else if (progressive && progressivePaused)
+    {
+        if (ImGui::Button("Resume##117", ImVec2(80, 0)))
+        {
+            progressivePaused = false;
+        }
+    }
+
 	ImGui::Image(*renderTexture);
 
 	ImGui::End();
@@ -293,247 +569,617 @@ void Raytracer::handleUI()
 /// <param name="multiThreaded">False for single-threaded and true for multi-threaded.</param>
 void Raytracer::render(bool multiThreaded)
 {
+    PROFILE_SCOPE("Raytracer Render");
+
+    cancelRender();
+
+    poolStats.begin();
+    perfCounters.begin();
+
     // Create timer
     Timer timer("Raytracer Render");
 
-    pixelArray.clear();
-    pixelArray.resize(renderW * renderH * 4);
+    hdrBuffer.resize(renderW, renderH);
 
     renderTexture = std::make_unique<sf::Texture>();
     renderTexture->create(renderW, renderH);
 
-    // Store futures in here
-    std::vector<std::future<void>> futures;
+    renderingW = renderW;
+    renderingH = renderH;
 
-	if (multiThreaded)
+    // Nothing is recorded about the rays, so the next render has to render every tile,
+    // and until then no tile can be kept or have samples added
+    fullRenderNeeded = true;
+    std::fill(tileSamples.begin(), tileSamples.end(), 0);
+
+    if (scene.useBins)
     {
-        int numOfSectionsW = (renderW / renderTileW) + 1;
-        int numOfSectionsH = (renderH / renderTileH) + 1;
+        scene.binSpheres(renderW, renderH);
+    }
 
-		// Add the render jobs to the thread pool
-        for (int y = 0; y < numOfSectionsH; ++y)
+	if (multiThreaded)
+    {
+        // Each tile is a job, tiles on the right and bottom edges are clipped to the image
+        parallelFor2D(*threadPool, { 0, 0, renderW, renderH }, { renderTileW, renderTileH }, [this](const Range2D &tile)
         {
-            for (int x = 0; x < numOfSectionsW; ++x)
-            {
-                // This lambda adds a block of code to the thread pool as a job
-                auto f = threadPool->addJob([=]
-                {
-                    int startX = x * renderTileW;
-                    int startY = y * renderTileH;
-
-                    int endX = startX + renderTileW;
-                    int endY = startY + renderTileH;
-
-                    renderSection({ startX, startY }, { endX, endY });
-                });
-
-                futures.push_back(std::move(f));
-            }
-        }
+            PROFILE_SCOPE("Raytracer Tile");
+            PERF_SCOPE(perfCounters.getTotals());
+            scene.renderSection(hdrBuffer, { tile.beginX, tile.beginY }, { tile.endX, tile.endY });
+        }, threadLimit);
 	}
 	else
 	{
 		// This renders using a single thread (this thread, the main thread)
         // The entire image is rendered in one sweep
-        renderSection({ 0, 0 }, { renderW, renderH });
-
-        ms = timer.stop();
+        PERF_SCOPE(perfCounters.getTotals());
+        scene.renderSection(hdrBuffer, { 0, 0 }, { renderW, renderH });
 	}
 
-    if (multiThreaded)
+    ms = timer.stop();
+    poolStats.end();
+    perfCounters.end();
+
+    resolveImage();
+}
+
+/// <summary>
+/// Start rendering without waiting for it to finish. The tiles are ordered from
+/// the centre of the image out, as that's usually where the interesting part is.
+/// Multi-threaded, the pool's threads render them. Single-threaded, the main
+/// thread renders a few each frame in updateRender(). Any render in progress is
+/// cancelled first. With preview refinement, each tile is rendered once per pass.
+/// If only spheres have been edited since the last render, only the tiles they
+/// could change are rendered, and the rest of the image is kept.
+/// </summary>
+/// <param name="multiThreaded">False for single-threaded and true for multi-threaded.</param>
+void Raytracer::startRender(bool multiThreaded)
+{
+    cancelRender();
+
+    accumulating = false;
+    progressivePaused = false;
+
+    // Anything that changes every pixel, or that the tiles' rays can't bound, renders every tile
+    bool renderAll = fullRenderNeeded || !renderingScene || renderW != renderingW || renderH != renderingH;
+
+    if (!renderAll)
+    {
+        renderAll = renderingScene->rayOrigin != scene.rayOrigin || renderingScene->fov != scene.fov || renderingScene->maxBounces != scene.maxBounces ||
+            renderingScene->backgroundColour != scene.backgroundColour || renderingScene->minContribution != scene.minContribution ||
+            renderingScene->aaGrid != scene.aaGrid || renderingScene->aaThreshold != scene.aaThreshold;
+    }
+
+    // A light lights every tile
+    for (const Sphere &sphere : editedSpheres)
+    {
+        renderAll |= sphere.emissionColour.x > 0;
+    }
+
+    // Keep the last image showing underneath, unless the size has changed
+    if (renderW != renderingW || renderH != renderingH)
+    {
+        hdrBuffer.resize(renderW, renderH);
+
+        renderTexture = std::make_unique<sf::Texture>();
+        renderTexture->create(renderW, renderH);
+    }
+
+    renderingW = renderW;
+    renderingH = renderH;
+
+    // Copying the spheres and BVH of a big scene takes a while, so when only the
+    // camera or settings have changed, only those are copied
+    if (!renderingScene || spheresChanged)
+    {
+        renderingScene = std::make_unique<RayScene>(scene);
+        spheresChanged = false;
+    }
+    else
+    {
+        renderingScene->rayOrigin = scene.rayOrigin;
+        renderingScene->fov = scene.fov;
+        renderingScene->maxBounces = scene.maxBounces;
+        renderingScene->backgroundColour = scene.backgroundColour;
+        renderingScene->usePackets = scene.usePackets;
+        renderingScene->minContribution = scene.minContribution;
+        renderingScene->useBins = scene.useBins;
+        renderingScene->useShadowCache = scene.useShadowCache;
+        renderingScene->aaGrid = scene.aaGrid;
+        renderingScene->aaThreshold = scene.aaThreshold;
+    }
+
+    passSteps.clear();
+
+    for (int step = previewRefinement ? PREVIEW_STEP : 1; step >= 1; step /= 2)
+    {
+        passSteps.push_back(step);
+    }
+
+    // Preview tiles must line up with the coarsest pass, so each pixel it fills is in the same tile
+    int tileW = (renderTileW + passSteps[0] - 1) / passSteps[0] * passSteps[0];
+    int tileH = (renderTileH + passSteps[0] - 1) / passSteps[0] * passSteps[0];
+
+    // What each tile rendered last time only helps if the tiles are in the same places
+    if (tileW != gridTileW || tileH != gridTileH)
+    {
+        gridTileW = tileW;
+        gridTileH = tileH;
+        renderAll = true;
+    }
+
+    gridColumns = (renderingW + gridTileW - 1) / gridTileW;
+    int cellAmount = gridColumns * ((renderingH + gridTileH - 1) / gridTileH);
+
+    if (renderAll)
+    {
+        tileBounds.assign(cellAmount, RayBounds());
+        tileSamples.assign(cellAmount, 0);
+    }
+
+    // The pixels each edited sphere could cover, before and after
+    std::vector<Footprint> footprints(editedSpheres.size());
+
+    for (std::size_t i = 0; i < editedSpheres.size(); ++i)
+    {
+        renderingScene->getFootprint(editedSpheres[i], renderingW, renderingH, footprints[i].pixTL, footprints[i].pixBR);
+    }
+
+    // Shadow rays went to the same lights last time, as editing a light renders every tile
+    std::vector<Vec3f> lights;
+
+    for (int light : renderingScene->getLights())
+    {
+        lights.push_back(renderingScene->spheres[light].center);
+    }
+
+    tiles.clear();
+
+    for (int y = 0; y < renderingH; y += tileH)
     {
-        // Wait for all threads to finish
-        for (auto &future : futures)
+        for (int x = 0; x < renderingW; x += tileW)
         {
-            future.wait();
+            Range2D tile{ x, y, std::min(x + tileW, renderingW), std::min(y + tileH, renderingH) };
+            int cell = getCell(tile);
+
+            if (isTileDirty(cell, footprints, lights))
+            {
+                // Until it's finished, the tile shows neither the old scene nor the new one
+                tileSamples[cell] = 0;
+                tiles.push_back(tile);
+            }
         }
+    }
+
+    editedSpheres.clear();
+    lastEditedSphere = -1;
+    fullRenderNeeded = false;
 
-        ms = timer.stop();
+    launchRender(multiThreaded);
+}
+
+/// <summary>
+/// Start adding one more sample to every pixel of each tile that has finished
+/// rendering but doesn't have maxSamples yet, without waiting for it to finish.
+/// The tiles are rendered the same way as by startRender(), at full resolution.
+/// Nothing is started if every tile is done, or while a render is in progress,
+/// as its tiles' sums could still be being read.
+/// </summary>
+void Raytracer::startAccumulation()
+{
+    // Every tile of the last render has been shown once it's no longer rendering,
+    // so no sample is added to pixels the main thread is still resolving
+    if (rendering || !renderingScene || fullRenderNeeded)
+    {
+        return;
+    }
+
+    accumulatingSample = maxSamples;
+    tiles.clear();
+
+    for (int y = 0; y < renderingH; y += gridTileH)
+    {
+        for (int x = 0; x < renderingW; x += gridTileW)
+        {
+            Range2D tile{ x, y, std::min(x + gridTileW, renderingW), std::min(y + gridTileH, renderingH) };
+            int samples = tileSamples[getCell(tile)];
+
+            if (samples > 0 && samples < maxSamples)
+            {
+                accumulatingSample = std::min(accumulatingSample, samples + 1);
+                tiles.push_back(tile);
+            }
+        }
     }
+
+    passSteps.assign(1, 1);
+    accumulating = true;
+
+    launchRender(multiThreaded);
 }
 
 /// <summary>
-/// Mix utility function.
+/// Start rendering every pass of the tiles in tiles, from the centre of the
+/// image out. Does nothing if there are no tiles.
 /// </summary>
-/// <param name="a">First value to mix.</param>
-/// <param name="b">Second value to mix.</param>
-/// <param name="mix">Mix value.</param>
-/// <returns>The resulting mixed value.</returns>
-float Raytracer::mix(const float &a, const float &b, const float &mix)
+/// <param name="multiThreaded">False for single-threaded and true for multi-threaded.</param>
+void Raytracer::launchRender(bool multiThreaded)
 {
-	return b * mix + a * (1 - mix);
+    if (tiles.empty())
+    {
+        return;
+    }
+
+    // Sort by each tile's distance from the centre of the image (doubled, to stay in whole numbers)
+    auto distance = [this](const Range2D &tile)
+    {
+        long long dx = tile.beginX + tile.endX - renderingW;
+        long long dy = tile.beginY + tile.endY - renderingH;
+
+        return dx * dx + dy * dy;
+    };
+
+    std::stable_sort(tiles.begin(), tiles.end(), [&](const Range2D &a, const Range2D &b) { return distance(a) < distance(b); });
+
+    int tileAmount = static_cast<int>(tiles.size());
+    workAmount = tileAmount * static_cast<int>(passSteps.size());
+    finishedTiles.reset(workAmount);
+
+    // Every tile's first pass is ready straight away, the rest once the pass before is shown
+    readyWork.resize(workAmount);
+
+    for (int i = 0; i < tileAmount; ++i)
+    {
+        readyWork[i] = i;
+    }
+
+    readyAmount.store(tileAmount);
+    nextReady.store(0);
+    activeWorkers.store(0);
+    renderedWork.store(0);
+    cancelled.store(false);
+    mainThreadMs = 0.0;
+    rendering = true;
+
+    // The main thread keeps running the UI, so only the pool's threads can render
+    renderWorkers = std::min({ threadLimit, static_cast<int>(threadPool->getThreadAmount()), tileAmount });
+    renderingMultiThreaded = multiThreaded && renderWorkers > 0;
+
+    poolStats.begin();
+    perfCounters.begin();
+    renderStart = Timer::Clock::now();
+
+    // Binning is part of rendering, so it's timed with it
+    if (renderingScene->useBins)
+    {
+        Timer timer("Raytracer Binning");
+        renderingScene->binSpheres(renderingW, renderingH);
+        mainThreadMs += timer.stop();
+    }
+
+    if (renderingMultiThreaded)
+    {
+        startRenderWorkers();
+    }
 }
 
 /// <summary>
-/// This is the main trace function. It takes a ray as argument (defined by its origin
-/// and direction). We test if this ray intersects any of the geometry in the scene.
-/// If the ray intersects an object, we compute the intersection point, the normal
-/// at the intersection point, and shade this point using this information.
-/// Shading depends on the surface property (is it transparent, reflective or diffuse?).
-/// The function returns a colour for the ray. If no intersection occurs, the background
-/// colour is returned.
+/// Move the render in progress along. Called once a frame: renders some tiles
+/// if single-threaded, then shows every tile that has been finished.
 /// </summary>
-/// <param name="rayOrigin">The origin point of the ray.</param>
-/// <param name="rayDir">The direction of the ray.</param>
-/// <param name="depth">Depth of recursion.</param>
-/// <returns>The ray colour.</returns>
-Vec3f Raytracer::trace(const Vec3f &rayOrigin, const Vec3f &rayDir, const int &depth)
+void Raytracer::updateRender()
 {
-    float tNear = INFINITY;
-    const Sphere *sphere = nullptr;
+    if (!rendering)
+    {
+        return;
+    }
 
-    // Find the intersection of this ray with the sphere in the scene
-    for (unsigned i = 0; i < spheres.size(); ++i)
+    if (!renderingMultiThreaded)
     {
-        float t0 = INFINITY;
-        float t1 = INFINITY;
+        // At least one tile is rendered each frame, so huge tiles still get finished
+        Timer timer("Raytracer Frame");
+
+        int work = 0;
 
-        if (spheres[i].intersect(rayOrigin, rayDir, t0, t1))
+        while (takeReadyWork(work))
         {
-            if (t0 < 0)
-            {
-                t0 = t1;
-            }
+            renderTile(work);
+
+            // The tile's next pass is only ready once this one has been shown
+            showFinishedTiles();
 
-            if (t0 < tNear)
+            if (timer.stop() >= FRAME_BUDGET_MS)
             {
-                tNear = t0;
-                sphere = &spheres[i];
+                break;
             }
         }
+
+        mainThreadMs += timer.stop();
     }
 
-    // If there's no intersection then return black or background color
-    if (!sphere)
+    showFinishedTiles();
+
+    if (finishedTiles.getPopped() == workAmount)
     {
-        return backgroundColour;
+        finishRender();
+
+        // The execution time is the render's, not how long a sample took
+        if (accumulating)
+        {
+            return;
+        }
+
+        if (renderingMultiThreaded)
+        {
+            ms = std::chrono::duration<double, std::milli>(renderEnd - renderStart).count();
+        }
+        else
+        {
+            ms = mainThreadMs;
+        }
     }
+}
 
-    Vec3f surfaceColour = 0; // The colour of the surface at the ray intersection point
-    Vec3f pHit = rayOrigin + rayDir * tNear; // The point of intersection
-    Vec3f nHit = pHit - sphere->center; // The normal at the intersection point
+/// <summary>
+/// Stop the render in progress, if any. Tiles already being rendered are
+/// finished and shown, the rest are left as they were.
+/// </summary>
+void Raytracer::cancelRender()
+{
+    if (!rendering)
+    {
+        return;
+    }
 
-    nHit.normalize();
+    cancelled.store(true);
+    finishRender();
+    showFinishedTiles();
+}
 
-    // If the normal and the view direction are not opposite to each other then
-    // reverse the normal direction. That also means we are inside the sphere, so set
-    // the inside bool to true. Finally, reverse the sign of IdotN which we want
-    // positive
-    float bias = 1e-4; // Add some bias to the point from which we will be tracing
-    bool inside = false;
+/// <summary>
+/// Keep rendering the next ready tile until there are none ready or the render
+/// is cancelled. Run by the render jobs on the pool's threads in a multi-threaded
+/// render. Rather than waiting for more tiles to be ready, the job ends, and
+/// showFinishedTiles() adds more jobs once there are.
+/// </summary>
+void Raytracer::renderTiles()
+{
+    int work = 0;
 
-    if (rayDir.dot(nHit) > 0)
+    while (true)
     {
-        nHit = -nHit;
-        inside = true;
+        while (!cancelled.load(std::memory_order_relaxed) && takeReadyWork(work))
+        {
+            renderTile(work);
+        }
+
+        activeWorkers.fetch_sub(1);
+
+        // Work made ready just as this job ran out may not have started another job for it
+        if (cancelled.load() || nextReady.load() >= readyAmount.load() || !claimWorker())
+        {
+            return;
+        }
     }
+}
 
-    if ((sphere->transparency > 0 || sphere->reflection > 0) && depth < maxBounces)
+/// <summary>
+/// Take the next piece of work that is ready to render, if any. Any thread can call this.
+/// </summary>
+/// <param name="work">Set to the work.</param>
+/// <returns>False if nothing is ready.</returns>
+bool Raytracer::takeReadyWork(int &work)
+{
+    int next = nextReady.load();
+
+    while (next < readyAmount.load(std::memory_order_acquire))
     {
-        float facingRatio = -rayDir.dot(nHit);
+        if (nextReady.compare_exchange_weak(next, next + 1))
+        {
+            work = readyWork[next];
 
-        // Change the mix value to tweak the effect
-        float fresnelEffect = mix(pow(1 - facingRatio, 3), 1, 0.1);
+            return true;
+        }
+    }
 
-        // Compute reflection direction (no need to normalize because all vectors
-        // are already normalized)
-        Vec3f reflDir = rayDir - nHit * 2 * rayDir.dot(nHit);
-        reflDir.normalize();
+    return false;
+}
 
-        Vec3f reflection = trace(pHit + nHit * bias, reflDir, depth + 1);
-        Vec3f refraction = 0;
+/// <summary>
+/// Count one more render job as running, if that keeps within renderWorkers.
+/// </summary>
+/// <returns>False if as many are running as are allowed.</returns>
+bool Raytracer::claimWorker()
+{
+    int active = activeWorkers.load();
 
-        // If the sphere is also transparent then compute refraction ray (transmission)
-        if (sphere->transparency)
+    while (active < renderWorkers)
+    {
+        if (activeWorkers.compare_exchange_weak(active, active + 1))
         {
-            float ior = 1.1;
-            float eta = (inside) ? ior : 1 / ior; // Are we inside or outside the surface?
-            float cosI = -nHit.dot(rayDir);
-            float k = 1 - eta * eta * (1 - cosI * cosI);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Add a render job to the pool for each piece of ready work that no job is
+/// running for yet, up to renderWorkers jobs in all.
+/// </summary>
+void Raytracer::startRenderWorkers()
+{
+    for (int waiting = readyAmount.load() - nextReady.load(); waiting > 0 && !cancelled.load() && claimWorker(); --waiting)
+    {
+        threadPool->addJob(renderJobs, [this] { renderTiles(); });
+    }
+}
+
+/// <summary>
+/// Render one pass of one tile and queue it to be shown. The pass before it
+/// has always been shown already, as it's only made ready after that.
+/// </summary>
+/// <param name="work">The pass times the number of tiles, plus the tile's place in tiles.</param>
+void Raytracer::renderTile(int work)
+{
+    PROFILE_SCOPE("Raytracer Tile");
+
+    int tileIndex = work % static_cast<int>(tiles.size());
+    int pass = work / static_cast<int>(tiles.size());
 
-            Vec3f refrDir = rayDir * eta + nHit * (eta * cosI - std::sqrt(k));
-            refrDir.normalize();
+    {
+        PERF_SCOPE(perfCounters.getTotals());
+
+        const Range2D &tile = tiles[tileIndex];
+        RayBounds &bounds = tileBounds[getCell(tile)];
 
-            refraction = trace(pHit - nHit * bias, refrDir, depth + 1);
+        // Every pass traces different pixels, and every sample different points of them, so their rays are added together
+        if (pass == 0 && !accumulating)
+        {
+            bounds.clear();
         }
 
-        // The result is a mix of reflection and refraction (if the sphere is transparent)
-        surfaceColour = (reflection * fresnelEffect + refraction * (1 - fresnelEffect) * sphere->transparency) * sphere->surfaceColour;
+        renderingScene->renderSection(hdrBuffer, { tile.beginX, tile.beginY }, { tile.endX, tile.endY },
+            passSteps[pass], pass > 0 ? passSteps[pass - 1] : 0, &bounds, accumulating);
     }
-    else
+
+    // The push below publishes renderEnd along with the tile's pixels
+    if (renderedWork.fetch_add(1) + 1 == workAmount)
     {
-        // It's a diffuse object so there's no need to trace any more
-        for (unsigned i = 0; i < spheres.size(); ++i)
-        {
-            if (spheres[i].emissionColour.x > 0)
-            {
-                // This is a light
-                Vec3f transmission = 1;
-                Vec3f lightDirection = spheres[i].center - pHit;
-                lightDirection.normalize();
+        renderEnd = Timer::Clock::now();
+    }
 
-                for (unsigned j = 0; j < spheres.size(); ++j)
-                {
-                    if (i != j)
-                    {
-                        float t0 = 0.0f;
-                        float t1 = 0.0f;
-
-                        if (spheres[j].intersect(pHit + nHit * bias, lightDirection, t0, t1))
-                        {
-                            transmission = 0;
-                            break;
-                        }
-                    }
-                }
+    finishedTiles.push(work);
+}
 
-                surfaceColour += sphere->surfaceColour * transmission * std::max(0.0f, nHit.dot(lightDirection)) * spheres[i].emissionColour;
-            }
+/// <summary>
+/// Tone map every finished tile that hasn't been shown yet into the texture.
+/// Only the tiles are uploaded, not the whole image. Once a tile's pass has
+/// been read, its next pass is made ready, and render jobs are added for it.
+/// </summary>
+void Raytracer::showFinishedTiles()
+{
+    int work = 0;
+
+    while (finishedTiles.tryPop(work))
+    {
+        int tileIndex = work % static_cast<int>(tiles.size());
+        const Range2D &tile = tiles[tileIndex];
+        int rowBytes = tile.width() * 4;
+
+        tileBuffer.resize(rowBytes * tile.height());
+
+        hdrBuffer.resolve(tileBuffer.data(), tile.beginX, tile.beginY, tile.endX, tile.endY, exposure, softClip);
+
+        renderTexture->update(tileBuffer.data(), tile.width(), tile.height(), tile.beginX, tile.beginY);
+
+        // Only now can the tile's next pass render over this one
+        if (work + static_cast<int>(tiles.size()) < workAmount)
+        {
+            readyWork[readyAmount.load(std::memory_order_relaxed)] = work + static_cast<int>(tiles.size());
+            readyAmount.fetch_add(1);
+        }
+
+        if (work / static_cast<int>(tiles.size()) == static_cast<int>(passSteps.size()) - 1)
+        {
+            int &samples = tileSamples[getCell(tile)];
+            samples = accumulating ? samples + 1 : 1;
         }
     }
 
-    return surfaceColour + sphere->emissionColour;
+    if (rendering && renderingMultiThreaded)
+    {
+        startRenderWorkers();
+    }
 }
 
 /// <summary>
-/// Raytrace a section of the image.
-/// We compute a camera ray for each pixel of the image,
-/// trace it and return a colour. If the ray hits a sphere, we return the colour of the
-/// sphere at the intersection point, otherwise we return the background colour.
+/// Wait for the pool's threads to stop rendering, and end the render.
 /// </summary>
-/// <param name="pixTL">The coordinate of the upper-left corner of the section.</param>
-/// <param name="pixBR">The coordinate of the lower-right corner of the section.</param>
-void Raytracer::renderSection(sf::Vector2i pixTL, sf::Vector2i pixBR)
+void Raytracer::finishRender()
 {
-	float invWidth = 1.0f / static_cast<float>(renderW);
-	float invHeight = 1.0f / static_cast<float>(renderH);
-	float aspectRatio = static_cast<float>(renderW) / static_cast<float>(renderH);
-	float angle = std::tan(PI * 0.5f * fov / 180.0f);
+    threadPool->wait(renderJobs);
 
-	for (unsigned int y = pixTL.y; y < pixBR.y; ++y)
-	{
-		for (unsigned int x = pixTL.x; x < pixBR.x; ++x)
-		{
-			int index = (y * renderW + x);
+    rendering = false;
+    poolStats.end();
+    perfCounters.end();
+}
 
-            // Out of bounds check
-            if (index < 0 || (index * 4) > (pixelArray.size() - 1))
-            {
-                continue;
-            }
+/// <summary>
+/// Render a real-time frame of the scene as it is now, waiting for it to finish,
+/// and show it. Any render in progress is cancelled, such as one started by a
+/// Render button, as the frame replaces the whole image anyway.
+/// </summary>
+void Raytracer::renderRealTime()
+{
+    cancelRender();
 
-			float xx = (2 * ((x + 0.5) * invWidth) - 1) * angle * aspectRatio;
-			float yy = (1 - 2 * ((y + 0.5) * invHeight)) * angle;
+    poolStats.begin();
 
-			Vec3f rayDir(xx, yy, -1);
-			rayDir.normalize();
-			Vec3f pixel = trace(rayOrigin, rayDir, 0);
+    ms = dynamicResolution.renderFrame(scene, *threadPool, multiThreaded ? threadLimit : 1, { renderTileW, renderTileH }, pixelArray, renderW, renderH, exposure, softClip);
 
-			// Update pixel array - RGBA
-			pixelArray[index * 4] = (uint8_t)(std::min(1.0f, pixel.x) * 255);
-			pixelArray[(index * 4) + 1] = (uint8_t)(std::min(1.0f, pixel.y) * 255);
-			pixelArray[(index * 4) + 2] = (uint8_t)(std::min(1.0f, pixel.z) * 255);
-			pixelArray[(index * 4) + 3] = 255;
-		}
-	}
-}
\ No newline at end of file
+    poolStats.end();
+
+    if (renderTexture->getSize() != sf::Vector2u(renderW, renderH))
+    {
+        renderTexture = std::make_unique<sf::Texture>();
+        renderTexture->create(renderW, renderH);
+    }
+
+    renderTexture->update(pixelArray.data());
+}
+
+/// <summary>
+/// Tone map the whole image into the texture again, with the current exposure and soft clip.
+/// </summary>
+void Raytracer::resolveImage()
+{
+    pixelArray.resize(renderingW * renderingH * 4);
+    hdrBuffer.resolve(pixelArray.data(), 0, 0, renderingW, renderingH, exposure, softClip);
+
+    renderTexture->update(pixelArray.data());
+    resolveNeeded = false;
+}
+
+/// <summary>
+/// Check whether a tile needs rendering again after the spheres in editedSpheres
+/// were edited, with isSectionDirty().
+/// </summary>
+/// <param name="cell">The tile's place in the grid.</param>
+/// <param name="footprints">The pixels each edited sphere could cover.</param>
+/// <param name="lights">The centers of the lights.</param>
+/// <returns>True if the tile could look different.</returns>
+bool Raytracer::isTileDirty(int cell, const std::vector<Footprint> &footprints, const std::vector<Vec3f> &lights) const
+{
+    int x = cell % gridColumns * gridTileW;
+    int y = cell / gridColumns * gridTileH;
+
+    return isSectionDirty({ x, y }, { std::min(x + gridTileW, renderingW), std::min(y + gridTileH, renderingH) }, tileSamples[cell] > 0,
+        tileBounds[cell], editedSpheres, footprints, lights);
+}
+
+/// <summary>
+/// Get a tile's place in the grid of tiles.
+/// </summary>
+/// <param name="tile">The tile.</param>
+/// <returns>Its row times the number of columns, plus its column.</returns>
+int Raytracer::getCell(const Range2D &tile) const
+{
+    return tile.beginY / gridTileH * gridColumns + tile.beginX / gridTileW;
+}
+
+/// <summary>
+/// Render the scene on a given number of threads, for the scaling sweep.
+/// </summary>
+/// <param name="threads">The number of threads to use, 1 for the single-threaded path.</param>
+/// <returns>The time taken in milliseconds.</returns>
+double Raytracer::runAtThreads(int threads)
+{
+    int savedLimit = threadLimit;
+
+    threadLimit = threads;
+    render(threads > 1);
+    threadLimit = savedLimit;
+
+    return ms;
+}
@@ -0,0 +1,193 @@
+#include "ScalingPanel.h"
+
+#include <algorithm>
+#include <vector>
+
+/// <summary>
+/// ScalingPanel constructor.
+/// </summary>
+/// <param name="threadPool">The pool the test runs on. The sweep goes up to its threads plus the main thread.</param>
+/// <param name="testName">The test's name, used for the CSV file name. This must be a string literal.</param>
+ScalingPanel::ScalingPanel(ThreadPool &threadPool, const char *testName) : threadPool(&threadPool), testName(testName)
+{
+
+}
+
+/// <summary>
+/// ScalingPanel destructor.
+/// </summary>
+ScalingPanel::~ScalingPanel()
+{
+
+}
+
+/// <summary>
+/// Draw the sweep settings and, once a sweep has run, its results.
+/// </summary>
+/// <param name="runAtThreads">Runs the test once on the given number of threads and returns the time it took in milliseconds.</param>
+void ScalingPanel::handleUI(const std::function<double(int threads)> &runAtThreads)
+{
+	ImGui::PushID(this);
+
+	ImGui::SeparatorText("Thread Scaling");
+
+	ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+	ImGui::SliderInt("Warmup Runs", &settings.warmup, 0, 5);
+	ImGui::SliderInt("Timed Runs", &settings.repetitions, 1, 30);
+
+	ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+	if (ImGui::Button("Run Sweep", ImVec2(110, 24)))
+	{
+		int maxThreads = static_cast<int>(threadPool->getThreadAmount()) + 1;
+		result = ScalingSweep::run(testName, runAtThreads, ScalingSweep::getThreadCounts(maxThreads), settings);
+		status.clear();
+	}
+
+	if (result.points.empty())
+	{
+		ImGui::Dummy(ImVec2(0.0f, 8.0f));
+		ImGui::Text("Run a sweep to see how the test\nscales from 1 to %d threads", static_cast<int>(threadPool->getThreadAmount()) + 1);
+		ImGui::Dummy(ImVec2(0.0f, 8.0f));
+		ImGui::PopID();
+
+		return;
+	}
+
+	ImGui::SameLine();
+
+	if (ImGui::Button("Export CSV", ImVec2(110, 24)))
+	{
+		std::string path = std::string(testName) + "_scaling.csv";
+
+		// File names don't get spaces
+		std::replace(path.begin(), path.end(), ' ', '_');
+
+		status = ScalingSweep::saveCsv(path, { result }) ? "Saved " + path : "Couldn't write " + path;
+	}
+
+	if (!status.empty())
+	{
+		ImGui::Text(status.c_str());
+	}
+
+	ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+	if (result.serialFraction > 0.0)
+	{
+		ImGui::Text("Serial fraction: %.1f%% (speedup can't pass %.1fx)", result.serialFraction * 100.0, 1.0 / result.serialFraction);
+	}
+	else
+	{
+		ImGui::Text("Serial fraction: 0%% (no limit found)");
+	}
+
+	ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+	drawSpeedupPlot();
+
+	ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+	std::vector<float> efficiencies;
+
+	for (auto &point : result.points)
+	{
+		efficiencies.push_back(static_cast<float>(point.efficiency));
+	}
+
+	ImGui::PlotHistogram("Efficiency", efficiencies.data(), static_cast<int>(efficiencies.size()), 0, nullptr, 0.0f, 1.0f, ImVec2(0.0f, 80.0f));
+
+	ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+	ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit;
+
+	if (ImGui::BeginTable("Scaling", 6, flags))
+	{
+		ImGui::TableSetupColumn("Threads");
+		ImGui::TableSetupColumn("Median");
+		ImGui::TableSetupColumn("p95");
+		ImGui::TableSetupColumn("Speedup");
+		ImGui::TableSetupColumn("Efficiency");
+		ImGui::TableSetupColumn("Amdahl");
+		ImGui::TableHeadersRow();
+
+		for (auto &point : result.points)
+		{
+			ImGui::TableNextRow();
+
+			ImGui::TableNextColumn();
+			ImGui::Text("%d", point.threads);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3fms", point.summary.median);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3fms", point.summary.p95);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.2fx", point.speedup);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f%%", point.efficiency * 100.0);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.2fx", ScalingSweep::getAmdahlSpeedup(result.serialFraction, point.threads));
+		}
+
+		ImGui::EndTable();
+	}
+
+	ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+	ImGui::PopID();
+}
+
+/// <summary>
+/// Draw speedup against threads. Grey is ideal scaling, yellow is the
+/// fitted Amdahl curve and green is what was measured.
+/// </summary>
+void ScalingPanel::drawSpeedupPlot()
+{
+	int maxThreads = result.points.back().threads;
+	double maxSpeedup = maxThreads;
+
+	for (auto &point : result.points)
+	{
+		maxSpeedup = std::max(maxSpeedup, point.speedup);
+	}
+
+	ImVec2 size(std::max(ImGui::GetContentRegionAvail().x, 100.0f), 160.0f);
+	ImVec2 topLeft = ImGui::GetCursorScreenPos();
+	ImVec2 bottomRight(topLeft.x + size.x, topLeft.y + size.y);
+	ImDrawList *drawList = ImGui::GetWindowDrawList();
+
+	// Map a thread count and speedup to a point on the plot
+	auto toScreen = [&](double threads, double speedup)
+	{
+		float x = maxThreads > 1 ? static_cast<float>((threads - 1.0) / (maxThreads - 1.0)) : 0.0f;
+		float y = static_cast<float>(speedup / maxSpeedup);
+
+		return ImVec2(topLeft.x + x * size.x, bottomRight.y - y * size.y);
+	};
+
+	drawList->AddRectFilled(topLeft, bottomRight, ImGui::GetColorU32(ImGuiCol_FrameBg));
+	drawList->AddLine(toScreen(1.0, 1.0), toScreen(maxThreads, maxThreads), IM_COL32(128, 128, 128, 255));
+
+	for (int threads = 1; threads < maxThreads; ++threads)
+	{
+		drawList->AddLine(toScreen(threads, ScalingSweep::getAmdahlSpeedup(result.serialFraction, threads)),
+			toScreen(threads + 1, ScalingSweep::getAmdahlSpeedup(result.serialFraction, threads + 1)), IM_COL32(230, 200, 50, 255));
+	}
+
+	for (std::size_t i = 0; i < result.points.size(); ++i)
+	{
+		ImVec2 point = toScreen(result.points[i].threads, result.points[i].speedup);
+
+		if (i > 0)
+		{
+			drawList->AddLine(toScreen(result.points[i - 1].threads, result.points[i - 1].speedup), point, IM_COL32(80, 220, 100, 255), 2.0f);
+		}
+
+		drawList->AddCircleFilled(point, 3.0f, IM_COL32(80, 220, 100, 255));
+	}
+
+	ImGui::Dummy(size);
+
+	ImGui::Text("Speedup (0-%.1fx) over 1-%d threads", maxSpeedup, maxThreads);
+}
@@ -0,0 +1,146 @@
+#include "ScalingSweep.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+/// <summary>
+/// Get the thread counts to sweep: the powers of two below the highest
+/// count, then the highest count itself.
+/// </summary>
+/// <param name="maxThreads">The highest thread count.</param>
+/// <returns>The thread counts, lowest first.</returns>
+std::vector<int> ScalingSweep::getThreadCounts(int maxThreads)
+{
+	std::vector<int> threadCounts;
+
+	for (int threads = 1; threads < maxThreads; threads *= 2)
+	{
+		threadCounts.push_back(threads);
+	}
+
+	threadCounts.push_back(std::max(maxThreads, 1));
+
+	return threadCounts;
+}
+
+/// <summary>
+/// Run a workload at every thread count and analyse the results.
+/// </summary>
+/// <param name="workload">The workload name.</param>
+/// <param name="runAtThreads">Runs the workload once on the given number of threads and returns the time it took in milliseconds.</param>
+/// <param name="threadCounts">The thread counts to run at.</param>
+/// <param name="settings">The number of warmup and timed runs at each thread count.</param>
+/// <returns>The results.</returns>
+ScalingResult ScalingSweep::run(const std::string &workload, const std::function<double(int threads)> &runAtThreads, const std::vector<int> &threadCounts, const BenchmarkSettings &settings)
+{
+	ScalingResult result;
+	result.workload = workload;
+
+	for (int threads : threadCounts)
+	{
+		ScalingPoint point;
+		point.threads = threads;
+		point.summary = Benchmark::summarise(Benchmark::run([&] { return runAtThreads(threads); }, settings));
+
+		result.points.push_back(point);
+	}
+
+	analyse(result);
+
+	return result;
+}
+
+/// <summary>
+/// Work out the speedup and efficiency at every thread count and fit the serial fraction.
+/// The median time at 1 thread is the baseline. Without a 1 thread result,
+/// the lowest thread count is assumed to have scaled perfectly.
+/// </summary>
+/// <param name="result">The results to analyse.</param>
+void ScalingSweep::analyse(ScalingResult &result)
+{
+	if (result.points.empty())
+	{
+		return;
+	}
+
+	std::sort(result.points.begin(), result.points.end(), [](const ScalingPoint &a, const ScalingPoint &b)
+		{
+			return a.threads < b.threads;
+		});
+
+	const ScalingPoint &base = result.points.front();
+	double singleThreadMs = base.summary.median * base.threads;
+
+	for (auto &point : result.points)
+	{
+		point.speedup = point.summary.median > 0.0 ? singleThreadMs / point.summary.median : 0.0;
+		point.efficiency = point.speedup / point.threads;
+	}
+
+	// Amdahl's law says time(n) / time(1) = s + (1 - s) / n, which is a
+	// straight line through the origin once 1 / n is moved to the left:
+	// time(n) / time(1) - 1 / n = s * (1 - 1 / n). Least squares then
+	// gives s directly. The 1 thread result always fits, so it adds nothing
+	double numerator = 0.0;
+	double denominator = 0.0;
+
+	for (auto &point : result.points)
+	{
+		if (point.threads <= 1 || point.speedup <= 0.0)
+		{
+			continue;
+		}
+
+		double inverse = 1.0 / point.threads;
+		double a = 1.0 / point.speedup - inverse;
+		double b = 1.0 - inverse;
+
+		numerator += a * b;
+		denominator += b * b;
+	}
+
+	result.serialFraction = denominator > 0.0 ? std::clamp(numerator / denominator, 0.0, 1.0) : 0.0;
+}
+
+/// <summary>
+/// Get the speedup Amdahl's law predicts.
+/// </summary>
+/// <param name="serialFraction">The share of the work that can't run in parallel, between 0 and 1.</param>
+/// <param name="threads">The number of threads.</param>
+/// <returns>The predicted speedup.</returns>
+double ScalingSweep::getAmdahlSpeedup(double serialFraction, int threads)
+{
+	return 1.0 / (serialFraction + (1.0 - serialFraction) / std::max(threads, 1));
+}
+
+/// <summary>
+/// Save results as CSV, one row per workload and thread count.
+/// </summary>
+/// <param name="path">The file to write.</param>
+/// <param name="results">The results.</param>
+/// <returns>True if the file was written.</returns>
+bool ScalingSweep::saveCsv(const std::string &path, const std::vector<ScalingResult> &results)
+{
+	std::ofstream file(path);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	file << std::fixed << std::setprecision(4);
+	file << "workload,threads,median,min,p95,stddev,speedup,efficiency,amdahl_speedup,serial_fraction\n";
+
+	for (auto &result : results)
+	{
+		for (auto &point : result.points)
+		{
+			file << result.workload << "," << point.threads << "," << point.summary.median << "," << point.summary.min << ","
+				<< point.summary.p95 << "," << point.summary.stddev << "," << point.speedup << "," << point.efficiency << ","
+				<< getAmdahlSpeedup(result.serialFraction, point.threads) << "," << result.serialFraction << "\n";
+		}
+	}
+
+	return file.good();
+}
@@ -0,0 +1,385 @@
+#include "SphereSoA.h"
+#include "RayScene.h"
+#include "SIMD.h"
+
+#include <algorithm>
+#include <atomic>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+    // The number of spheres tested at once
+    const int SIMD_WIDTH = 8;
+
+    /// <summary>
+    /// Ask the CPU and OS whether AVX can be used.
+    /// </summary>
+    /// <returns>True if AVX instructions will run.</returns>
+    bool detectAVX()
+    {
+#if defined(USE_AVX) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+
+        // The CPU must have AVX, and the OS must save the YMM registers on a context switch
+        bool hasAVX = (info[2] & (1 << 28)) != 0;
+        bool hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+
+        return hasAVX && hasOSXSAVE && (_xgetbv(0) & 6) == 6;
+#elif defined(USE_AVX)
+        return __builtin_cpu_supports("avx");
+#else
+        return false;
+#endif
+    }
+
+    const bool simdAvailable = detectAVX();
+    std::atomic<bool> simdEnabled{ simdAvailable };
+}
+
+/// <summary>
+/// Remove every sphere.
+/// </summary>
+void SphereSoA::clear()
+{
+    resize(0);
+}
+
+/// <summary>
+/// Change the number of slots. New slots must be set before they're tested.
+/// </summary>
+/// <param name="amount">The number of slots.</param>
+void SphereSoA::resize(int amount)
+{
+    // Pad the end so a group of 8 can always be loaded, even from the last slot
+    std::size_t padded = static_cast<std::size_t>(amount) + SIMD_WIDTH - 1;
+
+    centerX.resize(padded, 0.0f);
+    centerY.resize(padded, 0.0f);
+    centerZ.resize(padded, 0.0f);
+    radius2.resize(padded, 0.0f);
+    sphereIndices.resize(padded, -1);
+    size = amount;
+}
+
+/// <summary>
+/// Store a sphere in a slot.
+/// </summary>
+/// <param name="slot">The slot.</param>
+/// <param name="sphere">The sphere.</param>
+/// <param name="sphereIndex">The sphere's index in the scene, which is returned for hits.</param>
+void SphereSoA::set(int slot, const Sphere &sphere, int sphereIndex)
+{
+    centerX[slot] = sphere.center.x;
+    centerY[slot] = sphere.center.y;
+    centerZ[slot] = sphere.center.z;
+    radius2[slot] = sphere.radius2;
+    sphereIndices[slot] = sphereIndex;
+}
+
+/// <summary>
+/// Copy one slot over another.
+/// </summary>
+/// <param name="from">The slot to copy.</param>
+/// <param name="to">The slot to overwrite.</param>
+void SphereSoA::copy(int from, int to)
+{
+    centerX[to] = centerX[from];
+    centerY[to] = centerY[from];
+    centerZ[to] = centerZ[from];
+    radius2[to] = radius2[from];
+    sphereIndices[to] = sphereIndices[from];
+}
+
+/// <summary>
+/// Change which sphere in the scene a slot belongs to, without moving it.
+/// </summary>
+/// <param name="slot">The slot.</param>
+/// <param name="sphereIndex">The sphere's new index in the scene.</param>
+void SphereSoA::setSphereIndex(int slot, int sphereIndex)
+{
+    sphereIndices[slot] = sphereIndex;
+}
+
+/// <summary>
+/// Get the number of slots.
+/// </summary>
+/// <returns>The number of slots.</returns>
+int SphereSoA::getSize() const
+{
+    return size;
+}
+
+/// <summary>
+/// Find the closest sphere a ray hits out of a run of slots. Ties go to the
+/// earliest slot, the same as testing the spheres one by one.
+/// </summary>
+/// <param name="first">The first slot.</param>
+/// <param name="count">The number of slots.</param>
+/// <param name="rayOrigin">The origin point of the ray.</param>
+/// <param name="rayDir">The direction of the ray.</param>
+/// <param name="tNear">The distance to the closest hit. Only hits closer than its starting value count.</param>
+/// <param name="hitIndex">The scene index of the sphere that was hit.</param>
+/// <returns>True if a sphere was hit.</returns>
+bool SphereSoA::closestHit(int first, int count, const Vec3f &rayOrigin, const Vec3f &rayDir, float &tNear, int &hitIndex) const
+{
+    if (simdEnabled.load(std::memory_order_relaxed))
+    {
+        return closestHitSIMD(first, count, rayOrigin, rayDir, tNear, hitIndex);
+    }
+
+    return closestHitScalar(first, count, rayOrigin, rayDir, tNear, hitIndex);
+}
+
+/// <summary>
+/// Check whether a ray hits any sphere in a run of slots.
+/// </summary>
+/// <param name="first">The first slot.</param>
+/// <param name="count">The number of slots.</param>
+/// <param name="rayOrigin">The origin point of the ray.</param>
+/// <param name="rayDir">The direction of the ray.</param>
+/// <param name="ignoreIndex">The scene index of a sphere to leave out, or -1.</param>
+/// <param name="hitIndex">Set to the scene index of the sphere that was hit, left alone if none was.</param>
+/// <returns>True if a sphere was hit.</returns>
+bool SphereSoA::anyHit(int first, int count, const Vec3f &rayOrigin, const Vec3f &rayDir, int ignoreIndex, int &hitIndex) const
+{
+    if (simdEnabled.load(std::memory_order_relaxed))
+    {
+        return anyHitSIMD(first, count, rayOrigin, rayDir, ignoreIndex, hitIndex);
+    }
+
+    return anyHitScalar(first, count, rayOrigin, rayDir, ignoreIndex, hitIndex);
+}
+
+/// <summary>
+/// Check whether this CPU can run the SIMD path.
+/// </summary>
+/// <returns>True if AVX is available and SIMD wasn't compiled out.</returns>
+bool SphereSoA::isSIMDAvailable()
+{
+    return simdAvailable;
+}
+
+/// <summary>
+/// Turn the SIMD path on or off for every SphereSoA. It can't be turned on if it isn't available.
+/// </summary>
+/// <param name="enabled">True to use SIMD.</param>
+void SphereSoA::setSIMDEnabled(bool enabled)
+{
+    simdEnabled.store(enabled && simdAvailable);
+}
+
+/// <summary>
+/// Check whether the SIMD path is being used.
+/// </summary>
+/// <returns>True if SIMD is in use.</returns>
+bool SphereSoA::isSIMDEnabled()
+{
+    return simdEnabled.load();
+}
+
+/// <summary>
+/// The one sphere at a time version of closestHit.
+/// </summary>
+bool SphereSoA::closestHitScalar(int first, int count, const Vec3f &rayOrigin, const Vec3f &rayDir, float &tNear, int &hitIndex) const
+{
+    bool hit = false;
+
+    for (int i = first; i < first + count; ++i)
+    {
+        // The same steps as Sphere::intersect
+        float lx = centerX[i] - rayOrigin.x;
+        float ly = centerY[i] - rayOrigin.y;
+        float lz = centerZ[i] - rayOrigin.z;
+        float tca = lx * rayDir.x + ly * rayDir.y + lz * rayDir.z;
+
+        if (tca < 0) { continue; }
+
+        float d2 = (lx * lx + ly * ly + lz * lz) - tca * tca;
+
+        if (d2 > radius2[i]) { continue; }
+
+        float thc = std::sqrt(radius2[i] - d2);
+        float t0 = tca - thc;
+
+        if (t0 < 0)
+        {
+            t0 = tca + thc;
+        }
+
+        if (t0 < tNear)
+        {
+            tNear = t0;
+            hitIndex = sphereIndices[i];
+            hit = true;
+        }
+    }
+
+    return hit;
+}
+
+/// <summary>
+/// The one sphere at a time version of anyHit.
+/// </summary>
+bool SphereSoA::anyHitScalar(int first, int count, const Vec3f &rayOrigin, const Vec3f &rayDir, int ignoreIndex, int &hitIndex) const
+{
+    for (int i = first; i < first + count; ++i)
+    {
+        float lx = centerX[i] - rayOrigin.x;
+        float ly = centerY[i] - rayOrigin.y;
+        float lz = centerZ[i] - rayOrigin.z;
+        float tca = lx * rayDir.x + ly * rayDir.y + lz * rayDir.z;
+
+        if (tca < 0) { continue; }
+
+        float d2 = (lx * lx + ly * ly + lz * lz) - tca * tca;
+
+        if (d2 > radius2[i]) { continue; }
+
+        if (sphereIndices[i] != ignoreIndex)
+        {
+            hitIndex = sphereIndices[i];
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#ifdef USE_AVX
+
+/// <summary>
+/// The 8 spheres at a time version of closestHit. Each group of 8 is tested
+/// with AVX, then any hits are checked against tNear in slot order.
+/// </summary>
+AVX_FUNCTION bool SphereSoA::closestHitSIMD(int first, int count, const Vec3f &rayOrigin, const Vec3f &rayDir, float &tNear, int &hitIndex) const
+{
+    const __m256 originX = _mm256_set1_ps(rayOrigin.x);
+    const __m256 originY = _mm256_set1_ps(rayOrigin.y);
+    const __m256 originZ = _mm256_set1_ps(rayOrigin.z);
+    const __m256 dirX = _mm256_set1_ps(rayDir.x);
+    const __m256 dirY = _mm256_set1_ps(rayDir.y);
+    const __m256 dirZ = _mm256_set1_ps(rayDir.z);
+    const __m256 zero = _mm256_setzero_ps();
+
+    bool hit = false;
+    int end = first + count;
+
+    for (int i = first; i < end; i += SIMD_WIDTH)
+    {
+        __m256 lx = _mm256_sub_ps(_mm256_loadu_ps(&centerX[i]), originX);
+        __m256 ly = _mm256_sub_ps(_mm256_loadu_ps(&centerY[i]), originY);
+        __m256 lz = _mm256_sub_ps(_mm256_loadu_ps(&centerZ[i]), originZ);
+        __m256 r2 = _mm256_loadu_ps(&radius2[i]);
+
+        __m256 tca = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, dirX), _mm256_mul_ps(ly, dirY)), _mm256_mul_ps(lz, dirZ));
+        __m256 l2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, lx), _mm256_mul_ps(ly, ly)), _mm256_mul_ps(lz, lz));
+        __m256 d2 = _mm256_sub_ps(l2, _mm256_mul_ps(tca, tca));
+
+        // "Not less than" and "not greater than" so NaNs pass, as they do in the scalar tests
+        __m256 valid = _mm256_and_ps(_mm256_cmp_ps(tca, zero, _CMP_NLT_UQ), _mm256_cmp_ps(d2, r2, _CMP_NGT_UQ));
+        int mask = _mm256_movemask_ps(valid);
+
+        // Leave out the slots past the end of the run
+        if (end - i < SIMD_WIDTH)
+        {
+            mask &= (1 << (end - i)) - 1;
+        }
+
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        __m256 thc = _mm256_sqrt_ps(_mm256_sub_ps(r2, d2));
+        __m256 t0 = _mm256_sub_ps(tca, thc);
+        __m256 t1 = _mm256_add_ps(tca, thc);
+        __m256 t = _mm256_blendv_ps(t0, t1, _mm256_cmp_ps(t0, zero, _CMP_LT_OQ));
+
+        alignas(32) float distances[SIMD_WIDTH];
+        _mm256_store_ps(distances, t);
+
+        for (int lane = 0; lane < SIMD_WIDTH; ++lane)
+        {
+            if ((mask & (1 << lane)) && distances[lane] < tNear)
+            {
+                tNear = distances[lane];
+                hitIndex = sphereIndices[i + lane];
+                hit = true;
+            }
+        }
+    }
+
+    return hit;
+}
+
+/// <summary>
+/// The 8 spheres at a time version of anyHit.
+/// </summary>
+AVX_FUNCTION bool SphereSoA::anyHitSIMD(int first, int count, const Vec3f &rayOrigin, const Vec3f &rayDir, int ignoreIndex, int &hitIndex) const
+{
+    const __m256 originX = _mm256_set1_ps(rayOrigin.x);
+    const __m256 originY = _mm256_set1_ps(rayOrigin.y);
+    const __m256 originZ = _mm256_set1_ps(rayOrigin.z);
+    const __m256 dirX = _mm256_set1_ps(rayDir.x);
+    const __m256 dirY = _mm256_set1_ps(rayDir.y);
+    const __m256 dirZ = _mm256_set1_ps(rayDir.z);
+    const __m256 zero = _mm256_setzero_ps();
+
+    int end = first + count;
+
+    for (int i = first; i < end; i += SIMD_WIDTH)
+    {
+        __m256 lx = _mm256_sub_ps(_mm256_loadu_ps(&centerX[i]), originX);
+        __m256 ly = _mm256_sub_ps(_mm256_loadu_ps(&centerY[i]), originY);
+        __m256 lz = _mm256_sub_ps(_mm256_loadu_ps(&centerZ[i]), originZ);
+
+        __m256 tca = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, dirX), _mm256_mul_ps(ly, dirY)), _mm256_mul_ps(lz, dirZ));
+        __m256 l2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, lx), _mm256_mul_ps(ly, ly)), _mm256_mul_ps(lz, lz));
+        __m256 d2 = _mm256_sub_ps(l2, _mm256_mul_ps(tca, tca));
+
+        __m256 valid = _mm256_and_ps(_mm256_cmp_ps(tca, zero, _CMP_NLT_UQ), _mm256_cmp_ps(d2, _mm256_loadu_ps(&radius2[i]), _CMP_NGT_UQ));
+        int mask = _mm256_movemask_ps(valid);
+
+        if (end - i < SIMD_WIDTH)
+        {
+            mask &= (1 << (end - i)) - 1;
+        }
+
+        for (int lane = 0; mask != 0 && lane < SIMD_WIDTH; ++lane)
+        {
+            if ((mask & (1 << lane)) && sphereIndices[i + lane] != ignoreIndex)
+            {
+                hitIndex = sphereIndices[i + lane];
+
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+#else
+
+/// <summary>
+/// Without AVX the SIMD path is never turned on, so this is never called.
+/// </summary>
+bool SphereSoA::closestHitSIMD(int first, int count, const Vec3f &rayOrigin, const Vec3f &rayDir, float &tNear, int &hitIndex) const
+{
+    return closestHitScalar(first, count, rayOrigin, rayDir, tNear, hitIndex);
+}
+
+/// <summary>
+/// Without AVX the SIMD path is never turned on, so this is never called.
+/// </summary>
+bool SphereSoA::anyHitSIMD(int first, int count, const Vec3f &rayOrigin, const Vec3f &rayDir, int ignoreIndex, int &hitIndex) const
+{
+    return anyHitScalar(first, count, rayOrigin, rayDir, ignoreIndex, hitIndex);
+}
+
+#endif
@@ -0,0 +1,140 @@
+#include "TaskGraph.h"
+
+/// <summary>
+/// TaskGraph destructor.
+/// Waits for a run that was started but never waited on, as its jobs
+/// still point at this graph.
+/// </summary>
+TaskGraph::~TaskGraph()
+{
+	wait();
+}
+
+/// <summary>
+/// Make one task wait for another.
+/// </summary>
+/// <param name="before">The task that must finish first.</param>
+/// <param name="after">The task that waits for it.</param>
+void TaskGraph::addEdge(TaskID before, TaskID after)
+{
+	tasks[before]->successors.push_back(after);
+	++tasks[after]->dependencies;
+}
+
+/// <summary>
+/// Remove every task so the graph can be built again.
+/// </summary>
+void TaskGraph::clear()
+{
+	wait();
+	tasks.clear();
+}
+
+/// <summary>
+/// Get the number of tasks in the graph.
+/// </summary>
+/// <returns>The number of tasks.</returns>
+std::size_t TaskGraph::size() const
+{
+	return tasks.size();
+}
+
+/// <summary>
+/// Start running the graph without waiting for it.
+/// Every task with no dependencies is added to the pool, so the calling
+/// thread is free to do other work before calling wait().
+/// </summary>
+/// <param name="threadPool">The pool to run the tasks on.</param>
+void TaskGraph::start(ThreadPool &threadPool)
+{
+	// Finish any previous run before the counts are reset
+	wait();
+
+	this->threadPool = &threadPool;
+
+	for (auto &task : tasks)
+	{
+		task->remaining.store(task->dependencies, std::memory_order_relaxed);
+	}
+
+	for (TaskID id = 0; id < tasks.size(); ++id)
+	{
+		if (tasks[id]->dependencies == 0)
+		{
+			submit(id);
+		}
+	}
+}
+
+/// <summary>
+/// Wait until every task in the graph has finished.
+/// The calling thread runs tasks itself while it waits.
+/// </summary>
+void TaskGraph::wait()
+{
+	if (threadPool != nullptr)
+	{
+		threadPool->wait(jobCounter);
+		threadPool = nullptr;
+	}
+}
+
+/// <summary>
+/// Run the graph and wait for it to finish.
+/// </summary>
+/// <param name="threadPool">The pool to run the tasks on.</param>
+void TaskGraph::run(ThreadPool &threadPool)
+{
+	start(threadPool);
+	wait();
+}
+
+/// <summary>
+/// Add a task to the pool as a job.
+/// </summary>
+/// <param name="id">The task to add.</param>
+void TaskGraph::submit(TaskID id)
+{
+	threadPool->addJob(jobCounter, [this, id] { runTask(id); });
+}
+
+/// <summary>
+/// Run a task, then start any task that was only waiting on it.
+/// If several become ready, all but the last go to the pool and the last
+/// one is run here, which saves a trip through the queues along a chain.
+/// The next task is added to the counter before this job reports that it
+/// has finished, so the counter can't reach zero while tasks are left.
+/// </summary>
+/// <param name="id">The task to run.</param>
+void TaskGraph::runTask(TaskID id)
+{
+	while (true)
+	{
+		Task &task = *tasks[id];
+
+		task.function();
+
+		TaskID next = tasks.size();
+
+		for (TaskID successor : task.successors)
+		{
+			// The last dependency to finish is the one that starts the task
+			if (tasks[successor]->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				if (next != tasks.size())
+				{
+					submit(next);
+				}
+
+				next = successor;
+			}
+		}
+
+		if (next == tasks.size())
+		{
+			break;
+		}
+
+		id = next;
+	}
+}
@@ -3,23 +3,21 @@
 /// <summary>
 /// TerrainGenerator constructor.
 /// </summary>
-TerrainGenerator::TerrainGenerator() : mt(rd())
+/// <param name="threadPool">The thread pool shared by all tests.</param>
+TerrainGenerator::TerrainGenerator(ThreadPool &threadPool) : threadPool(&threadPool), poolStats(threadPool), scalingPanel(threadPool, "Terrain Generator"), terrainMap(threadPool), mt(rd())
 {
-	noise = std::make_unique<Noise>();
+	// Use every pool thread plus the main thread until the user lowers it
+	threadLimit = static_cast<int>(threadPool.getThreadAmount()) + 1;
 
-	// Default map
-	generate(mapWidth, mapHeight, 500, heightMap);
+	terrainMap.setPerfTotals(perfCounters.getTotals());
 
-	pixelArray.resize(mapWidth * mapHeight * 4); // RGBA values stored here
+	// Default map
+	generate(mapWidth, mapHeight, 500);
 
 	texture = std::make_unique<sf::Texture>();
 	texture->create(mapWidth, mapHeight);
 
 	render(); // Update map so it's visible on startup
-
-	availableThreads = std::thread::hardware_concurrency();
-
-	threadPool = std::make_unique<ThreadPool>(availableThreads);
 }
 
 /// <summary>
@@ -31,163 +29,22 @@ TerrainGenerator::~TerrainGenerator()
 }
 
 /// <summary>
-/// Generate a terrain/height map.
+/// Generate a terrain map and time it.
 /// </summary>
 /// <param name="width">The width of the map.</param>
 /// <param name="height">The height of the map.</param>
 /// <param name="seed">A seed value for map randomization. Any given seed will always produce the same result.</param>
-/// <param name="array">The height map is stored here.</param>
-void TerrainGenerator::generate(int width, int height, int seed, std::vector<float> &array)
+void TerrainGenerator::generate(int width, int height, int seed)
 {
-	// Clear the height map if not empty
-	if (array.size() > 0)
-	{
-		array.clear();
-	}
-
-	array.resize(width * height);
-
-	// Store futures in here
-	std::vector<std::future<void>> futures;
-
+	poolStats.begin();
+	perfCounters.begin();
 	Timer timer("Terrain Generator");
 
-	if (multiThreaded)
-	{
-		int sectionW = mapWidth / 16;
-		int sectionH = mapHeight / 16;
-
-		// Add the jobs to the thread pool
-		for (int y = 0; y < 16; ++y)
-		{
-			for (int x = 0; x < 16; ++x)
-			{
-				// This lambda adds a block of code to the thread pool as a job
-				auto f = threadPool->addJob([=]
-					{
-						int startX = x * sectionW;
-						int startY = y * sectionH;
-
-						int endX = startX + sectionW;
-						int endY = startY + sectionH;
-
-						generateSection(sf::Vector2i(startX, startY), sf::Vector2i(endX, endY));
-					});
-
-				futures.push_back(std::move(f));
-			}
-		}
-	}
-	else
-	{
-		generateSection({ 0, 0 }, { mapWidth, mapHeight });
-
-		ms = timer.stop();
-	}
-
-	if (multiThreaded)
-	{
-		// Wait for all threads to finish
-		for (auto &future : futures)
-		{
-			future.wait();
-		}
-
-		ms = timer.stop();
-	}
-
-	float min = 0;
-	float max = 0;
-
-	// Initialise min and max from first two elevation map elements
-	if (heightMap[0] > heightMap[1])
-	{
-		max = heightMap[0];
-		min = heightMap[1];
-	}
-	else
-	{
-		max = heightMap[1];
-		min = heightMap[0];
-	}
-
-	// First pass of array to find MIN and MAX values
-	for (int y = 0; y < mapHeight; ++y)
-	{
-		for (int x = 0; x < mapWidth; ++x)
-		{
-			float yValue = heightMap[y * mapWidth + x];
-
-			// Set min and max values from array
-			if (yValue > max)
-			{
-				max = yValue;
-			}
-			else if (yValue < min)
-			{
-				min = yValue;
-			}
-		}
-	}
-
-	float yValue = 0.0f;
-
-	// Second pass of array to normalise values using MIN and MAX
-	for (int y = 0; y < mapHeight; ++y)
-	{
-		for (int x = 0; x < mapWidth; ++x)
-		{
-			float arrVal = heightMap[y * mapWidth + x];
-			heightMap[y * mapWidth + x] = noise->normaliseToRange(arrVal, min, max) * 10; // Between 0 and 9;
-
-			if (heightMap[y * mapWidth + x] > 9)
-			{
-				heightMap[y * mapWidth + x] = 9;
-			}
-
-			if (heightMap[y * mapWidth + x] < 0)
-			{
-				heightMap[y * mapWidth + x] = 0;
-			}
-		}
-	}
-}
+	terrainMap.generate(width, height, seed, currentTerrainID, multiThreaded, threadLimit);
 
-/// <summary>
-/// Generates a block of terrain to the given dimensions.
-/// </summary>
-/// <param name="pixTL">The coordinate of the upper-left corner of the section.</param>
-/// <param name="pixBR">The coordinate of the lower-right corner of the section.</param>
-void TerrainGenerator::generateSection(sf::Vector2i pixTL, sf::Vector2i pixBR)
-{
-	// Generate terrain
-	for (unsigned int y = pixTL.y; y < pixBR.y; ++y)
-	{
-		for (unsigned int x = pixTL.x; x < pixBR.x; ++x)
-		{
-			int index = (y * mapWidth + x);
-
-			// Out of bounds check
-			if (index < 0 || (index * 4) >(pixelArray.size() - 1))
-			{
-				continue;
-			}
-
-			float freqX = x / static_cast<float>(mapWidth) - 0.5f;
-			float freqY = y / static_cast<float>(mapHeight) - 0.5f;
-
-			double e = (1.00f * noise->generate(1.0 * (double)freqX, 1.0 * (double)freqY)
-				+ 0.50f * noise->generate(2.0 * (double)freqX + seed, 2.0 * (double)freqY + seed)
-				+ 0.25f * noise->generate(4.0 * (double)freqX + seed, 4.0 * (double)freqY + seed)
-				+ 0.13f * noise->generate(8.0 * (double)freqX + seed, 8.0 * (double)freqY + seed)
-				+ 0.06f * noise->generate(16.0 * (double)freqX + seed, 16.0 * (double)freqY + seed)
-				+ 0.03f * noise->generate(32.0 * (double)freqX + seed, 32.0 * (double)freqY + seed));
-
-			e /= (3.00 + 0.50 + 0.25 + 0.13 + 0.06 + 0.03);
-			e = pow(e, 4.0f);
-			heightMap[y * mapWidth + x] = e;
-		}
-	}
+	ms = timer.stop();
+	poolStats.end();
+	perfCounters.end();
 }
 
 /// <summary>
@@ -206,11 +63,6 @@ void TerrainGenerator::handleUI()
 
 			ImGui::Text("Click the 'Generate Map' button to");
 			ImGui::Text("create a randomised terrain map.");
-			ImGui::Text("When generating a map directly after");
-			ImGui::Text("switching from multi threaded to");
-			ImGui::Text("single threaded, only a portion of the");
-			ImGui::Text("map may render. Re-generate the map to");
-			ImGui::Text("fix this.");
 
 			ImGui::Dummy(ImVec2(0.0f, 8.0f));
 		}
@@ -271,13 +123,13 @@ void TerrainGenerator::handleUI()
 			{
 				std::uniform_int_distribution<int> dist(0, 65535);
 				seed = dist(mt);
-				generate(mapWidth, mapHeight, seed, heightMap);
+				generate(mapWidth, mapHeight, seed);
 				render();
 			}
 			else
 			{
 				seed = enteredSeed;
-				generate(mapWidth, mapHeight, enteredSeed, heightMap);
+				generate(mapWidth, mapHeight, enteredSeed);
 				render();
 			}
 		}
@@ -299,6 +151,10 @@ void TerrainGenerator::handleUI()
 
 			ImGui::Dummy(ImVec2(0.0f, 8.0f));
 
+			ImGui::SliderInt("Thread Limit##094", &threadLimit, 1, static_cast<int>(threadPool->getThreadAmount()) + 1);
+
+			ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
 			ImGui::SeparatorText("Execution Time##092");
 
 			ImGui::Dummy(ImVec2(0.0f, 8.0f));
@@ -308,6 +164,12 @@ void TerrainGenerator::handleUI()
 			ImGui::Text(milliSecs.c_str());
 
 			ImGui::Dummy(ImVec2(0.0f, 8.0f));
+
+			poolStats.handleUI();
+
+			perfCounters.handleUI();
+
+			scalingPanel.handleUI([this](int threads) { return runAtThreads(threads); });
 		}
 	}
 
@@ -322,59 +184,40 @@ void TerrainGenerator::handleUI()
 /// <summary>
 /// Draw the terrain map.
 /// This does NOT get done on every frame, instead the map is only
-/// rendered when the terrain data is updated.
+/// rendered when the terrain data is updated. The pixels are coloured in
+/// by generate(), so this only has to copy them to the texture.
 /// </summary>
 void TerrainGenerator::render()
 {
-	pixelArray.resize(mapWidth * mapHeight * 4);
-
-	// Set every value to 0
-	std::fill(pixelArray.begin(), pixelArray.end(), 0);
-
-	for (int y = 0; y < mapHeight; ++y)
-	{
-		for (int x = 0; x < mapWidth; ++x)
-		{
-			// Out of bounds check
-			if (y < 0 || y >= mapHeight || x < 0 || x >= mapWidth)
-			{
-				continue;
-			}
+	texture->update(terrainMap.getPixels().data());
+}
 
-			// Get the height from the height map
-			int index = y * mapWidth + x;
-			int height = static_cast<int>(heightMap[index]);
+/// <summary>
+/// Generate the current map on a given number of threads, for the scaling sweep.
+/// The map is generated at the width and height entered, so the texture is
+/// made again if they have changed.
+/// </summary>
+/// <param name="threads">The number of threads to use, 1 for the single-threaded path.</param>
+/// <returns>The time taken in milliseconds.</returns>
+double TerrainGenerator::runAtThreads(int threads)
+{
+	bool savedMultiThreaded = multiThreaded;
+	int savedLimit = threadLimit;
 
-			sf::Color tileColour;
+	multiThreaded = threads > 1;
+	threadLimit = threads;
+	generate(mapWidth, mapHeight, seed);
+	multiThreaded = savedMultiThreaded;
+	threadLimit = savedLimit;
 
-			switch (currentTerrainID)
-			{
-				case 0:
-				{
-					tileColour = EARTH[height];
-					break;
-				}					
-
-				case 1:
-				{
-					tileColour = MARS[height];
-					break;
-				}				
-
-				case 2:
-				{
-					tileColour = MOON[height];
-					break;
-				}				
-			}
-
-			// Update pixel array - RGBA
-			pixelArray[index * 4] = tileColour.r;
-			pixelArray[(index * 4) + 1] = tileColour.g;
-			pixelArray[(index * 4) + 2] = tileColour.b;
-			pixelArray[(index * 4) + 3] = 255;
-		}
+	// The width or height may have been edited since the map was last generated
+	if (texture->getSize() != sf::Vector2u(mapWidth, mapHeight))
+	{
+		texture = std::make_unique<sf::Texture>();
+		texture->create(mapWidth, mapHeight);
 	}
 
-	texture->update(pixelArray.data());
+	render();
+
+	return ms;
 }
@@ -0,0 +1,285 @@
+#include "TerrainMap.h"
+
+/// <summary>
+/// TerrainMap constructor.
+/// </summary>
+/// <param name="threadPool">The pool to run on when multi-threaded.</param>
+TerrainMap::TerrainMap(ThreadPool &threadPool) : threadPool(&threadPool)
+{
+	noise = std::make_unique<Noise>();
+}
+
+/// <summary>
+/// TerrainMap destructor.
+/// </summary>
+TerrainMap::~TerrainMap()
+{
+
+}
+
+/// <summary>
+/// Generate a terrain/height map and colour it in.
+/// The stages are: generate the noise, find the lowest and highest points,
+/// normalise every height to 0-9 using them, then colour each pixel.
+/// </summary>
+/// <param name="width">The width of the map.</param>
+/// <param name="height">The height of the map.</param>
+/// <param name="seed">A seed value for map randomization. Any given seed will always produce the same result.</param>
+/// <param name="terrainID">The colour scheme (0 Earth, 1 Mars, 2 Moon).</param>
+/// <param name="multiThreaded">False for single-threaded and true for multi-threaded.</param>
+/// <param name="threadLimit">The most threads to use when multi-threaded.</param>
+void TerrainMap::generate(int width, int height, int seed, int terrainID, bool multiThreaded, int threadLimit)
+{
+	PROFILE_SCOPE("Terrain Generate");
+
+	mapWidth = width;
+	mapHeight = height;
+	this->seed = seed;
+	currentTerrainID = terrainID;
+
+	heightMap.resize(width * height);
+	pixelArray.resize(width * height * 4); // RGBA values stored here
+
+	if (multiThreaded)
+	{
+		runPipeline(threadLimit);
+	}
+	else
+	{
+		PERF_SCOPE(*perfTotals);
+
+		float min = 0;
+		float max = 0;
+
+		generateSection({ 0, 0 }, { mapWidth, mapHeight });
+		findRange({ 0, 0 }, { mapWidth, mapHeight }, min, max);
+		normaliseSection({ 0, 0 }, { mapWidth, mapHeight }, min, max);
+		colouriseSection({ 0, 0 }, { mapWidth, mapHeight });
+	}
+}
+
+/// <summary>
+/// Get the height map. Each height is a whole number between 0 and 9.
+/// </summary>
+/// <returns>The height map, one value per pixel in rows.</returns>
+const std::vector<float> &TerrainMap::getHeightMap() const
+{
+	return heightMap;
+}
+
+/// <summary>
+/// Get the coloured-in map.
+/// </summary>
+/// <returns>The RGBA pixels of the map.</returns>
+const std::vector<uint8_t> &TerrainMap::getPixels() const
+{
+	return pixelArray;
+}
+
+/// <summary>
+/// Set the totals that the hardware counters of every stage are added to.
+/// Until this is called they go to totals nobody reads.
+/// </summary>
+/// <param name="totals">The totals.</param>
+void TerrainMap::setPerfTotals(PerfCounterTotals &totals)
+{
+	perfTotals = &totals;
+}
+
+/// <summary>
+/// Run every stage of generate() on the pool.
+/// The noise stage splits the map into whole-row strips with parallelFor2D,
+/// a few per thread so a slow strip doesn't hold the rest up. Each strip
+/// finds its own lowest and highest points as soon as its noise is done, so
+/// the only point where every strip has to wait is when those are combined.
+/// After that each strip is normalised and coloured in straight away, without
+/// waiting on the others.
+/// </summary>
+/// <param name="threadLimit">The most threads to use, including the calling thread.</param>
+void TerrainMap::runPipeline(int threadLimit)
+{
+	int stripAmount = std::min(getConcurrency(*threadPool, threadLimit) * CHUNKS_PER_THREAD, mapHeight);
+	int stripHeight = (mapHeight + stripAmount - 1) / stripAmount;
+	stripAmount = (mapHeight + stripHeight - 1) / stripHeight;
+
+	stripMin.assign(stripAmount, 0.0f);
+	stripMax.assign(stripAmount, 0.0f);
+
+	parallelFor2D(*threadPool, { 0, 0, mapWidth, mapHeight }, { 0, stripHeight }, [this, stripHeight](const Range2D &strip)
+	{
+		PROFILE_SCOPE("Terrain Noise");
+		PERF_SCOPE(*perfTotals);
+
+		int i = strip.beginY / stripHeight;
+		generateSection({ strip.beginX, strip.beginY }, { strip.endX, strip.endY });
+		findRange({ strip.beginX, strip.beginY }, { strip.endX, strip.endY }, stripMin[i], stripMax[i]);
+	}, threadLimit);
+
+	// Combine each strip's range into one for the whole map
+	{
+		PROFILE_SCOPE("Terrain Combine");
+		PERF_SCOPE(*perfTotals);
+		heightMin = *std::min_element(stripMin.begin(), stripMin.end());
+		heightMax = *std::max_element(stripMax.begin(), stripMax.end());
+	}
+
+	parallelFor2D(*threadPool, { 0, 0, mapWidth, mapHeight }, { 0, stripHeight }, [this](const Range2D &strip)
+	{
+		PERF_SCOPE(*perfTotals);
+
+		{
+			PROFILE_SCOPE("Terrain Normalise");
+			normaliseSection({ strip.beginX, strip.beginY }, { strip.endX, strip.endY }, heightMin, heightMax);
+		}
+
+		{
+			PROFILE_SCOPE("Terrain Colourise");
+			colouriseSection({ strip.beginX, strip.beginY }, { strip.endX, strip.endY });
+		}
+	}, threadLimit);
+}
+
+/// <summary>
+/// Generates a block of terrain to the given dimensions.
+/// </summary>
+/// <param name="pixTL">The coordinate of the upper-left corner of the section.</param>
+/// <param name="pixBR">The coordinate of the lower-right corner of the section.</param>
+void TerrainMap::generateSection(sf::Vector2i pixTL, sf::Vector2i pixBR)
+{
+	// Generate terrain
+	for (unsigned int y = pixTL.y; y < pixBR.y; ++y)
+	{
+		for (unsigned int x = pixTL.x; x < pixBR.x; ++x)
+		{
+			int index = (y * mapWidth + x);
+
+			// Out of bounds check
+			if (index < 0 || index >= static_cast<int>(heightMap.size()))
+			{
+				continue;
+			}
+
+			float freqX = x / static_cast<float>(mapWidth) - 0.5f;
+			float freqY = y / static_cast<float>(mapHeight) - 0.5f;
+
+			double e = (1.00f * noise->generate(1.0 * (double)freqX, 1.0 * (double)freqY)
+				+ 0.50f * noise->generate(2.0 * (double)freqX + seed, 2.0 * (double)freqY + seed)
+				+ 0.25f * noise->generate(4.0 * (double)freqX + seed, 4.0 * (double)freqY + seed)
+				+ 0.13f * noise->generate(8.0 * (double)freqX + seed, 8.0 * (double)freqY + seed)
+				+ 0.06f * noise->generate(16.0 * (double)freqX + seed, 16.0 * (double)freqY + seed)
+				+ 0.03f * noise->generate(32.0 * (double)freqX + seed, 32.0 * (double)freqY + seed));
+
+			e /= (3.00 + 0.50 + 0.25 + 0.13 + 0.06 + 0.03);
+			e = pow(e, 4.0f);
+			heightMap[y * mapWidth + x] = e;
+		}
+	}
+}
+
+/// <summary>
+/// Find the lowest and highest points in a block of the height map.
+/// </summary>
+/// <param name="pixTL">The coordinate of the upper-left corner of the section.</param>
+/// <param name="pixBR">The coordinate of the lower-right corner of the section.</param>
+/// <param name="min">The lowest height is stored here.</param>
+/// <param name="max">The highest height is stored here.</param>
+void TerrainMap::findRange(sf::Vector2i pixTL, sf::Vector2i pixBR, float &min, float &max)
+{
+	min = heightMap[pixTL.y * mapWidth + pixTL.x];
+	max = min;
+
+	for (int y = pixTL.y; y < pixBR.y; ++y)
+	{
+		for (int x = pixTL.x; x < pixBR.x; ++x)
+		{
+			float yValue = heightMap[y * mapWidth + x];
+
+			// Set min and max values from array
+			if (yValue > max)
+			{
+				max = yValue;
+			}
+
+			if (yValue < min)
+			{
+				min = yValue;
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Normalise a block of the height map to whole heights between 0 and 9.
+/// </summary>
+/// <param name="pixTL">The coordinate of the upper-left corner of the section.</param>
+/// <param name="pixBR">The coordinate of the lower-right corner of the section.</param>
+/// <param name="min">The lowest height in the whole map.</param>
+/// <param name="max">The highest height in the whole map.</param>
+void TerrainMap::normaliseSection(sf::Vector2i pixTL, sf::Vector2i pixBR, float min, float max)
+{
+	for (int y = pixTL.y; y < pixBR.y; ++y)
+	{
+		for (int x = pixTL.x; x < pixBR.x; ++x)
+		{
+			float arrVal = heightMap[y * mapWidth + x];
+			heightMap[y * mapWidth + x] = noise->normaliseToRange(arrVal, min, max) * 10; // Between 0 and 9;
+
+			if (heightMap[y * mapWidth + x] > 9)
+			{
+				heightMap[y * mapWidth + x] = 9;
+			}
+
+			if (heightMap[y * mapWidth + x] < 0)
+			{
+				heightMap[y * mapWidth + x] = 0;
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Colour in a block of the pixel array from the normalised height map.
+/// </summary>
+/// <param name="pixTL">The coordinate of the upper-left corner of the section.</param>
+/// <param name="pixBR">The coordinate of the lower-right corner of the section.</param>
+void TerrainMap::colouriseSection(sf::Vector2i pixTL, sf::Vector2i pixBR)
+{
+	for (int y = pixTL.y; y < pixBR.y; ++y)
+	{
+		for (int x = pixTL.x; x < pixBR.x; ++x)
+		{
+			// Get the height from the height map
+			int index = y * mapWidth + x;
+			int height = static_cast<int>(heightMap[index]);
+
+			TerrainColour tileColour{};
+
+			switch (currentTerrainID)
+			{
+				case 0:
+				{
+					tileColour = EARTH[height];
+					break;
+				}
+
+				case 1:
+				{
+					tileColour = MARS[height];
+					break;
+				}
+
+				case 2:
+				{
+					tileColour = MOON[height];
+					break;
+				}
+			}
+
+			// Update pixel array - RGBA
+			pixelArray[index * 4] = tileColour.r;
+			pixelArray[(index * 4) + 1] = tileColour.g;
+			pixelArray[(index * 4) + 2] = tileColour.b;
+			pixelArray[(index * 4) + 3] = 255;
+		}
+	}
+}
@@ -1,12 +1,34 @@
 #include "ThreadPool.h"
 
+namespace
+{
+	// The pool and queue index of the worker running on this thread
+	// (nullptr on any thread that isn't one of the pool's workers)
+	thread_local ThreadPool *currentPool = nullptr;
+	thread_local std::size_t currentQueue = 0;
+
+	// How many jobs deep this thread is, so a job that runs other jobs
+	// while it waits doesn't count that time as busy twice
+	thread_local int jobDepth = 0;
+
+	/// <summary>
+	/// Get the current time for the pool's counters.
+	/// </summary>
+	/// <returns>The time in nanoseconds.</returns>
+	std::uint64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
 /// <summary>
 /// ThreadPool constructor.
 /// </summary>
 /// <param name="threadAmount">Set the number of threads in the pool.</param>
 ThreadPool::ThreadPool(std::size_t threadAmount)
 {
-	start(threadAmount);
+	// hardware_concurrency() is allowed to return 0
+	start(std::max<std::size_t>(threadAmount, 1));
 }
 
 /// <summary>
@@ -17,45 +39,39 @@ ThreadPool::~ThreadPool()
 	stop();
 }
 
+/// <summary>
+/// Get the number of worker threads in the pool.
+/// </summary>
+/// <returns>The number of worker threads.</returns>
+std::size_t ThreadPool::getThreadAmount() const
+{
+	return threads.size();
+}
+
 /// <summary>
 /// Start pool.
 /// </summary>
 /// <param name="threadAmount">Set the number of threads in the pool.</param>
 void ThreadPool::start(std::size_t threadAmount)
 {
+	// All queues must exist before any worker starts stealing from them
 	for (auto i = 0u; i < threadAmount; ++i)
 	{
-		threads.emplace_back([=]
-		{
-			// Loop runs as long as there's jobs
-			while (true)
-			{
-				Job job;
-
-				// New scope
-				{
-					std::unique_lock<std::mutex> lock{ eventMutex };
-					eventVar.wait(lock, [=] { return stopping || !jobs.empty(); });
-
-					// Break out of loop if thread is stopping and there's no jobs left
-					if (stopping && jobs.empty())
-					{
-						break;
-					}
-
-					// Move front job to current job
-					job = std::move(jobs.front());
-					jobs.pop();
-				}
-				
-				job();
-			}
-		});
+		queues.push_back(std::make_unique<WorkerQueue>());
+	}
+
+	// One set of counters per worker, plus one shared by every other thread
+	counters = std::make_unique<ThreadCounters[]>(threadAmount + 1);
+
+	for (auto i = 0u; i < threadAmount; ++i)
+	{
+		threads.emplace_back([=] { runWorker(i); });
 	}
 }
 
 /// <summary>
 /// Stop all threads.
+/// Any jobs still queued are finished first.
 /// </summary>
 void ThreadPool::stop() noexcept
 {
@@ -72,4 +88,369 @@ void ThreadPool::stop() noexcept
 	{
 		thread.join();
 	}
-}
\ No newline at end of file
+}
+
+/// <summary>
+/// Wait until every job added with the given counter has finished.
+/// While waiting, the calling thread runs any queued jobs from the same
+/// batch itself, so it adds to the work instead of sitting idle. It only
+/// goes to sleep once the rest of the batch is already running elsewhere.
+/// </summary>
+/// <param name="counter">The counter to wait on.</param>
+void ThreadPool::wait(const JobCounter &counter)
+{
+	while (!counter.isDone())
+	{
+		Job job;
+
+		if (takeGroupJob(counter, job))
+		{
+			runJob(job);
+			continue;
+		}
+
+		// Nothing left to help with, so sleep until a counted job finishes.
+		// A finished job may have added more jobs to the batch, so look
+		// again after every wake-up rather than only when the batch is done
+		std::unique_lock<std::mutex> lock = lockCounted(waitMutex);
+
+		waitingThreads.fetch_add(1);
+
+		if (!counter.isDone())
+		{
+			std::uint64_t sleepStart = now();
+			waitVar.wait(lock);
+			getCounters().waitNs.fetch_add(now() - sleepStart, std::memory_order_relaxed);
+		}
+
+		waitingThreads.fetch_sub(1);
+	}
+}
+
+/// <summary>
+/// Add a job to one of the worker queues and wake a sleeping worker if there is one.
+/// Jobs added from a worker go to that worker's own queue, jobs added from
+/// anywhere else are spread across the queues in turn.
+/// </summary>
+/// <param name="job">The job to add.</param>
+void ThreadPool::push(Job &&job)
+{
+	std::size_t index = (currentPool == this) ? currentQueue : nextQueue.fetch_add(1) % queues.size();
+
+	// Counted before it's queued so the count can never drop below zero
+	pendingJobs.fetch_add(1);
+
+	// New scope
+	{
+		WorkerQueue &queue = *queues[index];
+		std::unique_lock<std::mutex> lock = lockCounted(queue.mutex);
+
+		queue.jobs.pushBack(std::move(job));
+
+		if (queue.jobs.size() > queue.highWater.load(std::memory_order_relaxed))
+		{
+			queue.highWater.store(queue.jobs.size(), std::memory_order_relaxed);
+		}
+
+		std::uint32_t watches = activeWatches.load();
+
+		for (int watch = 0; watches != 0; ++watch, watches >>= 1)
+		{
+			if ((watches & 1) != 0)
+			{
+				queue.watchHighWater[watch] = std::max<std::uint64_t>(queue.watchHighWater[watch], queue.jobs.size());
+			}
+		}
+	}
+
+	// The event mutex is only touched when somebody is actually asleep.
+	// Locking it before notifying means a worker that is just about to sleep
+	// is either already waiting or will see the new job when it checks
+	if (sleepingThreads.load() > 0)
+	{
+		{
+			std::unique_lock<std::mutex> lock = lockCounted(eventMutex);
+		}
+
+		eventVar.notify_one();
+	}
+}
+
+/// <summary>
+/// Take the newest job from a worker's own queue.
+/// </summary>
+/// <param name="index">The worker's queue index.</param>
+/// <param name="job">The job is moved in here.</param>
+/// <returns>True if a job was found.</returns>
+bool ThreadPool::popJob(std::size_t index, Job &job)
+{
+	std::unique_lock<std::mutex> lock = lockCounted(queues[index]->mutex);
+
+	if (queues[index]->jobs.empty())
+	{
+		return false;
+	}
+
+	job = queues[index]->jobs.popBack();
+	pendingJobs.fetch_sub(1);
+
+	return true;
+}
+
+/// <summary>
+/// Take the oldest job from another worker's queue.
+/// Queues that are busy are skipped rather than waited on.
+/// </summary>
+/// <param name="index">The queue index of the worker doing the stealing.</param>
+/// <param name="job">The job is moved in here.</param>
+/// <returns>True if a job was found.</returns>
+bool ThreadPool::stealJob(std::size_t index, Job &job)
+{
+	for (auto i = 1u; i < queues.size(); ++i)
+	{
+		WorkerQueue &victim = *queues[(index + i) % queues.size()];
+
+		std::unique_lock<std::mutex> lock{ victim.mutex, std::try_to_lock };
+
+		if (!lock.owns_lock() || victim.jobs.empty())
+		{
+			continue;
+		}
+
+		job = victim.jobs.popFront();
+		pendingJobs.fetch_sub(1);
+
+		counters[index].jobsStolen.fetch_add(1, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	return false;
+}
+
+/// <summary>
+/// Find a queued job that belongs to the given batch and take it.
+/// A worker checks its own queue first, then every queue is searched from the
+/// newest job to the oldest, as other work may have been queued around the
+/// batch's jobs. Busy queues are waited on rather than skipped, so a job from
+/// the batch is never missed before the caller goes to sleep.
+/// </summary>
+/// <param name="group">The counter the job must report to.</param>
+/// <param name="job">The job is moved in here.</param>
+/// <returns>True if a job was found.</returns>
+bool ThreadPool::takeGroupJob(const JobCounter &group, Job &job)
+{
+	std::size_t first = (currentPool == this) ? currentQueue : 0;
+
+	for (auto i = 0u; i < queues.size(); ++i)
+	{
+		WorkerQueue &queue = *queues[(first + i) % queues.size()];
+
+		std::unique_lock<std::mutex> lock = lockCounted(queue.mutex);
+
+		if (!queue.jobs.takeMatching(&group, job))
+		{
+			continue;
+		}
+
+		pendingJobs.fetch_sub(1);
+
+		return true;
+	}
+
+	return false;
+}
+
+/// <summary>
+/// Run a job and, if it was part of a batch, wake any threads waiting on a batch.
+/// </summary>
+/// <param name="job">The job to run.</param>
+void ThreadPool::runJob(Job &job)
+{
+	bool counted = job.getCounter() != nullptr;
+	ThreadCounters &threadCounters = getCounters();
+	std::uint64_t jobStart = (jobDepth == 0) ? now() : 0;
+
+	++jobDepth;
+	job();
+	--jobDepth;
+
+	threadCounters.jobsExecuted.fetch_add(1, std::memory_order_relaxed);
+
+	if (jobDepth == 0)
+	{
+		threadCounters.busyNs.fetch_add(now() - jobStart, std::memory_order_relaxed);
+	}
+
+	// Locking before notifying means a thread that is just about to sleep in
+	// wait() is either already asleep or will see the finished counter
+	if (counted && waitingThreads.load() > 0)
+	{
+		{
+			std::unique_lock<std::mutex> lock{ waitMutex };
+		}
+
+		waitVar.notify_all();
+	}
+}
+
+/// <summary>
+/// The loop each worker thread runs until the pool is stopped.
+/// </summary>
+/// <param name="index">The worker's queue index.</param>
+void ThreadPool::runWorker(std::size_t index)
+{
+	currentPool = this;
+	currentQueue = index;
+
+	// Loop runs as long as there's jobs
+	while (true)
+	{
+		Job job;
+
+		if (popJob(index, job) || stealJob(index, job))
+		{
+			runJob(job);
+			continue;
+		}
+
+		// Nothing to do, so sleep until a job is added
+		std::unique_lock<std::mutex> lock = lockCounted(eventMutex);
+
+		std::uint64_t parkStart = now();
+
+		sleepingThreads.fetch_add(1);
+		eventVar.wait(lock, [=] { return stopping || pendingJobs.load() > 0; });
+		sleepingThreads.fetch_sub(1);
+
+		counters[index].parkedNs.fetch_add(now() - parkStart, std::memory_order_relaxed);
+
+		// Break out of loop if thread is stopping and there's no jobs left
+		if (stopping && pendingJobs.load() == 0)
+		{
+			break;
+		}
+	}
+}
+
+/// <summary>
+/// Read every thread's counters.
+/// The counters keep running while they're read, so each value is exact
+/// but they may be from very slightly different moments.
+/// </summary>
+/// <returns>One entry per worker, then one last entry for all threads outside the pool (those that help in wait()).</returns>
+std::vector<ThreadStats> ThreadPool::getStats() const
+{
+	std::vector<ThreadStats> stats(queues.size() + 1);
+
+	for (std::size_t i = 0; i < stats.size(); ++i)
+	{
+		const ThreadCounters &source = counters[i];
+
+		stats[i].jobsExecuted = source.jobsExecuted.load(std::memory_order_relaxed);
+		stats[i].jobsStolen = source.jobsStolen.load(std::memory_order_relaxed);
+		stats[i].busyNs = source.busyNs.load(std::memory_order_relaxed);
+		stats[i].parkedNs = source.parkedNs.load(std::memory_order_relaxed);
+		stats[i].waitNs = source.waitNs.load(std::memory_order_relaxed);
+		stats[i].lockWaitNs = source.lockWaitNs.load(std::memory_order_relaxed);
+
+		if (i < queues.size())
+		{
+			stats[i].queueHighWater = queues[i]->highWater.load(std::memory_order_relaxed);
+		}
+	}
+
+	return stats;
+}
+
+/// <summary>
+/// Start measuring how deep each queue gets from now on, without affecting
+/// any other watch. The other counters only ever go up, so they can be
+/// compared between two snapshots instead.
+/// </summary>
+/// <returns>The watch, to pass to stopHighWaterWatch(), or -1 if MAX_WATCHES are already running.</returns>
+int ThreadPool::startHighWaterWatch()
+{
+	std::uint32_t claimed = claimedWatches.load();
+	int watch = 0;
+
+	do
+	{
+		for (watch = 0; watch < MAX_WATCHES && (claimed & (1u << watch)) != 0; ++watch)
+		{
+		}
+
+		if (watch == MAX_WATCHES)
+		{
+			return -1;
+		}
+	} while (!claimedWatches.compare_exchange_weak(claimed, claimed | (1u << watch)));
+
+	// Each queue starts from how deep it is now. A push holds the queue's lock
+	// while it records, so nothing recorded for the watch's last user survives
+	for (auto &queue : queues)
+	{
+		std::unique_lock<std::mutex> lock = lockCounted(queue->mutex);
+		queue->watchHighWater[watch] = queue->jobs.size();
+	}
+
+	activeWatches.fetch_or(1u << watch);
+
+	return watch;
+}
+
+/// <summary>
+/// Stop a watch and get how deep each queue got while it ran.
+/// </summary>
+/// <param name="watch">The watch from startHighWaterWatch().</param>
+/// <returns>The deepest each worker's queue got, or nothing if the watch is -1.</returns>
+std::vector<std::uint64_t> ThreadPool::stopHighWaterWatch(int watch)
+{
+	std::vector<std::uint64_t> highWater;
+
+	if (watch < 0)
+	{
+		return highWater;
+	}
+
+	activeWatches.fetch_and(~(1u << watch));
+
+	for (auto &queue : queues)
+	{
+		std::unique_lock<std::mutex> lock = lockCounted(queue->mutex);
+		highWater.push_back(queue->watchHighWater[watch]);
+	}
+
+	claimedWatches.fetch_and(~(1u << watch));
+
+	return highWater;
+}
+
+/// <summary>
+/// Get the counters for the calling thread.
+/// </summary>
+/// <returns>The worker's own counters, or the shared ones for any other thread.</returns>
+ThreadPool::ThreadCounters &ThreadPool::getCounters()
+{
+	return counters[(currentPool == this) ? currentQueue : queues.size()];
+}
+
+/// <summary>
+/// Lock a mutex, adding any time spent waiting for it to the calling thread's counters.
+/// The clock is only read when the mutex is already taken.
+/// </summary>
+/// <param name="mutex">The mutex to lock.</param>
+/// <returns>The lock.</returns>
+std::unique_lock<std::mutex> ThreadPool::lockCounted(std::mutex &mutex)
+{
+	std::unique_lock<std::mutex> lock{ mutex, std::try_to_lock };
+
+	if (!lock.owns_lock())
+	{
+		std::uint64_t lockStart = now();
+		lock.lock();
+		getCounters().lockWaitNs.fetch_add(now() - lockStart, std::memory_order_relaxed);
+	}
+
+	return lock;
+}